@@ -10,208 +10,462 @@
 #include "ConverterController.h"
 #include "../services/ConversionManager.h"
 #include "../services/RateLimiter.h"
+#include "../services/FileExpiry.h"
+#include "../services/StorageManager.h"
+#include "../services/ScratchSpace.h"
+#include "../services/MediaProbe.h"
+#include "../services/ProgressTracker.h"
+#include "../services/SegmentPlanner.h"
+#include "../services/OutputStreamer.h"
+#include "../services/BlockingExecutor.h"
+#include "../services/FileIO.h"
+#include "../services/BatchRegistry.h"
+#include "../services/JobTrace.h"
+#include "../services/PresetRegistry.h"
+#include "../services/Lifecycle.h"
 #include <drogon/utils/Utilities.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <cstdlib>
+#include <deque>
+#include <exception>
 #include <filesystem>
 #include <iostream>
+#include <mutex>
+#include <sstream>
 
-void ConverterController::convert(const HttpRequestPtr &req,
-                                  std::function<void(const HttpResponsePtr &)> &&callback)
-{
-    // Step 1: Rate Limiting
-    // Check if the client IP has exceeded the allowed number of requests per hour.
-    std::string clientIP = req->getPeerAddr().toIp();
-    if (!RateLimiter::instance().isAllowed(clientIP)) {
-        auto resp = HttpResponse::newHttpResponse();
-        resp->setStatusCode(k429TooManyRequests);
-        
-        Json::Value json;
-        json["status"] = "error";
-        json["error"] = "Rate limit exceeded. Maximum 10 conversions per hour.";
-        json["remaining"] = RateLimiter::instance().getRemainingRequests(clientIP);
-        
-        resp->setBody(json.toStyledString());
-        resp->setContentTypeCode(CT_APPLICATION_JSON);
-        callback(resp);
-        return;
-    }
-    
-    // Step 2: Handle File Upload
-    // Parse the multipart request to extract the uploaded file.
-    MultiPartParser fileUpload;
-    if (fileUpload.parse(req) != 0 || fileUpload.getFiles().empty())
-    {
-        auto resp = HttpResponse::newHttpResponse();
-        resp->setStatusCode(k400BadRequest);
-        resp->setBody("No file uploaded");
-        callback(resp);
-        return;
+// Decides whether the probed source audio can be remuxed as-is. The podcast
+// preset always re-encodes because it downmixes to mono. Lossy sources are only
+// copied when they are not noticeably larger than the requested preset, so a
+// "low" request still produces a smaller file.
+static bool canStreamCopy(const MediaInfo& info, const EncoderPreset& preset) {
+    auto config = drogon::app().getCustomConfig()["conversion"];
+    if (!config.get("stream_copy", true).asBool()) return false;
+    if (preset.quality == "podcast" || !info.canStreamCopy(preset.format)) return false;
+
+    int64_t target = preset.bitrate;
+    if (target == 0 || info.audioBitrate == 0) return true; // Lossless, or bitrate not declared
+    return info.audioBitrate <= target + target / 10;
+}
+
+// Rough upper bound for the output size, used for storage admission before the
+// transcode starts (see EncoderPreset::sizeRatio).
+static uint64_t estimateOutputBytes(const EncoderPreset& preset, uint64_t inputBytes) {
+    return static_cast<uint64_t>(inputBytes * preset.sizeRatio);
+}
+
+// Parses a time offset given as seconds ("90", "90.5") or as "MM:SS" /
+// "HH:MM:SS" with optional fractional seconds.
+static bool parseTimestamp(const std::string& text, double& seconds) {
+    if (text.empty() || text.size() > 32) return false;
+    seconds = 0;
+    size_t begin = 0;
+    int fields = 0;
+    while (true) {
+        size_t colon = text.find(':', begin);
+        std::string field = text.substr(begin, colon == std::string::npos ? std::string::npos : colon - begin);
+        bool lastField = colon == std::string::npos;
+        if (field.empty() || ++fields > 3) return false;
+        // Only digits, plus a decimal point in the seconds field
+        for (char c : field) {
+            if (!isdigit(static_cast<unsigned char>(c)) && !(lastField && c == '.')) return false;
+        }
+        char* end = nullptr;
+        double value = std::strtod(field.c_str(), &end);
+        if (*end != '\0') return false;
+        if (fields > 1 && value >= 60) return false; // Minutes/seconds after a colon
+        seconds = seconds * 60 + value;
+        if (lastField) break;
+        begin = colon + 1;
     }
+    return true;
+}
 
-    auto &file = fileUpload.getFiles()[0];
-    auto uuid = drogon::utils::getUuid(); // Generate unique ID for this conversion task
-    
-    // Step 3: Security Sanitization
-    // Sanitize the original filename to prevent Command Injection and Path Traversal attacks.
-    // We strictly allow only alphanumeric characters, dots, dashes, and underscores.
-    std::string rawFilename = file.getFileName();
+// Largest accepted upload, per file (also per batch item)
+static const size_t MAX_FILE_SIZE = 500 * 1024 * 1024; // 500MB
+
+// Bitrate assumed for media whose duration the probe could not read, when
+// charging the media budget. Few uploads are smaller per second, so the
+// charge is an upper bound for nearly all of them.
+static const double UNKNOWN_DURATION_BITS_PER_SECOND = 128000;
+
+// Replaces everything but alphanumerics, dots, dashes and underscores, so a
+// filename can never inject arguments or traverse paths.
+static std::string sanitizeFilename(const std::string& rawFilename) {
     std::string safeFilename;
     for (char c : rawFilename) {
-        if (isalnum(c) || c == '.' || c == '-' || c == '_') {
+        if (isalnum(static_cast<unsigned char>(c)) || c == '.' || c == '-' || c == '_') {
             safeFilename += c;
         } else {
             safeFilename += '_';
         }
     }
-    
+
     // Fallback if filename becomes empty (e.g., was all special symbols)
     if (safeFilename.empty() || safeFilename == "." || safeFilename == "..") {
         safeFilename = "video_file";
     }
+    return safeFilename;
+}
 
-    std::string uploadDir = "./uploads/";
-    std::string inputFilename = uploadDir + uuid + "_" + safeFilename;
-    
-    // Step 4: File Size Validation
-    // Enforce a maximum file size limit (500MB) to prevent Denial of Service (DoS).
-    const size_t MAX_FILE_SIZE = 500 * 1024 * 1024; // 500MB
-    if (file.fileLength() > MAX_FILE_SIZE) {
-        auto resp = HttpResponse::newHttpResponse();
-        resp->setStatusCode(k413RequestEntityTooLarge);
-        resp->setBody("File too large. Maximum size: 500MB");
-        callback(resp);
-        return;
-    }
-    
-    // Ensure uploads directory exists
-    if (!std::filesystem::exists(uploadDir)) {
-        std::filesystem::create_directory(uploadDir);
-    }
+// Answer to requests for new work while the server drains for a shutdown or
+// restart. The connection is closed so the retry reaches the successor.
+static HttpResponsePtr drainingResponse() {
+    auto resp = HttpResponse::newHttpResponse();
+    resp->setStatusCode(k503ServiceUnavailable);
+    resp->addHeader("Retry-After", std::to_string(Lifecycle::instance().retryAfterSeconds()));
+    resp->setCloseConnection(true);
 
-    // Save the uploaded file to disk
-    file.saveAs(inputFilename);
+    Json::Value json;
+    json["status"] = "error";
+    json["error"] = "Server is restarting. Please retry shortly.";
 
-    // Step 5: Parameter Extraction
-    // Get target format and quality settings from the request.
-    auto &params = fileUpload.getParameters();
-    std::string targetFormat;
+    resp->setBody(json.toStyledString());
+    resp->setContentTypeCode(CT_APPLICATION_JSON);
+    return resp;
+}
+
+// Conversion settings from the form fields of /api/convert and /api/batch
+struct ConversionOptions {
+    std::string targetFormat = "mp3";
+    std::string quality = "medium";
+    double startSeconds = 0;
+    double endSeconds = 0; // 0 = end of input
+    const EncoderPreset* preset = nullptr; // Set when the options are valid
+};
+
+// Reads format, quality, speed and the optional time range; returns an error message if they are invalid
+static std::string parseOptions(const std::unordered_map<std::string, std::string>& params, ConversionOptions& options) {
     auto it = params.find("format");
-    if (it != params.end()) {
-        targetFormat = it->second;
+    if (it != params.end() && !it->second.empty()) {
+        options.targetFormat = it->second;
     }
-    if (targetFormat.empty()) targetFormat = "mp3";
-    
+
     // Get quality preset (high/medium/low/podcast)
-    std::string quality = "medium"; // default
     auto qualityIt = params.find("quality");
     if (qualityIt != params.end()) {
-        quality = qualityIt->second;
+        options.quality = qualityIt->second;
+    }
+
+    // Validate format against the preset table (built-ins plus config.json presets)
+    const PresetRegistry& presets = PresetRegistry::instance();
+    if (!presets.hasFormat(options.targetFormat)) {
+        return "Invalid format. Supported: " + presets.formatList();
+    }
+
+    // Optional speed variant: "fast", or "normal" to opt out of the configured A/B split
+    std::string variant;
+    auto speedIt = params.find("speed");
+    if (speedIt == params.end() || speedIt->second.empty()) {
+        variant = presets.defaultVariant();
+    } else if (speedIt->second == "fast") {
+        variant = "fast";
+    }
+
+    // Validate quality preset
+    options.preset = presets.find(options.targetFormat, options.quality, variant);
+    if (!options.preset) {
+        options.quality = "medium"; // fallback to default
+        options.preset = presets.find(options.targetFormat, options.quality, variant);
+        if (!options.preset) return "No " + options.targetFormat + " preset available";
+    }
+
+    // Optional time range; checked against the probed duration after upload
+    auto startIt = params.find("start");
+    auto endIt = params.find("end");
+    bool badStart = startIt != params.end() && !startIt->second.empty() &&
+                    !parseTimestamp(startIt->second, options.startSeconds);
+    bool badEnd = endIt != params.end() && !endIt->second.empty() &&
+                  !parseTimestamp(endIt->second, options.endSeconds);
+    if (badStart || badEnd || (options.endSeconds > 0 && options.endSeconds <= options.startSeconds)) {
+        return "Invalid time range. Use seconds or HH:MM:SS, with end after start";
+    }
+    return "";
+}
+
+// Validated conversion request handed from the event loop to the blocking executor
+struct UploadJob {
+    HttpRequestPtr req; // Keeps the request, and the file data parsed from it, alive
+    std::shared_ptr<MultiPartParser> parser; // Null for batch items, which are already on disk
+    std::string clientIP;
+    std::string uuid;
+    std::string safeFilename;
+    std::string targetFormat;
+    const EncoderPreset* preset = nullptr; // Quality and speed variant; PresetRegistry is never modified
+    double startSeconds = 0;
+    double endSeconds = 0; // 0 = end of input
+    std::string progressId; // Client-chosen id for /api/progress, may be empty (tracked under ProgressTracker::key)
+    bool progressive = false;
+    BlockingExecutor::ResponseCallback callback; // Posts to the request's event loop
+    JobTracePtr trace; // Stage timings, null when tracing is off
+    Lifecycle::InFlightPtr inFlight; // Holds off a drain until the job is queued
+    std::string batchId; // Set for /api/batch items
+    size_t batchIndex = 0;
+    bool queued = false; // Handed to ConversionManager, which reports the outcome from then on
+
+    // A job rejected before it was queued gives up its claimed progress id
+    ~UploadJob() {
+        if (!queued && !progressId.empty()) {
+            ProgressTracker::instance().finish(ProgressTracker::key(clientIP, progressId), false);
+        }
     }
+};
 
-    // Validate format - now supporting AAC, FLAC, M4A, OPUS
-    if (targetFormat != "mp3" && targetFormat != "wav" && targetFormat != "ogg" &&
-        targetFormat != "aac" && targetFormat != "flac" && targetFormat != "m4a" && targetFormat != "opus") {
+// Notes why a traced job ended early; its record is written once the job is released
+static void traceError(const std::shared_ptr<UploadJob>& job, const std::string& error) {
+    if (job->trace) job->trace->error = error;
+}
+
+static void convertSavedUpload(const std::shared_ptr<UploadJob>& job, const std::string& inputFilename,
+                               const std::string& workDir, ScratchSpace::LeasePtr scratch,
+                               StorageManager::ReservationPtr reservation);
+
+// Step 6 of convert(), run on a BlockingExecutor thread
+static void processUpload(const std::shared_ptr<UploadJob>& job) {
+    const auto& callback = job->callback;
+    const std::string& clientIP = job->clientIP;
+    const std::string& uuid = job->uuid;
+    const std::string& safeFilename = job->safeFilename;
+    auto& file = job->parser->getFiles()[0];
+    std::string uploadDir = "./uploads/";
+
+    // Step 6: Storage Admission
+    // Small jobs keep their upload and intermediate output in the RAM scratch
+    // tier; everything else spills to ./uploads/.
+    uint64_t expectedOutputBytes = estimateOutputBytes(*job->preset, file.fileLength());
+    auto scratch = ScratchSpace::instance().acquire(file.fileLength() + expectedOutputBytes);
+    std::string workDir = scratch ? scratch->directory() : uploadDir;
+    std::string inputFilename = workDir + uuid + "_" + safeFilename;
+
+    // Reserve room for the upload and the expected output up front, so a full
+    // disk rejects the job now instead of failing halfway through a transcode.
+    std::string storageError;
+    auto reservation = StorageManager::instance().reserve(clientIP, scratch ? 0 : file.fileLength(),
+                                                          expectedOutputBytes, storageError);
+    if (!reservation) {
+        traceError(job, storageError);
         auto resp = HttpResponse::newHttpResponse();
-        resp->setStatusCode(k400BadRequest);
-        resp->setBody("Invalid format. Supported: mp3, wav, ogg, aac, flac, m4a, opus");
+        resp->setStatusCode(k507InsufficientStorage);
+
+        Json::Value json;
+        json["status"] = "error";
+        json["error"] = storageError;
+
+        resp->setBody(json.toStyledString());
+        resp->setContentTypeCode(CT_APPLICATION_JSON);
         callback(resp);
-        // Clean up input
-        std::filesystem::remove(inputFilename);
         return;
     }
-    
-    // Validate quality preset
-    if (quality != "high" && quality != "medium" && quality != "low" && quality != "podcast") {
-        quality = "medium"; // fallback to default
+
+    // Ensure uploads directory exists (a failure surfaces when the upload is written)
+    std::error_code dirError;
+    if (!std::filesystem::exists(uploadDir, dirError)) {
+        std::filesystem::create_directory(uploadDir, dirError);
+    }
+
+    // Save the uploaded file to disk (batched io_uring writes when available)
+    std::error_code saveError;
+    if (!FileIO::instance().writeFile(inputFilename, file.fileData(), file.fileLength(), saveError)) {
+        LOG_ERROR << "Failed to save upload: " << inputFilename << ": " << saveError.message();
+        traceError(job, "Failed to store upload");
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k500InternalServerError);
+        resp->setBody("Failed to store upload");
+        callback(resp);
+        return;
     }
+    // Safety net in case the job never completes; normally removed right after conversion
+    FileExpiry::instance().track(inputFilename);
 
     LOG_INFO << "File saved to: " << inputFilename;
+    if (job->trace) {
+        job->trace->saved = JobTrace::now();
+        job->trace->inputBytes = file.fileLength();
+    }
 
-    std::string outputFilename = uploadDir + uuid + "." + targetFormat;
+    convertSavedUpload(job, inputFilename, workDir, std::move(scratch), std::move(reservation));
+}
 
-    // Construct ffmpeg command with quality presets
-    // Construct ffmpeg command args
-    std::vector<std::string> args;
-    args.push_back("ffmpeg");
-    args.push_back("-nostdin");
-    args.push_back("-i");
-    args.push_back(inputFilename);
-    args.push_back("-vn");
-    
-    // Quality Presets Implementation
-    if (targetFormat == "mp3") {
-        args.push_back("-acodec"); args.push_back("libmp3lame");
-        if (quality == "high") {
-            args.push_back("-b:a"); args.push_back("320k");
-        } else if (quality == "medium") {
-            args.push_back("-q:a"); args.push_back("2");
-        } else if (quality == "low") {
-            args.push_back("-q:a"); args.push_back("5");
-        } else { // podcast
-            args.push_back("-b:a"); args.push_back("64k");
-            args.push_back("-ac"); args.push_back("1");
+// Steps 7-14 of convert() for an upload that is on disk (also used for batch items)
+static void convertSavedUpload(const std::shared_ptr<UploadJob>& job, const std::string& inputFilename,
+                               const std::string& workDir, ScratchSpace::LeasePtr scratch,
+                               StorageManager::ReservationPtr reservation) {
+    const auto& callback = job->callback;
+    const std::string& clientIP = job->clientIP;
+    const std::string& uuid = job->uuid;
+    const std::string& safeFilename = job->safeFilename;
+    const std::string& targetFormat = job->targetFormat;
+    const EncoderPreset& preset = *job->preset;
+    const std::string& progressId = job->progressId;
+    // The tracker entry is scoped to the client; the bare id is only echoed back
+    std::string progressKey = progressId.empty() ? "" : ProgressTracker::key(job->clientIP, progressId);
+    bool progressive = job->progressive;
+    double startSeconds = job->startSeconds;
+    double endSeconds = job->endSeconds;
+    const JobTracePtr& trace = job->trace;
+    if (trace) {
+        trace->jobId = uuid;
+        trace->format = targetFormat;
+        trace->preset = preset.name();
+    }
+
+    // Step 7: Media Probe
+    // Read only the container headers to reject non-media uploads and files
+    // without audio before they occupy a worker for a full ffmpeg run.
+    MediaInfo mediaInfo;
+    MediaProbe::Status probeStatus = MediaProbe::probe(inputFilename, mediaInfo);
+    if (probeStatus == MediaProbe::Status::Invalid || probeStatus == MediaProbe::Status::NoAudio) {
+        std::error_code ec;
+        std::filesystem::remove(inputFilename, ec);
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k422UnprocessableEntity);
+
+        Json::Value json;
+        json["status"] = "error";
+        json["error"] = probeStatus == MediaProbe::Status::NoAudio
+            ? "The uploaded file has no audio stream."
+            : "The uploaded file is not a supported video or audio file.";
+        traceError(job, json["error"].asString());
+
+        resp->setBody(json.toStyledString());
+        resp->setContentTypeCode(CT_APPLICATION_JSON);
+        callback(resp);
+        return;
+    }
+    if (probeStatus == MediaProbe::Status::Ok) {
+        LOG_INFO << "Probed " << inputFilename << ": " << mediaInfo.durationSeconds << "s "
+                 << mediaInfo.audioCodec << " " << mediaInfo.sampleRate << "Hz x" << mediaInfo.channels
+                 << (mediaInfo.canStreamCopy(targetFormat) ? " (stream copy possible)" : "");
+    }
+
+    // Validate the time range against the probed duration. Only the requested
+    // span is decoded, so it is also all the job is charged for.
+    if (probeStatus == MediaProbe::Status::Ok && mediaInfo.durationSeconds > 0) {
+        // Container durations can be slightly short; an end just past it means "to the end"
+        if (endSeconds > mediaInfo.durationSeconds && endSeconds <= mediaInfo.durationSeconds + 1) {
+            endSeconds = 0;
         }
-    } 
-    else if (targetFormat == "aac" || targetFormat == "m4a") {
-        args.push_back("-acodec"); args.push_back("aac");
-        if (quality == "high") {
-            args.push_back("-b:a"); args.push_back("256k");
-        } else if (quality == "medium") {
-            args.push_back("-b:a"); args.push_back("192k");
-        } else if (quality == "low") {
-            args.push_back("-b:a"); args.push_back("128k");
-        } else { // podcast
-            args.push_back("-b:a"); args.push_back("64k");
-            args.push_back("-ac"); args.push_back("1");
+        std::string rangeError;
+        if (startSeconds >= mediaInfo.durationSeconds) {
+            rangeError = "Start time is beyond the end of the media.";
+        } else if (endSeconds > mediaInfo.durationSeconds) {
+            rangeError = "End time is beyond the end of the media.";
         }
-    }
-    else if (targetFormat == "ogg") {
-        args.push_back("-acodec"); args.push_back("libvorbis");
-        if (quality == "high") {
-            args.push_back("-q:a"); args.push_back("6");
-        } else if (quality == "medium") {
-            args.push_back("-q:a"); args.push_back("4");
-        } else if (quality == "low") {
-            args.push_back("-q:a"); args.push_back("3");
-        } else { // podcast
-            args.push_back("-q:a"); args.push_back("1");
-            args.push_back("-ac"); args.push_back("1");
+        if (!rangeError.empty()) {
+            traceError(job, rangeError);
+            std::error_code ec;
+            std::filesystem::remove(inputFilename, ec);
+            auto resp = HttpResponse::newHttpResponse();
+            resp->setStatusCode(k422UnprocessableEntity);
+
+            Json::Value json;
+            json["status"] = "error";
+            json["error"] = rangeError;
+            json["duration"] = mediaInfo.durationSeconds;
+
+            resp->setBody(json.toStyledString());
+            resp->setContentTypeCode(CT_APPLICATION_JSON);
+            callback(resp);
+            return;
         }
     }
-    else if (targetFormat == "opus") {
-        args.push_back("-acodec"); args.push_back("libopus");
-        if (quality == "high") {
-            args.push_back("-b:a"); args.push_back("192k");
-        } else if (quality == "medium") {
-            args.push_back("-b:a"); args.push_back("128k");
-        } else if (quality == "low") {
-            args.push_back("-b:a"); args.push_back("96k");
-        } else { // podcast
-            args.push_back("-b:a"); args.push_back("48k");
-            args.push_back("-ac"); args.push_back("1");
-        }
+    double spanSeconds = endSeconds > 0 ? endSeconds - startSeconds
+                                        : std::max(0.0, mediaInfo.durationSeconds - startSeconds);
+
+    // Without a duration (ffprobe missing or timed out, or N/A in the container)
+    // charge what the file size suggests instead of nothing
+    double chargedSeconds = spanSeconds;
+    bool durationKnown = probeStatus == MediaProbe::Status::Ok && mediaInfo.durationSeconds > 0;
+    if (!durationKnown && endSeconds <= 0) {
+        std::error_code ec;
+        uint64_t inputBytes = std::filesystem::file_size(inputFilename, ec);
+        chargedSeconds = (ec ? MAX_FILE_SIZE : inputBytes) * 8.0 / UNKNOWN_DURATION_BITS_PER_SECOND;
     }
-    else if (targetFormat == "flac") {
-        args.push_back("-acodec"); args.push_back("flac");
-        if (quality == "podcast") {
-            args.push_back("-ar"); args.push_back("22050");
-            args.push_back("-ac"); args.push_back("1");
-        }
+
+    if (!RateLimiter::instance().consumeMediaSeconds(clientIP, chargedSeconds)) {
+        traceError(job, "Hourly media limit exceeded");
+        std::error_code ec;
+        std::filesystem::remove(inputFilename, ec);
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k429TooManyRequests);
+
+        Json::Value json;
+        json["status"] = "error";
+        json["error"] = "Hourly media limit exceeded. Convert a shorter range or try again later.";
+        json["remaining_seconds"] = RateLimiter::instance().getRemainingMediaSeconds(clientIP);
+
+        resp->setBody(json.toStyledString());
+        resp->setContentTypeCode(CT_APPLICATION_JSON);
+        callback(resp);
+        return;
     }
-    else if (targetFormat == "wav") {
-        args.push_back("-acodec"); args.push_back("pcm_s16le");
-        if (quality == "podcast") {
-            args.push_back("-ar"); args.push_back("22050");
-            args.push_back("-ac"); args.push_back("1");
+
+    std::string outputFilename = workDir + uuid + "." + preset.extension;
+
+    // Quality Presets Implementation
+    // Encoder arguments for the requested format, quality and speed variant
+    std::vector<std::string> codecArgs = preset.codecArgs();
+
+    // Stream Copy Fast Path
+    // If the source audio already uses the target codec at an acceptable
+    // bitrate, remux it (-c:a copy) instead of decoding and re-encoding.
+    bool streamCopy = probeStatus == MediaProbe::Status::Ok &&
+                      canStreamCopy(mediaInfo, preset);
+
+    // A failed remux is redone by re-encoding from the start, which a client
+    // already streaming the output cannot follow. Remuxes run at disk speed,
+    // so those are answered once the file is done instead.
+    if (streamCopy) progressive = false;
+
+    // Construct ffmpeg command args
+    auto buildArgs = [&](const std::vector<std::string>& audioArgs) {
+        std::vector<std::string> cmd = {"ffmpeg", "-nostdin"};
+        // Input-side seeking: the demuxer skips to the range, nothing before it is decoded
+        if (startSeconds > 0) {
+            cmd.push_back("-ss"); cmd.push_back(std::to_string(startSeconds));
         }
-    }
+        if (endSeconds > 0) {
+            cmd.push_back("-to"); cmd.push_back(std::to_string(endSeconds));
+        }
+        cmd.insert(cmd.end(), {"-i", inputFilename, "-vn"});
+        cmd.insert(cmd.end(), audioArgs.begin(), audioArgs.end());
+        // Machine readable progress on stdout, parsed by the worker
+        if (!progressId.empty()) {
+            cmd.push_back("-progress"); cmd.push_back("pipe:1");
+            cmd.push_back("-nostats");
+        }
+        // Write each packet as soon as it is muxed so followers see it immediately
+        if (progressive) {
+            cmd.push_back("-flush_packets"); cmd.push_back("1");
+        }
+        cmd.push_back(outputFilename);
+        cmd.push_back("-y");
+        return cmd;
+    };
 
-    args.push_back(outputFilename);
-    args.push_back("-y");
+    ConversionTask task;
+    if (streamCopy) {
+        LOG_INFO << "Remuxing " << mediaInfo.audioCodec << " audio without re-encoding";
+        task.args = buildArgs({"-c:a", "copy"});
+        // Re-encode if the remux fails (e.g. stream not accepted by the target muxer)
+        task.fallbackArgs = buildArgs(codecArgs);
+    } else {
+        task.args = buildArgs(codecArgs);
+    }
+    // A remux is mostly I/O, so it adds little to the weighted backlog
+    task.cost = streamCopy ? 0.1 : preset.cost;
+    if (trace) {
+        trace->codec = streamCopy ? "copy" : preset.codec;
+        trace->mediaSeconds = spanSeconds;
+    }
 
     std::string downloadDir = "./www/downloads/";
-    if (!std::filesystem::exists(downloadDir)) {
-        std::filesystem::create_directory(downloadDir);
+    std::error_code dirError;
+    if (!std::filesystem::exists(downloadDir, dirError)) {
+        std::filesystem::create_directory(downloadDir, dirError);
     }
     
     std::filesystem::path originalPath(safeFilename);
@@ -223,101 +477,197 @@ void ConverterController::convert(const HttpRequestPtr &req,
     auto callbackCopy = callback; // shared_ptr copy
     
     // No global mutex needed anymore due to unique file paths (UUID)
+    // The storage reservation and scratch lease are captured so they are held until the task completes.
     
-    ConversionManager::instance().addTask(args, inputFilename, outputFilename, 
-        [destinationDir = downloadDir, outputFilename, inputFilename, targetFormat, newBaseName, callbackCopy](bool success) {
+    task.inputFilename = inputFilename;
+    task.outputFilename = outputFilename;
+    task.mediaSeconds = spanSeconds;
+    task.progressId = progressKey;
+    // Remote workers cannot serve a progressive stream, which OutputStreamer reads from
+    // the local output, nor see RAM scratch paths, which are private to this host
+    task.remoteAllowed = !progressive && !scratch;
+    task.trace = trace;
+
+    // A progressive job answers the request when a worker starts it, so the
+    // completion callback may no longer own the response.
+    auto responded = std::make_shared<std::atomic<bool>>(false);
+    std::string streamId;
+    if (progressive) {
+        streamId = uuid;
+        OutputStreamer::instance().open(streamId, outputFilename, targetFormat);
+        task.onStart = [callbackCopy, responded, streamId, progressId]() {
+            if (responded->exchange(true)) return;
+            Json::Value json;
+            json["status"] = "streaming";
+            json["stream_url"] = "/api/stream/" + streamId;
+            if (!progressId.empty()) json["progress_id"] = progressId;
+            callbackCopy(HttpResponse::newHttpJsonResponse(json));
+        };
+    }
+
+    auto onComplete =
+        [destinationDir = downloadDir, outputFilename, inputFilename, extension = preset.extension, newBaseName, clientIP,
+         reservation, scratch, callbackCopy, responded, streamId, trace, progressKey, chargedSeconds](bool success) {
+            auto reply = [&](const HttpResponsePtr& resp) {
+                if (!responded->exchange(true)) callbackCopy(resp);
+            };
             
             if (!success) {
+                RateLimiter::instance().refundMediaSeconds(clientIP, chargedSeconds);
+                if (trace) trace->error = "Conversion failed";
+                OutputStreamer::instance().finish(streamId, false, "", "");
                 auto resp = HttpResponse::newHttpResponse();
                 resp->setStatusCode(k500InternalServerError);
                 resp->setBody("Conversion failed");
-                callbackCopy(resp);
+                reply(resp);
                 
-                // Cleanup
-                std::filesystem::remove(inputFilename);
+                // Cleanup (including any partial output ffmpeg left behind)
+                std::error_code ec;
+                std::filesystem::remove(inputFilename, ec);
+                std::filesystem::remove(outputFilename, ec);
                 return;
             }
 
             // Success logic
-            std::string publicOutputFilename = destinationDir + newBaseName + "." + targetFormat;
+            std::string publicOutputFilename = destinationDir + newBaseName + "." + extension;
             
-            try {
-                // Move file
-                std::filesystem::rename(outputFilename, publicOutputFilename);
-                std::filesystem::remove(inputFilename); // Delete source video
-            } catch (const std::filesystem::filesystem_error& e) {
-                LOG_ERROR << "File operation failed: " << e.what();
+            // Move file (a rename on the same filesystem, a copy out of the scratch tier)
+            std::error_code ec;
+            std::filesystem::remove(inputFilename, ec); // Delete source video
+            if (!FileIO::instance().moveFile(outputFilename, publicOutputFilename, ec)) {
+                LOG_ERROR << "File operation failed: " << ec.message();
+                RateLimiter::instance().refundMediaSeconds(clientIP, chargedSeconds);
+                if (trace) trace->error = "File operation failed";
+                std::filesystem::remove(outputFilename, ec);
+                OutputStreamer::instance().finish(streamId, false, "", "");
                 auto resp = HttpResponse::newHttpResponse();
                 resp->setStatusCode(k500InternalServerError);
                 resp->setBody("File operation failed");
-                callbackCopy(resp);
+                reply(resp);
                 return;
             }
+            StorageManager::instance().add(publicOutputFilename, clientIP);
+            if (trace) {
+                auto bytes = std::filesystem::file_size(publicOutputFilename, ec);
+                trace->moved = JobTrace::now();
+                trace->outputBytes = ec ? 0 : bytes;
+                trace->success = true;
+            }
             
+            std::string downloadUrl = "/downloads/" + newBaseName + "." + extension;
+            OutputStreamer::instance().finish(streamId, true, publicOutputFilename, downloadUrl);
+            ProgressTracker::instance().setDownloadUrl(progressKey, downloadUrl);
+
             Json::Value json;
             json["status"] = "success";
-            json["download_url"] = "/downloads/" + newBaseName + "." + targetFormat;
+            json["download_url"] = downloadUrl;
 
             auto resp = HttpResponse::newHttpJsonResponse(json);
-            callbackCopy(resp);
-        });
-}
+            reply(resp);
+        };
 
-// Step 7: Zip Archive Creation
-// Bundles valid files into a standardized zip archive for batch download.
-void ConverterController::createZip(const HttpRequestPtr &req,
-                                    std::function<void(const HttpResponsePtr &)> &&callback)
-{
-    auto jsonPtr = req->getJsonObject();
-    if (!jsonPtr) {
-        auto resp = HttpResponse::newHttpResponse();
-        resp->setStatusCode(k400BadRequest);
-        resp->setBody("Invalid JSON");
-        callback(resp);
-        return;
+    // Long inputs are split across idle workers when the segments join losslessly.
+    // Progressive jobs are not split: their output only exists after the join.
+    SegmentPlanner::Plan plan;
+    bool split = !streamCopy && !progressive && probeStatus == MediaProbe::Status::Ok &&
+                 SegmentPlanner::build(mediaInfo, targetFormat, codecArgs, inputFilename, outputFilename,
+                                       ConversionManager::instance().spareWorkers(), !progressId.empty(),
+                                       startSeconds, endSeconds, plan);
+    if (split && scratch) {
+        // The segments are written next to the output, so in the scratch tier
+        // they need room in its budget too; without it the job runs as one task
+        std::error_code ec;
+        uint64_t inputBytes = std::filesystem::file_size(inputFilename, ec);
+        uint64_t tempBytes = static_cast<uint64_t>(
+            plan.tempOutputCopies * estimateOutputBytes(preset, ec ? 0 : inputBytes));
+        if (!ScratchSpace::instance().extend(*scratch, tempBytes)) {
+            FileIO::instance().removeFiles(plan.tempFiles);
+            split = false;
+        }
     }
-    
-    const Json::Value& files = (*jsonPtr)["files"];
-    if (!files.isArray() || files.empty()) {
-        auto resp = HttpResponse::newHttpResponse();
-        resp->setStatusCode(k400BadRequest);
-        resp->setBody("Files list required");
-        callback(resp);
+    if (split) {
+        LOG_INFO << "Splitting " << inputFilename << " into " << plan.parts.size() << " segments";
+        plan.join.callback = std::move(onComplete);
+        plan.join.progressId = progressKey;
+        plan.join.trace = trace;
+        for (auto& part : plan.parts) {
+            part.cost = preset.cost;
+            part.remoteAllowed = task.remoteAllowed;
+        }
+        if (trace) trace->segments = plan.parts.size();
+        job->queued = true;
+        ConversionManager::instance().addTaskGroup(std::move(plan.parts), std::move(plan.join),
+                                                   std::move(plan.tempFiles));
         return;
     }
-    
+
+    // What a successor process needs to finish the job if this one is restarted
+    // before it is done: the same steps as onComplete (see JobAdopter)
+    Json::Value handoff;
+    handoff["job_id"] = uuid;
+    handoff["input"] = inputFilename;
+    handoff["output"] = outputFilename;
+    handoff["publish"] = downloadDir + newBaseName + "." + preset.extension;
+    handoff["download_url"] = "/downloads/" + newBaseName + "." + preset.extension;
+    handoff["client_ip"] = clientIP;
+    handoff["stream_id"] = streamId;
+    handoff["format"] = targetFormat;
+    if (!job->batchId.empty()) {
+        handoff["batch_id"] = job->batchId;
+        handoff["batch_index"] = (Json::UInt64)job->batchIndex;
+    }
+    if (scratch) handoff["scratch_bytes"] = (Json::UInt64)scratch->bytes();
+    task.handoff = handoff;
+
+    task.callback = std::move(onComplete);
+    job->queued = true;
+    ConversionManager::instance().addTask(std::move(task));
+}
+
+// Zips finished outputs from ./www/downloads/ (used by createZip and batch archives).
+// Runs on a BlockingExecutor thread; onCreated receives the archive URL on success.
+static void buildZip(const std::vector<std::string>& filenames, const std::string& clientIP,
+                     const BlockingExecutor::ResponseCallback& callback,
+                     std::function<void(const std::string& downloadUrl)> onCreated) {
     std::string downloadDir = "./www/downloads/";
-    
+
     // Construct zip command arguments securely
     std::vector<std::string> args;
     args.push_back("zip");
     args.push_back("-j"); // junk paths (don't include directory structure in zip)
     args.push_back("-q"); // quiet mode
-    
+
     // Generate unique zip filename
     auto uuid = drogon::utils::getUuid();
     std::string zipName = "batch_" + uuid + ".zip";
     std::string zipPath = downloadDir + zipName;
-    
+
     args.push_back(zipPath);
-    
+
     // Validate requested files
-    for (const auto& file : files) {
-        std::string filename = file.asString();
+    std::vector<std::string> candidates;
+    for (const auto& filename : filenames) {
         // Basic sanitization/validation: ensure it's just a filename in downloads dir
         // We only allow files that exist in ./www/downloads/
-        
+
         // Remove any directory components for security
         std::filesystem::path p(filename);
         std::string basename = p.filename().string();
-        
-        std::string fullPath = downloadDir + basename;
-        // Verify file existence to prevent zipping non-existent or malicious paths
-        if (std::filesystem::exists(fullPath)) {
-            args.push_back(fullPath);
+
+        candidates.push_back(downloadDir + basename);
+    }
+
+    // Verify file existence to prevent zipping non-existent or malicious paths.
+    // All files are stat-ed in one batch.
+    uint64_t totalBytes = 0;
+    std::vector<int64_t> sizes = FileIO::instance().fileSizes(candidates);
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (sizes[i] >= 0) {
+            args.push_back(candidates[i]);
+            totalBytes += static_cast<uint64_t>(sizes[i]);
         }
     }
-    
+
     if (args.size() <= 4) { // request + zip + -j + -q + output + nothing?
        // Means no valid files found
         auto resp = HttpResponse::newHttpResponse();
@@ -326,23 +676,702 @@ void ConverterController::createZip(const HttpRequestPtr &req,
         callback(resp);
         return;
     }
-    
+
+    // Audio is already compressed, so the archive is about as large as its inputs
+    std::string storageError;
+    auto reservation = StorageManager::instance().reserve(clientIP, 0, totalBytes, storageError);
+    if (!reservation) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k507InsufficientStorage);
+        resp->setBody(storageError);
+        callback(resp);
+        return;
+    }
+
+    auto trace = JobTrace::instance().begin("zip");
+    if (trace) {
+        trace->jobId = zipName;
+        trace->format = "zip";
+        trace->inputBytes = totalBytes;
+    }
+
     // Use ConversionManager to execute zip command async
     auto callbackCopy = callback;
-    
-    ConversionManager::instance().addTask(args, "", zipPath, 
-        [zipName, callbackCopy](bool success) {
+
+    ConversionTask task;
+    task.args = args;
+    task.outputFilename = zipPath;
+    task.trace = trace;
+    task.callback =
+        [zipName, zipPath, clientIP, reservation, callbackCopy, onCreated, trace](bool success) {
             if (success) {
+                StorageManager::instance().add(zipPath, clientIP);
+                if (trace) {
+                    std::error_code ec;
+                    auto bytes = std::filesystem::file_size(zipPath, ec);
+                    trace->outputBytes = ec ? 0 : bytes;
+                    trace->success = true;
+                }
+                std::string downloadUrl = "/downloads/" + zipName;
+                if (onCreated) onCreated(downloadUrl);
                 Json::Value json;
                 json["status"] = "success";
-                json["download_url"] = "/downloads/" + zipName;
+                json["download_url"] = downloadUrl;
                 auto resp = HttpResponse::newHttpJsonResponse(json);
                 callbackCopy(resp);
             } else {
                 auto resp = HttpResponse::newHttpResponse();
                 resp->setStatusCode(k500InternalServerError);
+                if (trace) trace->error = "Zip creation failed";
                 resp->setBody("Zip creation failed");
                 callbackCopy(resp);
             }
+        };
+    ConversionManager::instance().addTask(std::move(task));
+}
+
+void ConverterController::convert(const HttpRequestPtr &req,
+                                  std::function<void(const HttpResponsePtr &)> &&callback)
+{
+    // New work is refused while the server drains (see Lifecycle)
+    auto inFlight = Lifecycle::instance().admit();
+    if (!inFlight) {
+        callback(drainingResponse());
+        return;
+    }
+
+    // Step 1: Rate Limiting
+    // Check if the client IP has exceeded the allowed number of requests per hour.
+    std::string clientIP = req->getPeerAddr().toIp();
+    if (!RateLimiter::instance().isAllowed(clientIP)) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k429TooManyRequests);
+        
+        Json::Value json;
+        json["status"] = "error";
+        json["error"] = "Rate limit exceeded. Maximum 10 conversions per hour.";
+        json["remaining"] = RateLimiter::instance().getRemainingRequests(clientIP);
+        
+        resp->setBody(json.toStyledString());
+        resp->setContentTypeCode(CT_APPLICATION_JSON);
+        callback(resp);
+        return;
+    }
+    
+    // Step 2: Handle File Upload
+    // Parse the multipart request to extract the uploaded file.
+    auto fileUpload = std::make_shared<MultiPartParser>();
+    if (fileUpload->parse(req) != 0 || fileUpload->getFiles().empty())
+    {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("No file uploaded");
+        callback(resp);
+        return;
+    }
+
+    auto &file = fileUpload->getFiles()[0];
+    auto uuid = drogon::utils::getUuid(); // Generate unique ID for this conversion task
+    
+    // Step 3: Security Sanitization
+    std::string safeFilename = sanitizeFilename(file.getFileName());
+
+    // Step 4: File Size Validation
+    // Enforce a maximum file size limit (500MB) to prevent Denial of Service (DoS).
+    if (file.fileLength() > MAX_FILE_SIZE) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k413RequestEntityTooLarge);
+        resp->setBody("File too large. Maximum size: 500MB");
+        callback(resp);
+        return;
+    }
+    
+    // Step 5: Parameter Extraction
+    // Get target format and quality settings from the request.
+    auto &params = fileUpload->getParameters();
+    ConversionOptions options;
+    std::string optionsError = parseOptions(params, options);
+    if (!optionsError.empty()) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody(optionsError);
+        callback(resp);
+        return;
+    }
+
+    // Optional client-chosen id for polling /api/progress/{id}
+    std::string progressId;
+    auto progressIt = params.find("progress_id");
+    if (progressIt != params.end() && ProgressTracker::isValidId(progressIt->second)) {
+        progressId = progressIt->second;
+        auto claimed = ProgressTracker::instance().claim(ProgressTracker::key(clientIP, progressId));
+        if (claimed != ProgressTracker::ClaimResult::Claimed) {
+            bool inUse = claimed == ProgressTracker::ClaimResult::InUse;
+            auto resp = HttpResponse::newHttpResponse();
+            resp->setStatusCode(inUse ? k409Conflict : k429TooManyRequests);
+            resp->setBody(inUse ? "progress_id is already in use by a running conversion"
+                                : "Too many conversions in progress for this client");
+            callback(resp);
+            return;
+        }
+    }
+
+    // Progressive download: answer with a stream URL as soon as encoding starts
+    auto progressiveIt = params.find("progressive");
+    bool progressive = progressiveIt != params.end() &&
+                       (progressiveIt->second == "1" || progressiveIt->second == "true") &&
+                       OutputStreamer::isStreamable(options.targetFormat);
+
+    // Step 6 onwards writes the upload, runs ffprobe and touches the storage
+    // directories. None of that may block this event loop, so the rest of the
+    // request runs on the blocking I/O executor and the response is posted back here.
+    auto job = std::make_shared<UploadJob>();
+    job->req = req;
+    job->parser = fileUpload;
+    job->clientIP = clientIP;
+    job->uuid = uuid;
+    job->safeFilename = safeFilename;
+    job->targetFormat = options.targetFormat;
+    job->preset = options.preset;
+    job->startSeconds = options.startSeconds;
+    job->endSeconds = options.endSeconds;
+    job->progressId = progressId;
+    job->progressive = progressive;
+    job->inFlight = std::move(inFlight);
+    job->callback = BlockingExecutor::bindToLoop(trantor::EventLoop::getEventLoopOfCurrentThread(),
+                                                 std::move(callback));
+    // Received stage: when the request arrived, not when its body was parsed
+    job->trace = JobTrace::instance().begin("convert", req->creationDate().microSecondsSinceEpoch());
+    BlockingExecutor::instance().submit([job]() { processUpload(job); }, job->callback);
+}
+
+// Step 8: Zip Archive Creation
+// Bundles valid files into a standardized zip archive for batch download.
+void ConverterController::createZip(const HttpRequestPtr &req,
+                                    std::function<void(const HttpResponsePtr &)> &&callback)
+{
+    auto inFlight = Lifecycle::instance().admit();
+    if (!inFlight) {
+        callback(drainingResponse());
+        return;
+    }
+
+    auto jsonPtr = req->getJsonObject();
+    if (!jsonPtr) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Invalid JSON");
+        callback(resp);
+        return;
+    }
+    
+    const Json::Value& files = (*jsonPtr)["files"];
+    if (!files.isArray() || files.empty()) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k400BadRequest);
+        resp->setBody("Files list required");
+        callback(resp);
+        return;
+    }
+    
+    std::vector<std::string> filenames;
+    for (const auto& file : files) {
+        filenames.push_back(file.asString());
+    }
+
+    // Checking each file hits the filesystem, so the rest runs on the blocking
+    // I/O executor. The response is posted back to this request's event loop.
+    // inFlight is held until the zip task is queued.
+    std::string clientIP = req->getPeerAddr().toIp();
+    auto reply = BlockingExecutor::bindToLoop(trantor::EventLoop::getEventLoopOfCurrentThread(),
+                                              std::move(callback));
+    BlockingExecutor::instance().submit([filenames, clientIP, callback = reply, inFlight]() {
+        buildZip(filenames, clientIP, callback, nullptr);
+    }, reply);
+}
+
+// Step 9: Conversion Progress
+// Reports how far ffmpeg has got, relative to the probed duration.
+void ConverterController::getProgress(const HttpRequestPtr &req,
+                                      std::function<void(const HttpResponsePtr &)> &&callback,
+                                      std::string progressId)
+{
+    // Only the client that submitted the id can read its entry
+    Json::Value json = ProgressTracker::instance().get(ProgressTracker::key(req->getPeerAddr().toIp(), progressId));
+    if (json.isNull()) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k404NotFound);
+        resp->setBody("Unknown progress id");
+        callback(resp);
+        return;
+    }
+
+    auto resp = HttpResponse::newHttpJsonResponse(json);
+    callback(resp);
+}
+
+// Step 10: Progressive Download
+// Streams the output of a running job, then ends when the job finishes.
+void ConverterController::streamOutput(const HttpRequestPtr &req,
+                                       std::function<void(const HttpResponsePtr &)> &&callback,
+                                       std::string streamId)
+{
+    std::string downloadUrl, format;
+    OutputStreamer::State state = ProgressTracker::isValidId(streamId)
+        ? OutputStreamer::instance().state(streamId, downloadUrl, format)
+        : OutputStreamer::State::Unknown;
+
+    if (state == OutputStreamer::State::Unknown || state == OutputStreamer::State::Failed) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(state == OutputStreamer::State::Failed ? k410Gone : k404NotFound);
+        resp->setBody(state == OutputStreamer::State::Failed ? "Conversion failed" : "Unknown stream id");
+        callback(resp);
+        return;
+    }
+
+    // Finished jobs are served as ordinary files (sendfile, ranges)
+    if (state == OutputStreamer::State::Done) {
+        callback(HttpResponse::newRedirectionResponse(downloadUrl));
+        return;
+    }
+
+    auto resp = HttpResponse::newAsyncStreamResponse(
+        [streamId, connection = req->getConnectionPtr()](ResponseStreamPtr stream) {
+            OutputStreamer::instance().attach(streamId, std::move(stream), connection);
         });
+    resp->setContentTypeString(OutputStreamer::mimeType(format));
+    resp->addHeader("Cache-Control", "no-store");
+    callback(resp);
+}
+
+// Streaming state of one /api/batch request. The stream callbacks run on the
+// connection's event loop; file writes are queued, in order, onto the blocking
+// I/O executor through post(), so the loop never waits on the disk.
+namespace {
+struct BatchPart {
+    size_t index = 0;
+    std::string safeFilename;
+    std::string uuid;
+    std::string path;
+    ConversionOptions options;
+    uint64_t bytes = 0;
+    bool rejected = false; // Loop side: drop the rest of this part
+    std::string pending;   // Loop side: data not yet handed to the executor
+    JobTracePtr trace;     // Started when the part's header arrives
+
+    int fd = -1;              // Executor side
+    uint64_t written = 0;     // Executor side
+    bool writeFailed = false; // Executor side
+};
+
+struct BatchUpload : std::enable_shared_from_this<BatchUpload> {
+    std::string batchId;
+    std::string clientIP;
+    Lifecycle::InFlightPtr inFlight; // Shared with the batch's items
+    size_t maxItems = 50;
+    size_t maxQueuedBytes = 64 * 1024 * 1024; // Received data waiting for the disk
+    size_t items = 0;
+    std::unordered_map<std::string, std::string> params; // Form fields received so far
+
+    enum class PartType { None, Field, File } partType = PartType::None;
+    std::string fieldName;
+    std::string fieldValue;
+    std::shared_ptr<BatchPart> part;
+
+    // Runs file operations one at a time, in the order they were posted.
+    // bytes is the data the op holds until it has run, counted in queuedBytes().
+    void post(std::function<void()> op, size_t bytes = 0) {
+        {
+            std::lock_guard<std::mutex> lock(opsMutex_);
+            ops_.push_back({std::move(op), bytes});
+            queuedBytes_ += bytes;
+            if (draining_) return;
+            draining_ = true;
+        }
+        BlockingExecutor::instance().submit([self = shared_from_this()]() { self->drain(); });
+    }
+
+    size_t queuedBytes() {
+        std::lock_guard<std::mutex> lock(opsMutex_);
+        return queuedBytes_;
+    }
+
+private:
+    void drain() {
+        while (true) {
+            Op op;
+            {
+                std::lock_guard<std::mutex> lock(opsMutex_);
+                if (ops_.empty()) {
+                    draining_ = false;
+                    return;
+                }
+                op = std::move(ops_.front());
+                ops_.pop_front();
+            }
+            // A throwing op must not stall the ops queued after it
+            try {
+                op.run();
+            } catch (const std::exception& e) {
+                LOG_ERROR << "Batch " << batchId << " file operation failed: " << e.what();
+            }
+            op.run = nullptr; // Frees the data before it stops counting
+            std::lock_guard<std::mutex> lock(opsMutex_);
+            queuedBytes_ -= op.bytes;
+        }
+    }
+
+    struct Op {
+        std::function<void()> run;
+        size_t bytes = 0;
+    };
+
+    std::mutex opsMutex_;
+    std::deque<Op> ops_;
+    size_t queuedBytes_ = 0;
+    bool draining_ = false;
+};
+}
+
+// Records the outcome of a batch item from the response the single-file path would have sent
+static BlockingExecutor::ResponseCallback batchItemCallback(const std::string& batchId, size_t index) {
+    return [batchId, index](const HttpResponsePtr& resp) {
+        Json::Value json;
+        if (auto parsed = resp->getJsonObject()) {
+            json = *parsed;
+        } else {
+            // Error responses carry JSON as a plain body
+            std::string body(resp->body());
+            std::istringstream in(body);
+            std::string errors;
+            Json::parseFromStream(Json::CharReaderBuilder(), in, &json, &errors);
+        }
+        if (!json.isObject()) json = Json::Value();
+        std::string downloadUrl = json.get("download_url", "").asString();
+        std::string error = json.get("error", "").asString();
+        bool success = resp->statusCode() == k200OK && !downloadUrl.empty();
+        if (!success && error.empty()) error = std::string(resp->body());
+        BatchRegistry::instance().itemFinished(batchId, index, success, downloadUrl, error);
+    };
+}
+
+// Step 11 for one batch item once it is on disk: storage admission, then steps 7-14
+static void processBatchItem(const std::shared_ptr<UploadJob>& job, const std::string& inputFilename, uint64_t bytes) {
+    // The size is only known once the part has been received, so admission happens afterwards
+    std::string storageError;
+    auto reservation = StorageManager::instance().reserve(job->clientIP, bytes,
+                                                          estimateOutputBytes(*job->preset, bytes), storageError);
+    if (!reservation) {
+        traceError(job, storageError);
+        std::error_code ec;
+        std::filesystem::remove(inputFilename, ec);
+        Json::Value json;
+        json["status"] = "error";
+        json["error"] = storageError;
+        auto resp = HttpResponse::newHttpJsonResponse(json);
+        resp->setStatusCode(k507InsufficientStorage);
+        job->callback(resp);
+        return;
+    }
+    FileExpiry::instance().track(inputFilename);
+    convertSavedUpload(job, inputFilename, "./uploads/", nullptr, std::move(reservation));
+}
+
+// Step 11: Batch Conversion
+// Accepts many files in one multipart stream. Each file part is queued for
+// conversion as soon as it has been received, while later parts are still uploading.
+void ConverterController::convertBatch(const HttpRequestPtr &req, RequestStreamPtr &&stream,
+                                       std::function<void(const HttpResponsePtr &)> &&callback)
+{
+    auto inFlight = Lifecycle::instance().admit();
+    if (!inFlight) {
+        callback(drainingResponse());
+        return;
+    }
+
+    auto batch = std::make_shared<BatchUpload>();
+    batch->inFlight = std::move(inFlight);
+    batch->clientIP = req->getPeerAddr().toIp();
+    batch->batchId = BatchRegistry::instance().create(batch->clientIP);
+    auto config = drogon::app().getCustomConfig()["batch"];
+    batch->maxItems = config.get("max_items", (Json::UInt64)batch->maxItems).asUInt64();
+    batch->maxQueuedBytes = config.get("max_queued_mb", (Json::UInt64)(batch->maxQueuedBytes >> 20)).asUInt64() << 20;
+
+    auto failPart = [batch](const std::string& error) {
+        auto part = batch->part;
+        part->rejected = true;
+        part->pending.clear();
+        if (part->trace) part->trace->error = error;
+        BatchRegistry::instance().itemFinished(batch->batchId, part->index, false, "", error);
+        if (!part->path.empty()) {
+            batch->post([part]() {
+                if (part->fd >= 0) close(part->fd);
+                part->fd = -1;
+                std::error_code ec;
+                std::filesystem::remove(part->path, ec);
+            });
+        }
+    };
+
+    auto onHeader = [batch, failPart](MultipartHeader header) {
+        if (header.filename.empty()) {
+            // Form field (format, quality, speed, start, end): applies to the files after it
+            batch->partType = BatchUpload::PartType::Field;
+            batch->fieldName = header.name;
+            batch->fieldValue.clear();
+            return;
+        }
+
+        batch->partType = BatchUpload::PartType::File;
+        auto part = std::make_shared<BatchPart>();
+        batch->part = part;
+        part->safeFilename = sanitizeFilename(header.filename);
+        part->uuid = drogon::utils::getUuid();
+        std::string progressId = batch->batchId + "-" + std::to_string(batch->items);
+        part->index = BatchRegistry::instance().addItem(batch->batchId, part->safeFilename, progressId);
+
+        // Each item is checked and charged like a separate /api/convert request
+        std::string optionsError = parseOptions(batch->params, part->options);
+        if (++batch->items > batch->maxItems) {
+            failPart("Too many files in one batch. Maximum: " + std::to_string(batch->maxItems));
+        } else if (!optionsError.empty()) {
+            failPart(optionsError);
+        } else if (!RateLimiter::instance().isAllowed(batch->clientIP)) {
+            failPart("Rate limit exceeded. Maximum 10 conversions per hour.");
+        } else {
+            part->trace = JobTrace::instance().begin("convert");
+            part->path = "./uploads/" + part->uuid + "_" + part->safeFilename;
+            batch->post([part]() {
+                std::error_code ec;
+                std::filesystem::create_directories("./uploads/", ec);
+                part->fd = open(part->path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                part->writeFailed = part->fd < 0;
+            });
+        }
+    };
+
+    // Appends pending data to the part's file on the executor
+    auto flush = [batch](const std::shared_ptr<BatchPart>& part) {
+        if (part->pending.empty()) return;
+        size_t bytes = part->pending.size();
+        batch->post([part, data = std::move(part->pending)]() {
+            if (part->writeFailed) return;
+            std::error_code ec;
+            if (FileIO::instance().writeAt(part->fd, data.data(), data.size(), part->written, ec)) {
+                part->written += data.size();
+            } else {
+                LOG_ERROR << "Failed to write " << part->path << ": " << ec.message();
+                part->writeFailed = true;
+            }
+        }, bytes);
+        part->pending.clear();
+    };
+
+    auto onData = [batch, failPart, flush](const char* data, size_t length) {
+        if (batch->partType == BatchUpload::PartType::Field) {
+            if (length == 0) {
+                batch->params[batch->fieldName] = batch->fieldValue;
+                batch->partType = BatchUpload::PartType::None;
+            } else if (batch->fieldValue.size() < 1024) {
+                batch->fieldValue.append(data, length);
+            }
+            return;
+        }
+        if (batch->partType != BatchUpload::PartType::File) return;
+
+        auto part = batch->part;
+        if (length > 0) {
+            if (part->rejected) return;
+            part->bytes += length;
+            if (part->bytes > MAX_FILE_SIZE) {
+                failPart("File too large. Maximum size: 500MB");
+                return;
+            }
+            // The stream cannot be paused, so a client that outruns the disk loses the part
+            // instead of growing the write queue without bound
+            if (batch->queuedBytes() + part->pending.size() + length > batch->maxQueuedBytes) {
+                failPart("Upload is arriving faster than it can be stored; retry this file");
+                return;
+            }
+            part->pending.append(data, length);
+            // Hand data to the disk in 1 MB writes
+            if (part->pending.size() >= 1024 * 1024) flush(part);
+            return;
+        }
+
+        // End of this file part: queue it for conversion right away
+        batch->partType = BatchUpload::PartType::None;
+        batch->part.reset();
+        if (part->rejected) return;
+        flush(part);
+        std::string batchId = batch->batchId;
+        std::string clientIP = batch->clientIP;
+        batch->post([part, batchId, clientIP, inFlight = batch->inFlight]() {
+            if (part->fd >= 0) close(part->fd);
+            part->fd = -1;
+            if (part->writeFailed) {
+                if (part->trace) part->trace->error = "Failed to store upload";
+                std::error_code ec;
+                std::filesystem::remove(part->path, ec);
+                BatchRegistry::instance().itemFinished(batchId, part->index, false, "", "Failed to store upload");
+                return;
+            }
+            LOG_INFO << "Batch " << batchId << " item " << part->index << " saved to: " << part->path;
+            BatchRegistry::instance().itemConverting(batchId, part->index);
+
+            auto job = std::make_shared<UploadJob>();
+            job->clientIP = clientIP;
+            job->uuid = part->uuid;
+            job->safeFilename = part->safeFilename;
+            job->targetFormat = part->options.targetFormat;
+            job->preset = part->options.preset;
+            job->startSeconds = part->options.startSeconds;
+            job->endSeconds = part->options.endSeconds;
+            job->progressId = batchId + "-" + std::to_string(part->index);
+            job->callback = BlockingExecutor::once(batchItemCallback(batchId, part->index));
+            job->trace = part->trace;
+            job->inFlight = inFlight;
+            job->batchId = batchId;
+            job->batchIndex = part->index;
+            if (job->trace) {
+                job->trace->saved = JobTrace::now();
+                job->trace->inputBytes = part->bytes;
+            }
+            // Probing runs as its own task so the next part's writes are not held up
+            BlockingExecutor::instance().submit([job, path = part->path, bytes = part->bytes]() {
+                processBatchItem(job, path, bytes);
+            }, job->callback);
+        });
+    };
+
+    auto onFinish = [batch, failPart, callback = std::move(callback)](std::exception_ptr error) {
+        // A part cut off by a broken upload is dropped; finished parts keep converting
+        if (batch->partType == BatchUpload::PartType::File && batch->part && !batch->part->rejected) {
+            failPart("Upload interrupted");
+        }
+        batch->partType = BatchUpload::PartType::None;
+        batch->part.reset();
+        BatchRegistry::instance().uploadsComplete(batch->batchId);
+
+        if (batch->items == 0) {
+            // Nothing was accepted, so the batch has nothing to report later
+            BatchRegistry::instance().remove(batch->batchId);
+            auto resp = HttpResponse::newHttpResponse();
+            resp->setStatusCode(k400BadRequest);
+            resp->setBody(error ? "Invalid or interrupted multipart upload" : "No file uploaded");
+            callback(resp);
+            return;
+        }
+
+        // Items received before a broken or malformed stream keep converting, so the
+        // client still needs the batch id to find them; the cut-off part is marked failed
+        Json::Value json = BatchRegistry::instance().get(batch->batchId);
+        json["status"] = "accepted";
+        if (error) json["error"] = "Invalid or interrupted multipart upload";
+        json["status_url"] = "/api/batch/" + batch->batchId;
+        json["zip_url"] = "/api/batch/" + batch->batchId + "/zip";
+        callback(HttpResponse::newHttpJsonResponse(json));
+    };
+
+    auto reader = RequestStreamReader::newMultipartReader(req, std::move(onHeader), std::move(onData),
+                                                          std::move(onFinish));
+    if (stream) {
+        stream->setStreamReader(std::move(reader));
+    } else {
+        // The whole body arrived before the handler ran (or streaming is off)
+        reader->onStreamData(req->body().data(), req->body().size());
+        reader->onStreamFinish(nullptr);
+    }
+}
+
+// Step 12: Batch Status
+// Per-item state, conversion progress and download URLs of a batch.
+void ConverterController::getBatch(const HttpRequestPtr &req,
+                                   std::function<void(const HttpResponsePtr &)> &&callback,
+                                   std::string batchId)
+{
+    Json::Value json = BatchRegistry::instance().get(batchId);
+    if (json.isNull()) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k404NotFound);
+        resp->setBody("Unknown batch id");
+        callback(resp);
+        return;
+    }
+    callback(HttpResponse::newHttpJsonResponse(json));
+}
+
+// Step 13: Batch Item Download
+// Redirects to the output of one finished item.
+void ConverterController::getBatchItem(const HttpRequestPtr &req,
+                                       std::function<void(const HttpResponsePtr &)> &&callback,
+                                       std::string batchId, size_t index)
+{
+    BatchRegistry::State state;
+    std::string downloadUrl, error;
+    if (!BatchRegistry::instance().item(batchId, index, state, downloadUrl, error)) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k404NotFound);
+        resp->setBody("Unknown batch item");
+        callback(resp);
+        return;
+    }
+
+    if (state == BatchRegistry::State::Done) {
+        callback(HttpResponse::newRedirectionResponse(downloadUrl));
+        return;
+    }
+
+    auto resp = HttpResponse::newHttpResponse();
+    if (state == BatchRegistry::State::Failed) {
+        resp->setStatusCode(k422UnprocessableEntity);
+        resp->setBody(error.empty() ? "Conversion failed" : error);
+    } else {
+        resp->setStatusCode(k409Conflict);
+        resp->setBody("Item is not converted yet");
+    }
+    callback(resp);
+}
+
+// Step 14: Batch Archive
+// Zips every successful item of a finished batch (built once, then reused).
+void ConverterController::zipBatch(const HttpRequestPtr &req,
+                                   std::function<void(const HttpResponsePtr &)> &&callback,
+                                   std::string batchId)
+{
+    auto inFlight = Lifecycle::instance().admit();
+    if (!inFlight) {
+        callback(drainingResponse());
+        return;
+    }
+
+    auto reply = BlockingExecutor::bindToLoop(trantor::EventLoop::getEventLoopOfCurrentThread(),
+                                              std::move(callback));
+    BlockingExecutor::instance().submit([batchId, callback = reply, inFlight]() {
+        std::vector<std::string> downloadUrls;
+        if (!BatchRegistry::instance().finishedOutputs(batchId, downloadUrls)) {
+            auto resp = HttpResponse::newHttpResponse();
+            bool known = !BatchRegistry::instance().clientIP(batchId).empty();
+            resp->setStatusCode(known ? k409Conflict : k404NotFound);
+            resp->setBody(known ? "Batch is still uploading or converting" : "Unknown batch id");
+            callback(resp);
+            return;
+        }
+
+        // Reuse the archive while it has not expired
+        std::string zipUrl = BatchRegistry::instance().zipUrl(batchId);
+        std::error_code ec;
+        if (!zipUrl.empty() && std::filesystem::exists("./www" + zipUrl, ec)) {
+            Json::Value json;
+            json["status"] = "success";
+            json["download_url"] = zipUrl;
+            callback(HttpResponse::newHttpJsonResponse(json));
+            return;
+        }
+
+        buildZip(downloadUrls, BatchRegistry::instance().clientIP(batchId), callback,
+                 [batchId](const std::string& downloadUrl) {
+                     BatchRegistry::instance().setZipUrl(batchId, downloadUrl);
+                 });
+    }, reply);
 }
@@ -22,6 +22,10 @@ using namespace drogon;
  * This controller serves two main endpoints:
  * - /api/convert: Accepts video files and converts them to audio.
  * - /api/zip: Bundles converted files into a ZIP archive.
+ * - /api/progress/{id}: Reports progress of a queued or running conversion.
+ * - /api/stream/{id}: Streams the output of a progressive conversion while it is encoded.
+ * - /api/batch: Accepts many files in one streamed multipart request.
+ * - /api/batch/{id}, /api/batch/{id}/items/{n}, /api/batch/{id}/zip: Batch status and results.
  */
 class ConverterController : public drogon::HttpController<ConverterController>
 {
@@ -31,6 +35,15 @@ class ConverterController : public drogon::HttpController<ConverterController>
     ADD_METHOD_TO(ConverterController::convert, "/api/convert", Post);
     // Register the batch download endpoint: POST /api/zip
     ADD_METHOD_TO(ConverterController::createZip, "/api/zip", Post);
+    // Register the progress endpoint: GET /api/progress/{id}
+    ADD_METHOD_TO(ConverterController::getProgress, "/api/progress/{1}", Get);
+    // Register the progressive download endpoint: GET /api/stream/{id}
+    ADD_METHOD_TO(ConverterController::streamOutput, "/api/stream/{1}", Get);
+    // Register the batch endpoints (the upload is a request stream)
+    ADD_METHOD_TO(ConverterController::convertBatch, "/api/batch", Post);
+    ADD_METHOD_TO(ConverterController::getBatch, "/api/batch/{1}", Get);
+    ADD_METHOD_TO(ConverterController::getBatchItem, "/api/batch/{1}/items/{2}", Get);
+    ADD_METHOD_TO(ConverterController::zipBatch, "/api/batch/{1}/zip", Post);
     METHOD_LIST_END
 
     /**
@@ -48,4 +61,56 @@ class ConverterController : public drogon::HttpController<ConverterController>
      */
     void createZip(const HttpRequestPtr &req,
                    std::function<void(const HttpResponsePtr &)> &&callback);
+
+    /**
+     * @brief Returns the progress of a conversion submitted with a progress_id.
+     * @param req The HTTP request.
+     * @param callback Callback to return the HTTP response.
+     * @param progressId The id the client sent as the progress_id form field.
+     */
+    void getProgress(const HttpRequestPtr &req,
+                     std::function<void(const HttpResponsePtr &)> &&callback,
+                     std::string progressId);
+
+    /**
+     * @brief Streams the growing output of a job submitted with progressive=1.
+     * @param req The HTTP request.
+     * @param callback Callback to return the HTTP response.
+     * @param streamId The id from the stream_url returned by /api/convert.
+     */
+    void streamOutput(const HttpRequestPtr &req,
+                      std::function<void(const HttpResponsePtr &)> &&callback,
+                      std::string streamId);
+
+    /**
+     * @brief Receives a multipart stream of files and queues each one as soon as it is complete.
+     *
+     * Form fields (format, quality, speed, start, end) apply to the file parts that follow them.
+     * @param req The HTTP request (headers only; the body arrives through stream).
+     * @param stream Request body stream.
+     * @param callback Callback to return the HTTP response once the whole body was received.
+     */
+    void convertBatch(const HttpRequestPtr &req, RequestStreamPtr &&stream,
+                      std::function<void(const HttpResponsePtr &)> &&callback);
+
+    /**
+     * @brief Returns the state of every item of a batch.
+     */
+    void getBatch(const HttpRequestPtr &req,
+                  std::function<void(const HttpResponsePtr &)> &&callback,
+                  std::string batchId);
+
+    /**
+     * @brief Redirects to the output of one batch item once it is converted.
+     */
+    void getBatchItem(const HttpRequestPtr &req,
+                      std::function<void(const HttpResponsePtr &)> &&callback,
+                      std::string batchId, size_t index);
+
+    /**
+     * @brief Creates (or returns) a ZIP of the successful items of a finished batch.
+     */
+    void zipBatch(const HttpRequestPtr &req,
+                  std::function<void(const HttpResponsePtr &)> &&callback,
+                  std::string batchId);
 };
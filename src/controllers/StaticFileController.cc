@@ -1,4 +1,5 @@
 #include "controllers/StaticFileController.h"
+#include "../services/StorageManager.h"
 #include <drogon/utils/Utilities.h>
 #include <filesystem>
 #include <fstream>
@@ -113,6 +114,11 @@ void StaticFileController::asyncHandleHttpRequest(const drogon::HttpRequestPtr&
     // 6. Serve File & Add Headers
     // ==========================================
 
+    // Converted outputs are evicted least-recently-downloaded first under disk pressure
+    if (path.rfind("downloads/", 0) == 0) {
+        StorageManager::instance().touch(fullPath.string());
+    }
+
     // Use Drogon's optimized newFileResponse (uses sendfile for zero-copy performance)
     auto resp = drogon::HttpResponse::newFileResponse(fullPath.string());
     
@@ -9,6 +9,13 @@
 
 #include "StatsController.h"
 #include "../services/ConversionManager.h"
+#include "../services/StorageManager.h"
+#include "../services/ScratchSpace.h"
+#include "../services/FileIO.h"
+#include "../services/JobDispatcher.h"
+#include "../services/JobTrace.h"
+#include "../services/Lifecycle.h"
+#include "../services/RateLimiter.h"
 
 void StatsController::getStats(const HttpRequestPtr& req,
                                std::function<void (const HttpResponsePtr &)> &&callback)
@@ -17,8 +24,32 @@ void StatsController::getStats(const HttpRequestPtr& req,
     // We will implement getTotalConversions in ConversionManager
     json["total_conversions"] = (Json::UInt64)ConversionManager::instance().getTotalConversions();
     
-    // Optional: Add active tasks count if available
-    // json["active_tasks"] = ...
+    // Seconds of probed media waiting for a worker (rough backlog estimate)
+    json["queued_media_seconds"] = ConversionManager::instance().getQueuedMediaSeconds();
+    // The same backlog weighted by encoder cost, in mp3/medium seconds
+    json["queued_work_seconds"] = ConversionManager::instance().getQueuedWorkSeconds();
+    // True while new conversions are refused for a shutdown or restart
+    json["draining"] = Lifecycle::instance().draining();
+
+    // Disk occupancy, quotas and eviction counters
+    json["storage"] = StorageManager::instance().stats();
+    json["storage"]["scratch_used_bytes"] = (Json::UInt64)ScratchSpace::instance().usedBytes();
+    json["storage"]["io_backend"] = FileIO::instance().backend();
+
+    // IPs the rate limiter keeps history for (bounded by its stale-entry cleanup)
+    json["rate_limiter"]["tracked_clients"] = (Json::UInt64)RateLimiter::instance().trackedClients();
+
+    // Remote executor (konvertor_worker connections and their leases)
+    if (JobDispatcher::instance().enabled()) {
+        json["remote"]["workers"] = (Json::UInt64)JobDispatcher::instance().connectedWorkers();
+        json["remote"]["active_leases"] = (Json::UInt64)JobDispatcher::instance().activeLeases();
+    }
+
+    // Per-job trace records written, and dropped because the ring was full
+    if (JobTrace::instance().enabled()) {
+        json["trace"]["written"] = (Json::UInt64)JobTrace::instance().written();
+        json["trace"]["dropped"] = (Json::UInt64)JobTrace::instance().dropped();
+    }
     
     auto resp = HttpResponse::newHttpJsonResponse(json);
     callback(resp);
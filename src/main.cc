@@ -16,11 +16,45 @@
  */
 
 #include <drogon/drogon.h>
+#include "services/JobTrace.h"
+#include "services/StorageManager.h"
+#include "services/JobDispatcher.h"
+#include "services/PresetRegistry.h"
+#include "services/Lifecycle.h"
+
+int main(int argc, char* argv[]) {
+    // Record the command line for restarts and block the restart signal
+    // before any thread exists (see Lifecycle).
+    Lifecycle::instance().init(argc, argv);
 
-int main() {
     // Load configuration from local JSON file.
     // This sets listener ports, thread counts, and upload limits.
     drogon::app().loadConfigFile("config/config.json");
+
+    // Open the job trace before any other service so it is closed last and
+    // still records jobs that finish while the others shut down.
+    JobTrace::instance();
+
+    // Build the encoder preset table and check it against `ffmpeg -encoders`
+    // now, rather than on the first request.
+    PresetRegistry::instance();
+
+    // Re-register files left over from a previous run so they are counted
+    // against the storage quotas and still expire. This is the only full
+    // directory scan; new files are tracked when they are created.
+    StorageManager::instance().recover({"./uploads/", "./www/downloads/"});
+
+    // Accept konvertor_worker connections before the first job arrives
+    // (only if custom_config.remote is enabled).
+    JobDispatcher::instance();
+
+    // Drain on SIGTERM, restart on SIGUSR2. A process started by a restart
+    // also takes over its predecessor's jobs once it listens.
+    Lifecycle::instance().start();
+
+    // Let /api/batch read its multipart body while it is still arriving.
+    // Handlers without a stream parameter still receive complete bodies.
+    drogon::app().enableRequestStream();
     
     // Start the Drogon HTTP framework event loop.
     // This call blocks until the server is stopped.
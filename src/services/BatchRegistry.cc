@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#include "BatchRegistry.h"
+#include "ProgressTracker.h"
+#include <drogon/utils/Utilities.h>
+#include <algorithm>
+
+std::string BatchRegistry::create(const std::string& clientIP) {
+    std::string id = drogon::utils::getUuid();
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Periodic cleanup to prevent memory growth, same policy as ProgressTracker
+    if (batches_.size() > MAX_ENTRIES_BEFORE_CLEANUP) {
+        cleanupStaleEntries();
+    }
+
+    Batch& batch = batches_[id];
+    batch.clientIP = clientIP;
+    batch.updated = std::chrono::steady_clock::now();
+    return id;
+}
+
+size_t BatchRegistry::addItem(const std::string& batchId, const std::string& filename, const std::string& progressId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Batch& batch = batches_[batchId];
+    Item item;
+    item.filename = filename;
+    item.progressId = progressId;
+    batch.items.push_back(std::move(item));
+    batch.updated = std::chrono::steady_clock::now();
+    return batch.items.size() - 1;
+}
+
+void BatchRegistry::itemConverting(const std::string& batchId, size_t index) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = batches_.find(batchId);
+    if (it == batches_.end() || index >= it->second.items.size()) return;
+    Item& item = it->second.items[index];
+    if (item.state == State::Uploading) item.state = State::Converting;
+    it->second.updated = std::chrono::steady_clock::now();
+}
+
+void BatchRegistry::itemFinished(const std::string& batchId, size_t index, bool success,
+                                 const std::string& downloadUrl, const std::string& error) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = batches_.find(batchId);
+    if (it == batches_.end() || index >= it->second.items.size()) return;
+    Item& item = it->second.items[index];
+    item.state = success ? State::Done : State::Failed;
+    item.downloadUrl = downloadUrl;
+    item.error = error;
+    it->second.updated = std::chrono::steady_clock::now();
+}
+
+void BatchRegistry::uploadsComplete(const std::string& batchId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = batches_.find(batchId);
+    if (it == batches_.end()) return;
+    it->second.uploadsComplete = true;
+    it->second.updated = std::chrono::steady_clock::now();
+}
+
+void BatchRegistry::remove(const std::string& batchId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    batches_.erase(batchId);
+}
+
+Json::Value BatchRegistry::get(const std::string& batchId) {
+    static const char* stateNames[] = {"uploading", "converting", "done", "failed"};
+
+    Json::Value json;
+    std::vector<std::pair<Json::ArrayIndex, std::string>> converting;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = batches_.find(batchId);
+        if (it == batches_.end()) return Json::Value();
+        const Batch& batch = it->second;
+
+        bool finished = batch.uploadsComplete;
+        json["batch_id"] = batchId;
+        json["items"] = Json::Value(Json::arrayValue);
+        for (size_t i = 0; i < batch.items.size(); ++i) {
+            const Item& item = batch.items[i];
+            Json::Value entry;
+            entry["index"] = (Json::UInt64)i;
+            entry["filename"] = item.filename;
+            entry["state"] = stateNames[static_cast<int>(item.state)];
+            if (!item.progressId.empty()) entry["progress_id"] = item.progressId;
+            if (!item.downloadUrl.empty()) entry["download_url"] = item.downloadUrl;
+            if (!item.error.empty()) entry["error"] = item.error;
+            if (item.state == State::Converting) {
+                converting.emplace_back(static_cast<Json::ArrayIndex>(i), ProgressTracker::key(batch.clientIP, item.progressId));
+            }
+            finished = finished && (item.state == State::Done || item.state == State::Failed);
+            json["items"].append(entry);
+        }
+        json["uploads_complete"] = batch.uploadsComplete;
+        json["complete"] = finished;
+        if (!batch.zipUrl.empty()) json["zip_download_url"] = batch.zipUrl;
+    }
+
+    // Conversion progress of running items, read outside the registry lock
+    for (const auto& [index, progressId] : converting) {
+        Json::Value progress = ProgressTracker::instance().get(progressId);
+        if (progress.isMember("percent")) json["items"][index]["percent"] = progress["percent"];
+    }
+    return json;
+}
+
+bool BatchRegistry::item(const std::string& batchId, size_t index, State& state, std::string& downloadUrl, std::string& error) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = batches_.find(batchId);
+    if (it == batches_.end() || index >= it->second.items.size()) return false;
+    state = it->second.items[index].state;
+    downloadUrl = it->second.items[index].downloadUrl;
+    error = it->second.items[index].error;
+    return true;
+}
+
+bool BatchRegistry::finishedOutputs(const std::string& batchId, std::vector<std::string>& downloadUrls) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = batches_.find(batchId);
+    if (it == batches_.end() || !it->second.uploadsComplete) return false;
+    downloadUrls.clear();
+    for (const Item& item : it->second.items) {
+        if (item.state == State::Uploading || item.state == State::Converting) return false;
+        if (item.state == State::Done) downloadUrls.push_back(item.downloadUrl);
+    }
+    return true;
+}
+
+std::string BatchRegistry::clientIP(const std::string& batchId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = batches_.find(batchId);
+    return it == batches_.end() ? "" : it->second.clientIP;
+}
+
+void BatchRegistry::setZipUrl(const std::string& batchId, const std::string& url) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = batches_.find(batchId);
+    if (it != batches_.end()) it->second.zipUrl = url;
+}
+
+std::string BatchRegistry::zipUrl(const std::string& batchId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = batches_.find(batchId);
+    return it == batches_.end() ? "" : it->second.zipUrl;
+}
+
+Json::Value BatchRegistry::snapshot() {
+    Json::Value batches(Json::objectValue);
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& [id, batch] : batches_) {
+        Json::Value json;
+        json["client_ip"] = batch.clientIP;
+        json["uploads_complete"] = batch.uploadsComplete;
+        json["zip_url"] = batch.zipUrl;
+        json["items"] = Json::Value(Json::arrayValue);
+        for (const Item& item : batch.items) {
+            Json::Value entry;
+            entry["filename"] = item.filename;
+            entry["progress_id"] = item.progressId;
+            entry["state"] = static_cast<int>(item.state);
+            entry["download_url"] = item.downloadUrl;
+            entry["error"] = item.error;
+            json["items"].append(entry);
+        }
+        batches[id] = json;
+    }
+    return batches;
+}
+
+void BatchRegistry::restore(const Json::Value& batches) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& id : batches.getMemberNames()) {
+        const Json::Value& json = batches[id];
+        Batch& batch = batches_[id];
+        batch.clientIP = json["client_ip"].asString();
+        batch.uploadsComplete = true; // The request that streamed it ended with the old process
+        batch.zipUrl = json["zip_url"].asString();
+        batch.updated = now;
+        batch.items.clear();
+        for (const auto& entry : json["items"]) {
+            Item item;
+            item.filename = entry["filename"].asString();
+            item.progressId = entry["progress_id"].asString();
+            item.state = static_cast<State>(std::clamp(entry["state"].asInt(), 0, 3));
+            item.downloadUrl = entry["download_url"].asString();
+            item.error = entry["error"].asString();
+            if (item.state == State::Uploading || item.state == State::Converting) {
+                item.state = State::Failed;
+                item.error = "Interrupted by a server restart";
+            }
+            batch.items.push_back(std::move(item));
+        }
+    }
+}
+
+void BatchRegistry::itemResumed(const std::string& batchId, size_t index) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = batches_.find(batchId);
+    if (it == batches_.end() || index >= it->second.items.size()) return;
+    Item& item = it->second.items[index];
+    item.state = State::Converting;
+    item.error.clear();
+    it->second.updated = std::chrono::steady_clock::now();
+}
+
+void BatchRegistry::cleanupStaleEntries() {
+    auto cutoff = std::chrono::steady_clock::now() - RETENTION;
+    for (auto it = batches_.begin(); it != batches_.end(); ) {
+        if (it->second.updated < cutoff) {
+            it = batches_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <json/json.h>
+
+/**
+ * @class BatchRegistry
+ * @brief Thread-safe registry of multi-file batches submitted to /api/batch.
+ *
+ * A batch is created when its request starts streaming. Each file part becomes
+ * an item that moves through uploading -> converting -> done/failed on its own,
+ * so clients can poll the batch and fetch finished items while later ones are
+ * still uploading or converting.
+ */
+class BatchRegistry {
+public:
+    static BatchRegistry& instance() {
+        static BatchRegistry inst;
+        return inst;
+    }
+
+    enum class State { Uploading, Converting, Done, Failed };
+
+    /**
+     * @brief Registers a new batch and returns its id.
+     */
+    std::string create(const std::string& clientIP);
+
+    /**
+     * @brief Adds an item for a file part that started uploading.
+     * @return The item's index within the batch.
+     */
+    size_t addItem(const std::string& batchId, const std::string& filename, const std::string& progressId);
+
+    /**
+     * @brief Marks an item as fully received and queued for conversion.
+     */
+    void itemConverting(const std::string& batchId, size_t index);
+
+    /**
+     * @brief Records the outcome of an item.
+     * @param downloadUrl Output URL on success.
+     * @param error Reason shown to the client on failure.
+     */
+    void itemFinished(const std::string& batchId, size_t index, bool success,
+                      const std::string& downloadUrl, const std::string& error);
+
+    /**
+     * @brief Marks the end of the request body: no more items will be added.
+     */
+    void uploadsComplete(const std::string& batchId);
+
+    /**
+     * @brief Forgets a batch, e.g. one whose request carried no file.
+     */
+    void remove(const std::string& batchId);
+
+    /**
+     * @brief Batch snapshot as JSON, or a null value if the id is unknown.
+     */
+    Json::Value get(const std::string& batchId);
+
+    /**
+     * @brief Looks up one item.
+     * @return false if the batch or item is unknown.
+     */
+    bool item(const std::string& batchId, size_t index, State& state, std::string& downloadUrl, std::string& error);
+
+    /**
+     * @brief Download URLs of the successful items, once every item has finished.
+     * @return false if the batch is unknown or still has unfinished items.
+     */
+    bool finishedOutputs(const std::string& batchId, std::vector<std::string>& downloadUrls);
+
+    /**
+     * @brief Owner of a batch (empty if unknown), used for storage accounting of its ZIP.
+     */
+    std::string clientIP(const std::string& batchId);
+
+    void setZipUrl(const std::string& batchId, const std::string& url);
+    std::string zipUrl(const std::string& batchId);
+
+    /**
+     * @brief Every batch as JSON, handed to a successor process on restart.
+     */
+    Json::Value snapshot();
+
+    /**
+     * @brief Loads batches from a predecessor's snapshot().
+     *
+     * Items that were still uploading or converting are marked failed; the
+     * successor calls itemResumed() for the ones whose conversion it adopts.
+     */
+    void restore(const Json::Value& batches);
+
+    /**
+     * @brief Puts a restored item back into the converting state.
+     */
+    void itemResumed(const std::string& batchId, size_t index);
+
+private:
+    BatchRegistry() = default;
+    ~BatchRegistry() = default;
+    BatchRegistry(const BatchRegistry&) = delete;
+    BatchRegistry& operator=(const BatchRegistry&) = delete;
+
+    struct Item {
+        std::string filename;
+        std::string progressId;
+        State state = State::Uploading;
+        std::string downloadUrl;
+        std::string error;
+    };
+
+    struct Batch {
+        std::string clientIP;
+        std::vector<Item> items;
+        bool uploadsComplete = false;
+        std::string zipUrl;
+        std::chrono::steady_clock::time_point updated;
+    };
+
+    // Remove batches nobody has touched for a while
+    void cleanupStaleEntries();
+
+    std::unordered_map<std::string, Batch> batches_;
+    std::mutex mutex_;
+
+    const size_t MAX_ENTRIES_BEFORE_CLEANUP = 1000;
+    // Outputs expire after an hour (storage.file_ttl_seconds default), so do their batches
+    const std::chrono::minutes RETENTION{60};
+};
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#include "BlockingExecutor.h"
+#include <drogon/drogon.h>
+#include <trantor/utils/Logger.h>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+BlockingExecutor::BlockingExecutor() {
+    // Optional override from config.json (custom_config.io)
+    auto config = drogon::app().getCustomConfig()["io"];
+    threadCount_ = config.get("blocking_threads", (Json::UInt64)threadCount_).asUInt64();
+    if (threadCount_ == 0) threadCount_ = 1;
+
+    for (size_t i = 0; i < threadCount_; ++i) {
+        workers_.emplace_back(&BlockingExecutor::workerThread, this);
+    }
+    LOG_INFO << "BlockingExecutor started with " << threadCount_ << " threads";
+}
+
+BlockingExecutor::~BlockingExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    condition_.notify_all();
+    for (auto& worker : workers_) {
+        if (worker.joinable()) worker.join();
+    }
+}
+
+void BlockingExecutor::submit(std::function<void()> work, ResponseCallback callback) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push(Task{std::move(work), std::move(callback)});
+    }
+    condition_.notify_one();
+}
+
+BlockingExecutor::ResponseCallback BlockingExecutor::bindToLoop(trantor::EventLoop* loop, ResponseCallback callback) {
+    if (!loop) return once(std::move(callback));
+    return once([loop, callback = std::move(callback)](const drogon::HttpResponsePtr& resp) {
+        loop->queueInLoop([callback, resp]() { callback(resp); });
+    });
+}
+
+BlockingExecutor::ResponseCallback BlockingExecutor::once(ResponseCallback callback) {
+    auto answered = std::make_shared<std::atomic<bool>>(false);
+    return [answered, callback = std::move(callback)](const drogon::HttpResponsePtr& resp) {
+        if (!answered->exchange(true)) callback(resp);
+    };
+}
+
+size_t BlockingExecutor::pendingTasks() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return tasks_.size();
+}
+
+void BlockingExecutor::workerThread() {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+            if (stop_ && tasks_.empty()) return;
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }
+
+        // A throwing filesystem call must not take the pool thread down with it,
+        // nor leave its request without an answer
+        std::string error;
+        try {
+            task.work();
+        } catch (const std::exception& e) {
+            error = e.what();
+        } catch (...) {
+            error = "unknown exception";
+        }
+        if (error.empty()) continue;
+
+        LOG_ERROR << "Blocking task failed: " << error;
+        if (task.callback) {
+            auto resp = drogon::HttpResponse::newHttpResponse();
+            resp->setStatusCode(drogon::k500InternalServerError);
+            resp->setBody("Internal server error");
+            task.callback(resp);
+        }
+    }
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <drogon/HttpResponse.h>
+#include <trantor/net/EventLoop.h>
+#include <functional>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * @class BlockingExecutor
+ * @brief Small thread pool for blocking filesystem work started by HTTP handlers.
+ *
+ * Drogon runs every handler on one of its I/O event loops, and each loop serves
+ * many connections. Writing a 500 MB upload, stat-ing files or running ffprobe
+ * there stalls every other connection on that loop. Handlers validate the
+ * request on the loop, then `submit()` the rest here.
+ *
+ * Responses are always delivered on the loop that received the request:
+ * `bindToLoop()` wraps the handler's callback so it can be called from an
+ * executor or `ConversionManager` thread. Work submitted with the request's
+ * callback is answered with 500 if it throws, so the client is never left waiting.
+ */
+class BlockingExecutor {
+public:
+    using ResponseCallback = std::function<void(const drogon::HttpResponsePtr &)>;
+
+    static BlockingExecutor& instance() {
+        static BlockingExecutor inst;
+        return inst;
+    }
+
+    BlockingExecutor(const BlockingExecutor&) = delete;
+    BlockingExecutor& operator=(const BlockingExecutor&) = delete;
+
+    /**
+     * @brief Runs work on an executor thread.
+     * @param callback The callback of the request the work answers. If the work
+     *        throws, it receives a 500 response; it must ignore calls after the
+     *        first (see bindToLoop()). Empty for work that answers no request.
+     */
+    void submit(std::function<void()> work, ResponseCallback callback = nullptr);
+
+    /**
+     * @brief Wraps an HTTP callback so the response is posted to the given loop.
+     *        Only the first response is delivered; later calls are ignored.
+     * @param loop The request's event loop (EventLoop::getEventLoopOfCurrentThread() in a handler).
+     */
+    static ResponseCallback bindToLoop(trantor::EventLoop* loop, ResponseCallback callback);
+
+    /**
+     * @brief Wraps a callback so only its first call goes through.
+     */
+    static ResponseCallback once(ResponseCallback callback);
+
+    size_t pendingTasks();
+
+private:
+    BlockingExecutor();
+    ~BlockingExecutor();
+
+    struct Task {
+        std::function<void()> work;
+        ResponseCallback callback;
+    };
+
+    void workerThread();
+
+    std::vector<std::thread> workers_;
+    std::queue<Task> tasks_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stop_ = false;
+
+    size_t threadCount_ = 4;
+};
@@ -8,28 +8,43 @@
  */
 
 #include "ConversionManager.h"
+#include "ProcessRunner.h"
+#include "ProgressTracker.h"
+#include "FileIO.h"
+#include <drogon/drogon.h>
 #include <trantor/utils/Logger.h>
+#include <algorithm>
+#include <csignal>
 #include <cstdlib>
 #include <iostream>
-#include <filesystem>
-#include <chrono>
-#include <unistd.h>
-#include <sys/wait.h>
 #include <fcntl.h>
+#include <unistd.h>
 
 ConversionManager::ConversionManager() {
+    // Constructed first so it outlives the workers that submit trace records
+    JobTrace::instance();
+
     // Start worker threads equal to CPU cores (or at least 2)
     unsigned int numThreads = std::thread::hardware_concurrency();
     if (numThreads == 0) numThreads = 2; // Fallback
+
+    // With remote workers (custom_config.remote), the local pool can be shrunk or removed.
+    auto remote = drogon::app().getCustomConfig()["remote"];
+    remoteEnabled_ = remote.get("enabled", false).asBool();
+    if (remoteEnabled_) {
+        numThreads = remote.get("local_workers", numThreads).asUInt();
+    }
+    localWorkers_ = numThreads;
     
     LOG_INFO << "Starting ConversionManager with " << numThreads << " worker threads.";
 
     for (unsigned int i = 0; i < numThreads; ++i) {
-        workers_.emplace_back(&ConversionManager::workerThread, this);
+        workers_.emplace_back(&ConversionManager::workerThread, this, false);
+    }
+    // Zip archives and segment joins read several server-side files and never leave this host
+    if (numThreads == 0) {
+        workers_.emplace_back(&ConversionManager::workerThread, this, true);
     }
-    
-    // Start cleanup thread
-    cleanupThread_ = std::thread(&ConversionManager::cleanupLoop, this);
 }
 
 ConversionManager::~ConversionManager() {
@@ -38,131 +53,316 @@ ConversionManager::~ConversionManager() {
         stop_ = true;
     }
     condition_.notify_all();
-    cleanupCondition_.notify_all(); // Wake up cleanup thread
     for (std::thread &worker : workers_) {
         if (worker.joinable()) {
             worker.join();
         }
     }
-    if (cleanupThread_.joinable()) {
-        cleanupThread_.join();
+}
+
+void ConversionManager::addTask(const std::vector<std::string>& args, const std::string& inputFilename, const std::string& outputFilename, std::function<void(bool success)> callback,
+                                double mediaSeconds, const std::string& progressId) {
+    ConversionTask task;
+    task.args = args;
+    task.outputFilename = outputFilename;
+    task.inputFilename = inputFilename;
+    task.callback = std::move(callback);
+    task.mediaSeconds = mediaSeconds;
+    task.progressId = progressId;
+    addTask(std::move(task));
+}
+
+void ConversionManager::addTask(ConversionTask task) {
+    if (!task.progressId.empty()) {
+        ProgressTracker::instance().start(task.progressId, task.mediaSeconds);
+        task.callback = [callback = std::move(task.callback), progressId = task.progressId](bool success) {
+            ProgressTracker::instance().finish(progressId, success);
+            if (callback) callback(success);
+        };
+    }
+    enqueue(std::move(task));
+}
+
+void ConversionManager::addTaskGroup(std::vector<ConversionTask> parts, ConversionTask join, std::vector<std::string> tempFiles) {
+    struct GroupState {
+        std::atomic<size_t> remaining{0};
+        std::atomic<bool> failed{false};
+    };
+    auto state = std::make_shared<GroupState>();
+    state->remaining = parts.size();
+
+    // Progress is the sum of all parts; the join itself is only a remux
+    std::string progressId = join.progressId;
+    double totalSeconds = 0;
+    for (const auto& part : parts) totalSeconds += part.mediaSeconds;
+    ProgressTracker::instance().start(progressId, totalSeconds);
+    join.progressId.clear();
+
+    join.callback = [callback = std::move(join.callback), tempFiles = std::move(tempFiles), progressId](bool success) {
+        FileIO::instance().removeFiles(tempFiles);
+        ProgressTracker::instance().finish(progressId, success);
+        if (callback) callback(success);
+    };
+    auto sharedJoin = std::make_shared<ConversionTask>(std::move(join));
+
+    for (size_t i = 0; i < parts.size(); ++i) {
+        ConversionTask& part = parts[i];
+        part.progressId = progressId;
+        part.progressPart = i;
+        part.countsAsConversion = false;
+        part.trace = sharedJoin->trace;
+        part.callback = [this, state, sharedJoin](bool success) {
+            if (!success) state->failed = true;
+            if (--state->remaining > 0) return;
+
+            // Last part finished: join if everything succeeded
+            if (state->failed) {
+                LOG_ERROR << "Segment failed, abandoning " << sharedJoin->outputFilename;
+                sharedJoin->callback(false);
+            } else {
+                // Ahead of the queue: waiting behind other jobs would undo what splitting saved
+                enqueue(std::move(*sharedJoin), true);
+            }
+        };
+        enqueue(std::move(part));
+    }
+}
+
+size_t ConversionManager::spareWorkers() {
+    std::lock_guard<std::mutex> lock(queueMutex_);
+    size_t capacity = localWorkers_ + remoteWorkers_;
+    size_t committed = busyWorkers_ + tasks_.size();
+    return committed >= capacity ? 0 : capacity - committed;
+}
+
+void ConversionManager::countQueued(const ConversionTask& task, int sign) {
+    // Unsigned wrap-around makes adding the negated amount a subtraction
+    uint64_t media = static_cast<uint64_t>(task.mediaSeconds * 1000);
+    uint64_t work = static_cast<uint64_t>(task.mediaSeconds * task.cost * 1000);
+    queuedMediaMillis_ += sign > 0 ? media : -media;
+    queuedWorkMillis_ += sign > 0 ? work : -work;
+}
+
+void ConversionManager::enqueue(ConversionTask task, bool front) {
+    countQueued(task, 1);
+    // Segments and their join share one record; the first enqueue is the queued stage
+    if (task.trace && task.trace->queued == 0) task.trace->queued = JobTrace::now();
+    {
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        if (front) {
+            tasks_.push_front(std::move(task));
+        } else {
+            tasks_.push_back(std::move(task));
+        }
+    }
+    // Waiters may only accept some tasks (housekeeping thread, remote leases), so wake them all
+    if (remoteEnabled_) {
+        condition_.notify_all();
+    } else {
+        condition_.notify_one();
     }
 }
 
-void ConversionManager::addTask(const std::vector<std::string>& args, const std::string& inputFilename, const std::string& outputFilename, std::function<void(bool success)> callback) {
+bool ConversionManager::takeRemoteTask(bool sharedPath, ConversionTask& task, std::chrono::milliseconds wait) {
+    auto leasable = [sharedPath](const ConversionTask& t) {
+        return t.remoteAllowed && (sharedPath || t.followUpArgs.empty());
+    };
     {
         std::unique_lock<std::mutex> lock(queueMutex_);
-        tasks_.push({args, outputFilename, inputFilename, callback});
+        auto it = tasks_.end();
+        condition_.wait_for(lock, wait, [&] {
+            it = std::find_if(tasks_.begin(), tasks_.end(), leasable);
+            return stop_ || it != tasks_.end();
+        });
+        if (stop_ || it == tasks_.end()) return false;
+
+        task = std::move(*it);
+        tasks_.erase(it);
+        ++busyWorkers_;
     }
-    condition_.notify_one();
+    countQueued(task, -1);
+    return true;
+}
+
+void ConversionManager::finishRemoteTask(ConversionTask task, bool success) {
+    complete(task, success);
 }
 
-void ConversionManager::workerThread() {
+void ConversionManager::requeueRemoteTask(ConversionTask task) {
+    countQueued(task, 1);
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        --busyWorkers_;
+        // Front of the queue: the job has already waited once
+        tasks_.push_front(std::move(task));
+    }
+    condition_.notify_all();
+}
+
+bool ConversionManager::idle() {
+    std::lock_guard<std::mutex> lock(queueMutex_);
+    return tasks_.empty() && busyWorkers_ == 0;
+}
+
+void ConversionManager::abortAll() {
+    std::deque<ConversionTask> queued;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        queued.swap(tasks_);
+    }
+    // Stays set: the process is about to quit, and later commands would only be killed too
+    abort_ = true;
+    LOG_WARN << "Aborting " << queued.size() << " queued tasks and all running commands";
+    for (auto& task : queued) {
+        countQueued(task, -1);
+        if (task.callback) task.callback(false);
+    }
+}
+
+std::vector<HandOffEntry> ConversionManager::handOff() {
+    auto describe = [](const ConversionTask& task, bool withFallback) {
+        Json::Value entry;
+        for (const auto& arg : task.args) entry["args"].append(arg);
+        if (withFallback) {
+            for (const auto& arg : task.fallbackArgs) entry["fallback_args"].append(arg);
+        }
+        entry["media_seconds"] = task.mediaSeconds;
+        entry["cost"] = task.cost;
+        entry["progress_id"] = task.progressId;
+        entry["remote_allowed"] = task.remoteAllowed;
+        entry["handoff"] = task.handoff;
+        return entry;
+    };
+
+    std::vector<HandOffEntry> entries;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        handedOff_ = true;
+        stop_ = true;
+        for (const auto& task : tasks_) {
+            if (task.handoff.isNull()) continue;
+            HandOffEntry entry;
+            entry.task = describe(task, true);
+            entry.task["state"] = "queued";
+            entries.push_back(std::move(entry));
+        }
+        tasks_.clear();
+
+        for (const Running* running : running_) {
+            int pid = running->child.pid;
+            if (pid <= 0) continue;
+            const ConversionTask& task = *running->task;
+            if (task.handoff.isNull() || !task.followUpArgs.empty()) {
+                // Segments and archives belong to state the successor does not have
+                kill(pid, SIGKILL);
+                continue;
+            }
+            HandOffEntry entry;
+            entry.task = describe(task, !running->fallback);
+            entry.task["state"] = "running";
+            entry.task["pid"] = pid;
+            entry.task["start_time"] = (Json::UInt64)ProcessRunner::startTime(pid);
+            int fd = running->child.stdoutFd;
+            if (fd >= 0) {
+                entry.stdoutFd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+                // The worker may have closed and reused the descriptor in between
+                if (entry.stdoutFd >= 0 && (running->child.stdoutFd != fd || running->child.pid != pid)) {
+                    close(entry.stdoutFd);
+                    entry.stdoutFd = -1;
+                }
+            }
+            entries.push_back(std::move(entry));
+        }
+    }
+    condition_.notify_all();
+    return entries;
+}
+
+void ConversionManager::complete(ConversionTask& task, bool success) {
+    if (success && task.countsAsConversion) {
+        incrementTotalConversions();
+    }
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        --busyWorkers_;
+    }
+
+    if (task.callback) {
+        task.callback(success);
+    }
+}
+
+void ConversionManager::workerThread(bool housekeeping) {
     while (true) {
         ConversionTask task;
+        Running running;
         {
             std::unique_lock<std::mutex> lock(queueMutex_);
-            condition_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+            auto it = tasks_.end();
+            condition_.wait(lock, [&] {
+                it = housekeeping ? std::find_if(tasks_.begin(), tasks_.end(),
+                                                 [](const ConversionTask& t) { return !t.remoteAllowed; })
+                                  : tasks_.begin();
+                return stop_ || it != tasks_.end();
+            });
             
-            if (stop_ && tasks_.empty()) return;
+            if (stop_ && it == tasks_.end()) return;
             
-            task = std::move(tasks_.front());
-            tasks_.pop();
+            task = std::move(*it);
+            tasks_.erase(it);
+            ++busyWorkers_;
+            running.task = &task;
+            running_.push_back(&running);
         }
+        countQueued(task, -1);
 
-        std::string cmdStr;
-        for(const auto& arg : task.args) cmdStr += arg + " ";
-        LOG_INFO << "Worker processing conversion: " << cmdStr;
+        LOG_INFO << "Worker processing " << task.outputFilename;
+        if (task.onStart) task.onStart();
+        if (task.trace) task.trace->markStarted();
         
-        // Secure execution using fork/exec
-        pid_t pid = fork();
-        int status = 0;
-        bool success = false;
-
-        if (pid == -1) {
-            LOG_ERROR << "Failed to fork";
-            success = false;
-        } else if (pid == 0) {
-            // Child process
-            std::vector<char*> cargs;
-            for (const auto& arg : task.args) {
-                cargs.push_back(const_cast<char*>(arg.c_str()));
-            }
-            cargs.push_back(nullptr);
-
-            // Redirect stdout/stderr to /dev/null using low-level file descriptors
-            // This avoids "ignoring return value of freopen" warnings and is safer in forked processes.
-            int devNull = open("/dev/null", O_WRONLY);
-            if (devNull != -1) {
-                dup2(devNull, STDOUT_FILENO); // Redirect stdout
-                dup2(devNull, STDERR_FILENO); // Redirect stderr
-                close(devNull);
-            }
-            
-            execvp(cargs[0], cargs.data());
-            
-            // If execvp returns, it failed
-            exit(1); 
-        } else {
-            // Parent process
-            waitpid(pid, &status, 0);
-            if (WIFEXITED(status)) {
-                int exitCode = WEXITSTATUS(status);
-                LOG_INFO << "Worker execution result: " << exitCode;
-                success = (exitCode == 0);
-            } else {
-                LOG_ERROR << "Child process terminated abnormally";
-                success = false;
+        // Secure execution using fork/exec (see ProcessRunner).
+        // With a progress id, ffmpeg writes key=value progress lines to stdout.
+        ProcessRunner::LineCallback onProgress;
+        if (!task.progressId.empty()) {
+            onProgress = [&task](const std::string& line) {
+                // out_time_us is in microseconds (out_time_ms is too, despite its name)
+                if (line.rfind("out_time_us=", 0) == 0) {
+                    double processed = std::atof(line.c_str() + 12) / 1e6;
+                    ProgressTracker::instance().update(task.progressId, processed, task.progressPart);
+                }
+            };
+        }
+
+        // The pid is published for handOff(); abort_ cancels the command
+        ProcessResult result = ProcessRunner::run(task.args, onProgress, std::chrono::milliseconds(0), &abort_, &running.child);
+        long peakRssKb = result.peakRssKb;
+        if (!result.success() && !task.fallbackArgs.empty() && !abort_) {
+            LOG_WARN << "Primary command failed, running fallback for " << task.outputFilename;
+            {
+                std::lock_guard<std::mutex> lock(queueMutex_);
+                running.fallback = true;
             }
+            result = ProcessRunner::run(task.fallbackArgs, onProgress, std::chrono::milliseconds(0), &abort_, &running.child);
+            peakRssKb = std::max(peakRssKb, result.peakRssKb);
         }
-        
-        if (success) {
-            ConversionManager::instance().incrementTotalConversions();
+        for (size_t i = 0; i < task.followUpArgs.size() && result.success(); ++i) {
+            result = ProcessRunner::run(task.followUpArgs[i], nullptr, std::chrono::milliseconds(0), &abort_, &running.child);
+            peakRssKb = std::max(peakRssKb, result.peakRssKb);
         }
-        
-        if (task.callback) {
-            task.callback(success);
+        bool success = result.success();
+        if (task.trace) task.trace->markFinished(result.exitCode, peakRssKb);
+        if (result.exited) {
+            LOG_INFO << "Worker execution result: " << result.exitCode;
+        } else if (result.started) {
+            LOG_ERROR << "Child process terminated abnormally";
         }
-    }
-}
 
-void ConversionManager::cleanupLoop() {
-    namespace fs = std::filesystem;
-    // Cleanup every 5 minutes
-    const auto cleanupInterval = std::chrono::minutes(5);
-    // Delete files older than 1 hour
-    const auto maxFileAge = std::chrono::hours(1);
-    
-    while (true) {
         {
-            // Use dedicated cleanup mutex to avoid contention with workers
-            std::unique_lock<std::mutex> lock(cleanupMutex_);
-            if (cleanupCondition_.wait_for(lock, cleanupInterval, [this] { return stop_; })) {
-                return; // Stop requested
-            }
-        }
-        
-        LOG_INFO << "Running old file cleanup...";
-        
-        std::vector<std::string> dirs = {"./uploads/", "./www/downloads/"};
-        auto now = fs::file_time_type::clock::now();
-        
-        for (const auto& dirPath : dirs) {
-            if (!fs::exists(dirPath)) continue;
-            
-            for (const auto& entry : fs::directory_iterator(dirPath)) {
-                if (!entry.is_regular_file()) continue;
-                
-                try {
-                    auto ftime = entry.last_write_time();
-                    if ((now - ftime) > maxFileAge) {
-                        LOG_INFO << "Deleting old file: " << entry.path();
-                        fs::remove(entry.path());
-                    }
-                } catch (const std::exception& e) {
-                    LOG_ERROR << "Error deleting file: " << e.what();
-                }
-            }
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            running_.erase(std::find(running_.begin(), running_.end(), &running));
+            // After a hand-off the successor owns the task's files and client state
+            if (handedOff_) return;
         }
+        complete(task, success);
     }
 }
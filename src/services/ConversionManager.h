@@ -12,13 +12,17 @@
 #include <string>
 #include <functional>
 #include <vector>
-#include <queue>
+#include <deque>
+#include <chrono>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <memory>
 #include <atomic>
 #include <drogon/HttpResponse.h>
+#include <json/json.h>
+#include "JobTrace.h"
+#include "ProcessRunner.h"
 
 using namespace drogon;
 
@@ -27,6 +31,25 @@ struct ConversionTask {
     std::string outputFilename; // For verification or just logging
     std::string inputFilename; // To cleanup if needed
     std::function<void(bool success)> callback;
+    double mediaSeconds = 0; // Probed duration, 0 if unknown (e.g. zip tasks)
+    double cost = 1.0; // Encode time per media second relative to mp3/medium (EncoderPreset::cost)
+    std::string progressId; // Reported to ProgressTracker if non-empty (requires -progress pipe:1)
+    std::vector<std::string> fallbackArgs; // Run instead if args fails (e.g. stream copy -> re-encode)
+    std::vector<std::vector<std::string>> followUpArgs; // Run in order after args succeeds
+    size_t progressPart = 0; // Index of this part when several tasks report into one progress id
+    bool countsAsConversion = true; // False for segments of a larger job
+    std::function<void()> onStart; // Called on the worker thread right before the command runs
+    bool remoteAllowed = false; // May be leased to a konvertor_worker (commands only touch the input, the output and files next to it)
+    JobTracePtr trace; // Trace record of the job this task belongs to (shared by segments), may be null
+    Json::Value handoff; // How a successor process finishes this task after a restart (see JobAdopter), null if it cannot
+};
+
+/**
+ * @brief A task passed to a successor process by ConversionManager::handOff().
+ */
+struct HandOffEntry {
+    Json::Value task; // Commands, progress id, handoff description and, if running, pid and start_time
+    int stdoutFd = -1; // Duplicate of a running command's progress pipe (owned by the entry holder), or -1
 };
 
 /**
@@ -58,10 +81,88 @@ public:
      * @param inputFilename Path to input file (for cleanup tracking).
      * @param outputFilename Path to output file.
      * @param callback Function to call upon task completion.
+     * @param mediaSeconds Probed media duration, used for backlog estimates and progress.
+     * @param progressId Client progress id; the command must write `-progress pipe:1`.
+     */
+    void addTask(const std::vector<std::string>& args, const std::string& inputFilename, const std::string& outputFilename, std::function<void(bool success)> callback,
+                 double mediaSeconds = 0, const std::string& progressId = "");
+
+    /**
+     * @brief Adds a fully described task to the execution queue.
+     */
+    void addTask(ConversionTask task);
+
+    /**
+     * @brief Runs several tasks in parallel, then a join task once all of them succeeded.
+     *
+     * Used for segment-parallel transcoding: each part encodes one time range
+     * and the join task concatenates them. If any part fails the join is not
+     * run and its callback receives false. Parts report progress into the
+     * join task's progress id.
+     * @param parts Independent tasks; their callbacks are replaced.
+     * @param join Task to run after every part succeeded; owns the job's callback.
+     * @param tempFiles Intermediate files removed once the group completes.
+     */
+    void addTaskGroup(std::vector<ConversionTask> parts, ConversionTask join, std::vector<std::string> tempFiles);
+
+    /**
+     * @brief Number of workers (local and remote) that would sit idle if nothing else arrived.
+     */
+    size_t spareWorkers();
+
+    /**
+     * @brief Takes the oldest task a remote worker may run, waiting up to `wait` for one.
+     *
+     * Used by JobDispatcher. The task counts as busy until it is passed back
+     * through finishRemoteTask() or requeueRemoteTask().
+     * @param sharedPath The worker sees the server's paths; otherwise only tasks
+     *        without follow-up commands qualify (their output is sent back over the connection).
+     * @return false if nothing qualified before the wait elapsed.
+     */
+    bool takeRemoteTask(bool sharedPath, ConversionTask& task, std::chrono::milliseconds wait);
+
+    /**
+     * @brief Completes a task that a remote worker ran.
      */
-    void addTask(const std::vector<std::string>& args, const std::string& inputFilename, const std::string& outputFilename, std::function<void(bool success)> callback);
+    void finishRemoteTask(ConversionTask task, bool success);
+
+    /**
+     * @brief Puts a leased task back at the front of the queue (lease expired or worker gone).
+     */
+    void requeueRemoteTask(ConversionTask task);
+
+    /**
+     * @brief Number of connected remote workers, counted as capacity by spareWorkers().
+     */
+    void setRemoteWorkers(size_t count) { remoteWorkers_ = count; }
     
+    /**
+     * @brief True when no task is queued, running locally or leased to a remote worker.
+     */
+    bool idle();
+
+    /**
+     * @brief Fails every queued task and kills running commands (end of a drain
+     *        without a successor). Callbacks run with false as usual.
+     */
+    void abortAll();
+
+    /**
+     * @brief Stops all workers and describes the work for a successor process.
+     *
+     * Queued tasks and running commands whose task has a `handoff` description
+     * become journal entries; running commands are left running for the
+     * successor to adopt; their progress pipe is duplicated so ffmpeg keeps a
+     * reader once this process exits. Other running commands are killed. No
+     * callback runs afterwards, so the caller must exit the process.
+     */
+    std::vector<HandOffEntry> handOff();
+
     uint64_t getTotalConversions() const { return totalConversions_; }
+    // Seconds of media waiting in the queue (not yet picked up by a worker)
+    double getQueuedMediaSeconds() const { return queuedMediaMillis_ / 1000.0; }
+    // Queued media weighted by each task's preset cost, in mp3/medium seconds
+    double getQueuedWorkSeconds() const { return queuedWorkMillis_ / 1000.0; }
     void incrementTotalConversions() { totalConversions_++; }
 
 private:
@@ -69,23 +170,38 @@ private:
     ~ConversionManager();
 
     std::atomic<uint64_t> totalConversions_{0};
+    std::atomic<uint64_t> queuedMediaMillis_{0};
+    std::atomic<uint64_t> queuedWorkMillis_{0};
 
-    // Background worker thread loop
-    void workerThread();
-    // Periodic file cleanup loop
-    void cleanupLoop();
+    // Background worker thread loop; a housekeeping thread only runs tasks that cannot be leased
+    void workerThread(bool housekeeping);
+    // Adds (or with sign -1 removes) a task's media and work from the backlog counters
+    void countQueued(const ConversionTask& task, int sign);
+    // Pushes a task onto the queue (front: ahead of every waiting task) without any progress bookkeeping
+    void enqueue(ConversionTask task, bool front = false);
+    // Counters and callback once a task has run (locally or remotely)
+    void complete(ConversionTask& task, bool success);
+
+    // A task a local worker is running, and its current command
+    struct Running {
+        const ConversionTask* task = nullptr;
+        ChildHandle child;
+        bool fallback = false; // Running fallbackArgs; the primary command already failed
+    };
 
     std::vector<std::thread> workers_;
-    std::thread cleanupThread_;
-    std::queue<ConversionTask> tasks_;
+    size_t localWorkers_ = 0; // Threads that run any task (excludes the housekeeping thread)
+    std::atomic<size_t> remoteWorkers_{0};
+    bool remoteEnabled_ = false;
+    std::deque<ConversionTask> tasks_;
     
     // Mutex for protecting the task queue
     std::mutex queueMutex_;
     std::condition_variable condition_;
-    
-    // Separate mutex for cleanup thread to avoid contention with workers
-    std::mutex cleanupMutex_;
-    std::condition_variable cleanupCondition_;
+    size_t busyWorkers_ = 0; // Guarded by queueMutex_
+    std::vector<Running*> running_; // Guarded by queueMutex_
     
     bool stop_ = false;
+    bool handedOff_ = false; // Guarded by queueMutex_; workers leave without completing their task
+    std::atomic<bool> abort_{false}; // Cancels running commands (see abortAll())
 };
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#include "DispatchConnection.h"
+#include <trantor/utils/Logger.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+// A line longer than this is not a protocol message
+static const size_t MAX_MESSAGE_BYTES = 1024 * 1024;
+
+// Fills a sockaddr for "unix:/path" or "host:port"; returns its length or 0 if malformed
+static socklen_t parseAddress(const std::string& address, sockaddr_storage& storage) {
+    std::memset(&storage, 0, sizeof(storage));
+    if (address.rfind("unix:", 0) == 0) {
+        std::string path = address.substr(5);
+        auto* un = reinterpret_cast<sockaddr_un*>(&storage);
+        if (path.empty() || path.size() >= sizeof(un->sun_path)) return 0;
+        un->sun_family = AF_UNIX;
+        std::memcpy(un->sun_path, path.c_str(), path.size() + 1);
+        return sizeof(sockaddr_un);
+    }
+
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) return 0;
+    auto* in = reinterpret_cast<sockaddr_in*>(&storage);
+    in->sin_family = AF_INET;
+    in->sin_port = htons(static_cast<uint16_t>(std::atoi(address.c_str() + colon + 1)));
+    if (inet_pton(AF_INET, address.substr(0, colon).c_str(), &in->sin_addr) != 1) return 0;
+    return sizeof(sockaddr_in);
+}
+
+DispatchConnection::~DispatchConnection() {
+    if (fd_ >= 0) close(fd_);
+}
+
+int DispatchConnection::listenOn(const std::string& address) {
+    sockaddr_storage storage;
+    socklen_t length = parseAddress(address, storage);
+    if (length == 0) {
+        LOG_ERROR << "Invalid dispatch address: " << address;
+        return -1;
+    }
+
+    int fd = socket(storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    const char* path = nullptr;
+    if (storage.ss_family == AF_UNIX) {
+        // A socket file left behind by a previous run (or held by the process
+        // being replaced in a restart) would make bind() fail
+        path = reinterpret_cast<sockaddr_un*>(&storage)->sun_path;
+        unlink(path);
+    } else {
+        // No SO_REUSEPORT: another process binding the same port would take a share of the workers
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    }
+    // Workers are trusted with uploads, so only the service's user may connect to
+    // the socket file; nobody can connect before listen(), so chmod() is not racy
+    bool ok = bind(fd, reinterpret_cast<sockaddr*>(&storage), length) == 0 &&
+              (!path || chmod(path, 0600) == 0) && listen(fd, 64) == 0;
+    if (!ok) {
+        int err = errno;
+        if (err != EADDRINUSE) LOG_ERROR << "Cannot listen on " << address << ": " << std::strerror(err);
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+int DispatchConnection::connectTo(const std::string& address) {
+    sockaddr_storage storage;
+    socklen_t length = parseAddress(address, storage);
+    if (length == 0) return -1;
+
+    int fd = socket(storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, reinterpret_cast<sockaddr*>(&storage), length) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (storage.ss_family == AF_INET) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+bool DispatchConnection::send(const Json::Value& message) {
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    std::string line = Json::writeString(builder, message) + "\n";
+
+    const char* data = line.data();
+    size_t left = line.size();
+    while (left > 0) {
+        ssize_t n = ::send(fd_, data, left, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        left -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool DispatchConnection::receive(Json::Value& message, int timeoutMs, bool* timedOut) {
+    if (timedOut) *timedOut = false;
+    size_t newline;
+    while ((newline = buffer_.find('\n')) == std::string::npos) {
+        if (buffer_.size() > MAX_MESSAGE_BYTES) return false;
+
+        struct pollfd pfd = {fd_, POLLIN, 0};
+        int ready = poll(&pfd, 1, timeoutMs);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready == 0) {
+            if (timedOut) *timedOut = true;
+            return false;
+        }
+        if (ready < 0) return false;
+
+        char chunk[4096];
+        ssize_t n = recv(fd_, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        buffer_.append(chunk, static_cast<size_t>(n));
+    }
+
+    std::string line = buffer_.substr(0, newline);
+    buffer_.erase(0, newline + 1);
+
+    Json::CharReaderBuilder builder;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    std::string errors;
+    return reader->parse(line.data(), line.data() + line.size(), &message, &errors) && message.isObject();
+}
+
+bool DispatchConnection::sendFile(const std::string& path, uint64_t size) {
+    int in = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) return false;
+    off_t offset = 0;
+    bool ok = true;
+    while (ok && static_cast<uint64_t>(offset) < size) {
+        ssize_t n = sendfile(fd_, in, &offset, static_cast<size_t>(size - offset));
+        if (n < 0 && errno == EINTR) continue;
+        ok = n > 0;
+    }
+    close(in);
+    return ok;
+}
+
+bool DispatchConnection::receiveFile(const std::string& path, uint64_t size) {
+    int out = -1;
+    if (!path.empty()) {
+        out = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (out < 0) return false;
+    }
+
+    bool ok = true;
+    auto consume = [&](const char* data, size_t length) {
+        while (ok && out >= 0 && length > 0) {
+            ssize_t n = write(out, data, length);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                ok = false;
+                break;
+            }
+            data += n;
+            length -= static_cast<size_t>(n);
+        }
+    };
+
+    // Bytes that arrived together with the announcing message
+    size_t buffered = static_cast<size_t>(std::min<uint64_t>(size, buffer_.size()));
+    consume(buffer_.data(), buffered);
+    buffer_.erase(0, buffered);
+    uint64_t left = size - buffered;
+
+    char chunk[64 * 1024];
+    while (ok && left > 0) {
+        ssize_t n = recv(fd_, chunk, static_cast<size_t>(std::min<uint64_t>(sizeof(chunk), left)), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            ok = false;
+            break;
+        }
+        consume(chunk, static_cast<size_t>(n));
+        left -= static_cast<uint64_t>(n);
+    }
+
+    if (out >= 0) close(out);
+    return ok;
+}
+
+void DispatchConnection::shutdown() {
+    ::shutdown(fd_, SHUT_RDWR);
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <json/json.h>
+
+/**
+ * @class DispatchConnection
+ * @brief One end of a dispatcher <-> worker connection (see JobDispatcher).
+ *
+ * Messages are single-line JSON objects terminated by '\n'. File contents
+ * (inputs and outputs when the worker has no shared path) are sent as raw
+ * bytes right after the message that announces their size.
+ *
+ * Addresses are either `unix:/path/to/socket` or `host:port` (IPv4).
+ * Used by both the server and the konvertor_worker binary.
+ */
+class DispatchConnection {
+public:
+    explicit DispatchConnection(int fd) : fd_(fd) {}
+    ~DispatchConnection();
+
+    DispatchConnection(const DispatchConnection&) = delete;
+    DispatchConnection& operator=(const DispatchConnection&) = delete;
+
+    /**
+     * @brief Creates a listening socket for an address.
+     *
+     * A Unix socket is made accessible to its owner only (0600). A TCP port is
+     * bound without SO_REUSEPORT, so no other process can share its connections.
+     * @return The socket, or -1 (error logged unless errno is EADDRINUSE).
+     */
+    static int listenOn(const std::string& address);
+
+    /**
+     * @brief Connects to an address.
+     * @return The socket, or -1.
+     */
+    static int connectTo(const std::string& address);
+
+    /**
+     * @brief Sends one message.
+     */
+    bool send(const Json::Value& message);
+
+    /**
+     * @brief Receives one message.
+     * @param timeoutMs Give up after this long without a complete line (-1 = wait forever).
+     * @param timedOut Set when false is returned because of the timeout; the
+     *        connection stays usable and a partial line is kept.
+     * @return false on timeout, EOF, a socket error or an invalid message.
+     */
+    bool receive(Json::Value& message, int timeoutMs, bool* timedOut = nullptr);
+
+    /**
+     * @brief Sends the first size bytes of a file.
+     */
+    bool sendFile(const std::string& path, uint64_t size);
+
+    /**
+     * @brief Receives size raw bytes into a new file. An empty path discards them.
+     */
+    bool receiveFile(const std::string& path, uint64_t size);
+
+    /**
+     * @brief Unblocks a thread waiting in receive() (used on shutdown).
+     */
+    void shutdown();
+
+private:
+    int fd_;
+    std::string buffer_; // Bytes received after the last complete line
+};
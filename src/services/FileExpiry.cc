@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#include "FileExpiry.h"
+#include "StorageManager.h"
+#include <drogon/drogon.h>
+#include <trantor/utils/Logger.h>
+#include <algorithm>
+
+FileExpiry::FileExpiry() {
+    // Optional override from config.json (custom_config.storage)
+    auto config = drogon::app().getCustomConfig()["storage"];
+    fileTtl_ = std::chrono::seconds(config.get("file_ttl_seconds", (Json::Int64)fileTtl_.count()).asInt64());
+
+    expiryThread_ = std::thread(&FileExpiry::expiryLoop, this);
+}
+
+FileExpiry::~FileExpiry() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    condition_.notify_all();
+    if (expiryThread_.joinable()) {
+        expiryThread_.join();
+    }
+}
+
+void FileExpiry::track(const std::string& path, std::chrono::seconds age) {
+    // Already expired files (age >= TTL) get a deadline of now
+    auto remaining = std::max(fileTtl_ - age, std::chrono::seconds(0));
+    auto deadline = std::chrono::steady_clock::now() + remaining;
+    bool earliest = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        earliest = heap_.empty() || deadline < heap_.top().deadline;
+        heap_.push({deadline, path});
+    }
+    // Only wake the expiry thread if its current sleep target moved earlier
+    if (earliest) {
+        condition_.notify_one();
+    }
+}
+
+size_t FileExpiry::trackedFiles() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return heap_.size();
+}
+
+void FileExpiry::expiryLoop() {
+    while (true) {
+        std::vector<std::string> due;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (stop_) return;
+            // Sleep until the earliest deadline (or until something is tracked)
+            if (heap_.empty()) {
+                condition_.wait(lock);
+            } else {
+                condition_.wait_until(lock, heap_.top().deadline);
+            }
+            if (stop_) return;
+
+            auto now = std::chrono::steady_clock::now();
+            while (!heap_.empty() && heap_.top().deadline <= now) {
+                due.push_back(heap_.top().path);
+                heap_.pop();
+            }
+        }
+
+        // Delete outside the lock so track() never waits on disk I/O.
+        // Entries are never unregistered, so files already removed by their
+        // owner (e.g. inputs deleted after conversion) are simply skipped.
+        // Files expiring together are unlinked in one batch.
+        size_t removed = StorageManager::instance().removeAll(due);
+        if (removed > 0) {
+            LOG_INFO << "Deleted " << removed << " expired file(s)";
+        }
+    }
+}
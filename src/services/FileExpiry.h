@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+/**
+ * @class FileExpiry
+ * @brief Singleton service that deletes uploads and outputs at their expiry time.
+ *
+ * Every file the application produces is registered with `track()` when it is
+ * created. Deadlines are kept in a min-heap, and a single background thread
+ * sleeps until the earliest one, so files are removed on time without
+ * periodically scanning the storage directories. Files left by a previous run
+ * are re-registered once at startup by `StorageManager::recover()`.
+ *
+ * Deletion goes through `StorageManager` so disk accounting stays in sync.
+ */
+class FileExpiry {
+public:
+    static FileExpiry& instance() {
+        static FileExpiry inst;
+        return inst;
+    }
+
+    FileExpiry(const FileExpiry&) = delete;
+    FileExpiry& operator=(const FileExpiry&) = delete;
+
+    /**
+     * @brief Registers a file for deletion once the configured TTL has elapsed.
+     * @param path Path of the file on disk.
+     * @param age How old the file already is (non-zero for recovered files).
+     */
+    void track(const std::string& path, std::chrono::seconds age = std::chrono::seconds(0));
+
+    size_t trackedFiles();
+
+private:
+    FileExpiry();
+    ~FileExpiry();
+
+    struct Entry {
+        std::chrono::steady_clock::time_point deadline;
+        std::string path;
+    };
+
+    // Orders the heap so the earliest deadline is on top
+    struct LaterDeadline {
+        bool operator()(const Entry& a, const Entry& b) const {
+            return a.deadline > b.deadline;
+        }
+    };
+
+    // Background loop: sleeps until the next deadline and removes due files
+    void expiryLoop();
+
+    std::priority_queue<Entry, std::vector<Entry>, LaterDeadline> heap_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::thread expiryThread_;
+    bool stop_ = false;
+
+    // Configuration (overridable via custom_config.storage in config.json)
+    std::chrono::seconds fileTtl_{3600}; // 1 hour
+};
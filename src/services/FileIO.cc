@@ -0,0 +1,419 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#include "FileIO.h"
+#include <drogon/drogon.h>
+#include <trantor/utils/Logger.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef KONVERTOR_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+namespace {
+
+const size_t WRITE_CHUNK = 1024 * 1024;
+
+std::error_code errnoCode(int err) {
+    return std::error_code(err, std::generic_category());
+}
+
+#ifdef KONVERTOR_HAVE_LIBURING
+const unsigned RING_ENTRIES = 64;
+
+// One ring per thread: uploads are written from several executor threads at
+// once and a ring must not be shared without locking.
+struct ThreadRing {
+    struct io_uring ring;
+    bool ready = false;
+    ThreadRing() { ready = io_uring_queue_init(RING_ENTRIES, &ring, 0) == 0; }
+    ~ThreadRing() { if (ready) io_uring_queue_exit(&ring); }
+
+    // Replaces the ring, dropping requests a failed batch left unsubmitted
+    void reset() {
+        if (ready) io_uring_queue_exit(&ring);
+        ready = io_uring_queue_init(RING_ENTRIES, &ring, 0) == 0;
+        if (!ready) LOG_WARN << "Cannot recreate io_uring ring, this thread uses plain syscalls";
+    }
+};
+
+ThreadRing* threadRing() {
+    thread_local ThreadRing local;
+    return local.ready ? &local : nullptr;
+}
+
+// Submits count requests in waves of at most RING_ENTRIES. prep(sqe, i)
+// fills request i and done(i, res) receives its result.
+//
+// Requests point at the caller's buffers, so a batch never returns while one
+// is in flight: after a failed submit, every request that did reach the kernel
+// is still reaped, and the ring is then recreated so that neither unsubmitted
+// requests nor stray completions carry over into the next batch on this thread.
+template <typename Prep, typename Done>
+bool runBatch(ThreadRing& local, size_t count, Prep prep, Done done) {
+    struct io_uring* ring = &local.ring;
+    for (size_t first = 0; first < count; first += RING_ENTRIES) {
+        size_t wave = std::min<size_t>(RING_ENTRIES, count - first);
+        for (size_t i = 0; i < wave; ++i) {
+            struct io_uring_sqe* sqe = io_uring_get_sqe(ring);
+            if (!sqe) {
+                // Nothing of this wave was submitted yet
+                local.reset();
+                return false;
+            }
+            prep(sqe, first + i);
+            io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(static_cast<uintptr_t>(first + i)));
+        }
+
+        size_t submitted = 0;
+        bool failed = false;
+        while (submitted < wave) {
+            int rc = io_uring_submit_and_wait(ring, static_cast<unsigned>(wave - submitted));
+            if (rc == -EINTR) continue;
+            if (rc <= 0) {
+                failed = true;
+                break;
+            }
+            submitted += static_cast<size_t>(rc);
+        }
+
+        for (size_t i = 0; i < submitted; ++i) {
+            struct io_uring_cqe* cqe = nullptr;
+            int rc;
+            while ((rc = io_uring_wait_cqe(ring, &cqe)) == -EINTR) {}
+            if (rc < 0) {
+                // Cannot happen with a valid ring; the requests left are
+                // cancelled when the ring is torn down
+                LOG_ERROR << "io_uring completion wait failed: " << errnoCode(-rc).message();
+                failed = true;
+                break;
+            }
+            done(static_cast<size_t>(reinterpret_cast<uintptr_t>(io_uring_cqe_get_data(cqe))), cqe->res);
+            io_uring_cqe_seen(ring, cqe);
+        }
+
+        if (failed) {
+            local.reset();
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+} // namespace
+
+FileIO::FileIO() {
+    // Optional override from config.json (custom_config.io)
+    auto config = drogon::app().getCustomConfig()["io"];
+    bool wanted = config.get("io_uring", true).asBool();
+
+#ifdef KONVERTOR_HAVE_LIBURING
+    // Runtime probe: the ring must be creatable (not blocked by seccomp) and
+    // the kernel must know every opcode used here (5.11+ for unlinkat).
+    if (wanted) {
+        ThreadRing* local = threadRing();
+        struct io_uring_probe* probe = local ? io_uring_get_probe_ring(&local->ring) : nullptr;
+        if (probe) {
+            uring_ = io_uring_opcode_supported(probe, IORING_OP_WRITE) &&
+                     io_uring_opcode_supported(probe, IORING_OP_SPLICE) &&
+                     io_uring_opcode_supported(probe, IORING_OP_STATX) &&
+                     io_uring_opcode_supported(probe, IORING_OP_UNLINKAT);
+            io_uring_free_probe(probe);
+        }
+    }
+#else
+    (void)wanted;
+#endif
+    LOG_INFO << "FileIO backend: " << backend();
+}
+
+bool FileIO::writeFile(const std::string& path, const char* data, size_t size, std::error_code& ec) {
+    ec.clear();
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        ec = errnoCode(errno);
+        return false;
+    }
+
+    bool ok = writeAt(fd, data, size, 0, ec);
+    if (::close(fd) != 0 && ok) {
+        ec = errnoCode(errno);
+        ok = false;
+    }
+    if (!ok) ::unlink(path.c_str());
+    return ok;
+}
+
+bool FileIO::writeAt(int fd, const char* data, size_t size, uint64_t offset, std::error_code& ec) {
+    ec.clear();
+    int err = 0;
+    bool queued = false; // Written through the ring
+#ifdef KONVERTOR_HAVE_LIBURING
+    ThreadRing* ring = uring_ ? threadRing() : nullptr;
+    if (ring) {
+        queued = true;
+        // Queue every chunk at its own offset; short writes are requeued for the remainder
+        struct Chunk { uint64_t offset; size_t length; };
+        std::vector<Chunk> pending;
+        for (uint64_t start = 0; start < size; start += WRITE_CHUNK) {
+            pending.push_back({start, std::min<size_t>(WRITE_CHUNK, size - start)});
+        }
+        while (!pending.empty() && err == 0) {
+            std::vector<Chunk> retry;
+            bool ok = runBatch(*ring, pending.size(),
+                [&](struct io_uring_sqe* sqe, size_t i) {
+                    io_uring_prep_write(sqe, fd, data + pending[i].offset,
+                                        static_cast<unsigned>(pending[i].length), offset + pending[i].offset);
+                },
+                [&](size_t i, int res) {
+                    if (res < 0) {
+                        if (res != -EINTR && res != -EAGAIN) err = -res;
+                        else retry.push_back(pending[i]);
+                    } else if (res == 0) {
+                        err = EIO;
+                    } else if (static_cast<size_t>(res) < pending[i].length) {
+                        retry.push_back({pending[i].offset + res, pending[i].length - res});
+                    }
+                });
+            if (!ok && err == 0) {
+                // The ring failed, not the disk: write the whole buffer again without it
+                queued = false;
+                break;
+            }
+            pending.swap(retry);
+        }
+    }
+#endif
+    if (!queued && err == 0) {
+        size_t written = 0;
+        while (written < size) {
+            ssize_t n = ::pwrite(fd, data + written, std::min(WRITE_CHUNK, size - written),
+                                 static_cast<off_t>(offset + written));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                err = errno;
+                break;
+            }
+            if (n == 0) {
+                err = EIO;
+                break;
+            }
+            written += static_cast<size_t>(n);
+        }
+    }
+
+    if (err != 0) {
+        ec = errnoCode(err);
+        return false;
+    }
+    return true;
+}
+
+bool FileIO::moveFile(const std::string& from, const std::string& to, std::error_code& ec) {
+    ec.clear();
+    // Same filesystem: a plain rename, no data is copied
+    if (std::rename(from.c_str(), to.c_str()) == 0) return true;
+    if (errno != EXDEV) {
+        ec = errnoCode(errno);
+        return false;
+    }
+
+    // Different filesystems (scratch tier -> downloads): copy, then drop the source
+    int in = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        ec = errnoCode(errno);
+        return false;
+    }
+    struct stat st;
+    int out = -1;
+    if (fstat(in, &st) != 0 ||
+        (out = ::open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+        ec = errnoCode(errno);
+        ::close(in);
+        return false;
+    }
+
+    bool copied = copyAcross(in, out, static_cast<uint64_t>(st.st_size), ec);
+    ::close(in);
+    if (::close(out) != 0 && copied) {
+        ec = errnoCode(errno);
+        copied = false;
+    }
+    if (!copied) {
+        ::unlink(to.c_str());
+        return false;
+    }
+
+    if (::unlink(from.c_str()) != 0) {
+        LOG_WARN << "Copied " << from << " but could not remove it: " << errnoCode(errno).message();
+    }
+    return true;
+}
+
+bool FileIO::copyAcross(int in, int out, uint64_t size, std::error_code& ec) {
+    uint64_t done = 0;
+
+    // copy_file_range copies inside the kernel; some kernels refuse it across
+    // filesystem types (EXDEV), in which case fall through.
+    while (done < size) {
+        loff_t inOffset = static_cast<loff_t>(done), outOffset = static_cast<loff_t>(done);
+        ssize_t n = copy_file_range(in, &inOffset, out, &outOffset, size - done, 0);
+        if (n > 0) {
+            done += static_cast<uint64_t>(n);
+            continue;
+        }
+        if (n == 0) {
+            ec = errnoCode(EIO); // Source shrank while copying
+            return false;
+        }
+        if (errno == EINTR) continue;
+        if (errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP) {
+            ec = errnoCode(errno);
+            return false;
+        }
+        break;
+    }
+    if (done == size) return true;
+
+#ifdef KONVERTOR_HAVE_LIBURING
+    ThreadRing* ring = uring_ ? threadRing() : nullptr;
+    int pipeFds[2];
+    if (ring && pipe2(pipeFds, O_CLOEXEC) == 0) {
+        // file -> pipe -> file as a linked pair of splices per round trip
+        int pipeSize = fcntl(pipeFds[1], F_SETPIPE_SZ, 1024 * 1024);
+        size_t chunk = pipeSize > 0 ? static_cast<size_t>(pipeSize) : 64 * 1024;
+        int err = 0;
+        bool ringFailed = false;
+        while (done < size && err == 0) {
+            unsigned length = static_cast<unsigned>(std::min<uint64_t>(chunk, size - done));
+            int filled = 0, drained = 0;
+            bool ok = runBatch(*ring, 2,
+                [&](struct io_uring_sqe* sqe, size_t i) {
+                    if (i == 0) {
+                        io_uring_prep_splice(sqe, in, static_cast<int64_t>(done), pipeFds[1], -1, length, 0);
+                        io_uring_sqe_set_flags(sqe, IOSQE_IO_LINK);
+                    } else {
+                        io_uring_prep_splice(sqe, pipeFds[0], -1, out, static_cast<int64_t>(done), length, 0);
+                    }
+                },
+                [&](size_t i, int res) { (i == 0 ? filled : drained) = res; });
+            if (!ok) {
+                // Everything before done has been copied; sendfile() takes over from there
+                ringFailed = true;
+                break;
+            }
+            if (filled < 0) {
+                err = -filled;
+                break;
+            }
+            if (filled == 0) {
+                err = EIO;
+                break;
+            }
+            // A short first splice cancels or shortens the second; drain the rest of the pipe here
+            int64_t flushed = drained > 0 ? drained : 0;
+            while (flushed < filled) {
+                loff_t outOffset = static_cast<loff_t>(done + flushed);
+                ssize_t n = splice(pipeFds[0], nullptr, out, &outOffset, filled - flushed, 0);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) {
+                    err = n < 0 ? errno : EIO;
+                    break;
+                }
+                flushed += n;
+            }
+            done += static_cast<uint64_t>(filled);
+        }
+        ::close(pipeFds[0]);
+        ::close(pipeFds[1]);
+        if (err != 0) {
+            ec = errnoCode(err);
+            return false;
+        }
+        if (!ringFailed) return true;
+    }
+#endif
+
+    // Portable path: sendfile() also copies without a user-space buffer
+    while (done < size) {
+        off_t offset = static_cast<off_t>(done);
+        if (lseek(out, offset, SEEK_SET) < 0) {
+            ec = errnoCode(errno);
+            return false;
+        }
+        ssize_t n = sendfile(out, in, &offset, size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            ec = errnoCode(n < 0 ? errno : EIO);
+            return false;
+        }
+        done += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+std::vector<int64_t> FileIO::fileSizes(const std::vector<std::string>& paths) {
+    std::vector<int64_t> sizes(paths.size(), -1);
+    if (paths.empty()) return sizes;
+
+#ifdef KONVERTOR_HAVE_LIBURING
+    ThreadRing* ring = uring_ ? threadRing() : nullptr;
+    if (ring) {
+        std::vector<struct statx> results(paths.size());
+        bool ok = runBatch(*ring, paths.size(),
+            [&](struct io_uring_sqe* sqe, size_t i) {
+                io_uring_prep_statx(sqe, AT_FDCWD, paths[i].c_str(), 0, STATX_SIZE | STATX_TYPE, &results[i]);
+            },
+            [&](size_t i, int res) {
+                if (res == 0 && S_ISREG(results[i].stx_mode)) {
+                    sizes[i] = static_cast<int64_t>(results[i].stx_size);
+                }
+            });
+        if (ok) return sizes;
+    }
+#endif
+
+    for (size_t i = 0; i < paths.size(); ++i) {
+        struct stat st;
+        if (::stat(paths[i].c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+            sizes[i] = static_cast<int64_t>(st.st_size);
+        }
+    }
+    return sizes;
+}
+
+std::vector<int> FileIO::removeFiles(const std::vector<std::string>& paths) {
+    std::vector<int> errors(paths.size(), 0);
+    if (paths.empty()) return errors;
+
+#ifdef KONVERTOR_HAVE_LIBURING
+    ThreadRing* ring = uring_ ? threadRing() : nullptr;
+    if (ring) {
+        std::fill(errors.begin(), errors.end(), EIO); // Overwritten by each completion
+        bool ok = runBatch(*ring, paths.size(),
+            [&](struct io_uring_sqe* sqe, size_t i) {
+                io_uring_prep_unlinkat(sqe, AT_FDCWD, paths[i].c_str(), 0);
+            },
+            [&](size_t i, int res) { errors[i] = res < 0 ? -res : 0; });
+        if (ok) return errors;
+    }
+#endif
+
+    for (size_t i = 0; i < paths.size(); ++i) {
+        errors[i] = ::unlink(paths[i].c_str()) == 0 ? 0 : errno;
+    }
+    return errors;
+}
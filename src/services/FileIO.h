@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <system_error>
+
+/**
+ * @class FileIO
+ * @brief File operations on the upload, output and cleanup paths, with an optional io_uring backend.
+ *
+ * When the binary is built with liburing (KONVERTOR_HAVE_LIBURING) and the
+ * kernel supports the needed opcodes, FileIO does the following:
+ * - writes uploads as a batch of queued writes;
+ * - copies across filesystems with linked splice requests;
+ * - stats and unlinks a batch of files with a single submission.
+ * Each thread that uses FileIO gets its own ring, because rings are not thread-safe.
+ *
+ * Without io_uring (no liburing, an old kernel, a seccomp-restricted
+ * container, or `io.io_uring` set to false), the same calls use plain
+ * syscalls. Cross-filesystem copies always try `copy_file_range` first.
+ */
+class FileIO {
+public:
+    static FileIO& instance() {
+        static FileIO inst;
+        return inst;
+    }
+
+    FileIO(const FileIO&) = delete;
+    FileIO& operator=(const FileIO&) = delete;
+
+    /**
+     * @brief Name of the active backend ("io_uring" or "sync"), for stats.
+     */
+    const char* backend() const { return uring_ ? "io_uring" : "sync"; }
+
+    /**
+     * @brief Writes a buffer to a new file (replacing any existing one).
+     * @return true on success; ec describes the failure otherwise.
+     */
+    bool writeFile(const std::string& path, const char* data, size_t size, std::error_code& ec);
+
+    /**
+     * @brief Writes a buffer at an offset of an open file, e.g. the next piece of a streamed upload.
+     * @return true on success; ec describes the failure otherwise.
+     */
+    bool writeAt(int fd, const char* data, size_t size, uint64_t offset, std::error_code& ec);
+
+    /**
+     * @brief Moves a finished file to its final location.
+     *
+     * Uses rename() when source and destination share a filesystem and copies
+     * in the kernel, then unlinks the source, only when they do not (e.g. tmpfs -> disk).
+     * @return true on success; ec describes the failure otherwise.
+     */
+    bool moveFile(const std::string& from, const std::string& to, std::error_code& ec);
+
+    /**
+     * @brief Sizes of several files in one batch.
+     * @return One entry per path, -1 where the file cannot be stat-ed.
+     */
+    std::vector<int64_t> fileSizes(const std::vector<std::string>& paths);
+
+    /**
+     * @brief Unlinks several files in one batch.
+     * @return One entry per path: 0 if removed, otherwise the errno (ENOENT if already gone).
+     */
+    std::vector<int> removeFiles(const std::vector<std::string>& paths);
+
+private:
+    FileIO();
+    ~FileIO() = default;
+
+    // Copies from one descriptor to another on a different filesystem
+    bool copyAcross(int in, int out, uint64_t size, std::error_code& ec);
+
+    bool uring_ = false;
+};
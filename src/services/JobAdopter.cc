@@ -0,0 +1,357 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#include "JobAdopter.h"
+#include "ConversionManager.h"
+#include "BatchRegistry.h"
+#include "ProgressTracker.h"
+#include "OutputStreamer.h"
+#include "StorageManager.h"
+#include "ProcessRunner.h"
+#include "MediaProbe.h"
+#include "FileIO.h"
+#include <trantor/utils/Logger.h>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+// Largest message the predecessor sends: one batch of up to batch.max_items items
+static const size_t MAX_MESSAGE_BYTES = 1024 * 1024;
+
+JobAdopter::~JobAdopter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        // Wakes the reader if the predecessor is still draining
+        if (channel_ >= 0) shutdown(channel_, SHUT_RDWR);
+    }
+    if (reader_.joinable()) reader_.join();
+    if (watcher_.joinable()) watcher_.join();
+    for (auto& running : running_) {
+        if (running.pidFd >= 0) close(running.pidFd);
+        if (running.stdoutFd >= 0) close(running.stdoutFd);
+    }
+}
+
+void JobAdopter::start(int channel) {
+    channel_ = channel;
+    receiving_ = true;
+    reader_ = std::thread(&JobAdopter::readLoop, this);
+}
+
+bool JobAdopter::busy() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return receiving_ || !running_.empty();
+}
+
+void JobAdopter::readLoop() {
+    std::vector<char> buffer(MAX_MESSAGE_BYTES);
+    size_t batches = 0, tasks = 0;
+    while (true) {
+        struct iovec iov = {buffer.data(), buffer.size()};
+        char control[CMSG_SPACE(sizeof(int))];
+        struct msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t n = recvmsg(channel_, &msg, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break; // The predecessor has sent everything and exited
+
+        // A running command's progress pipe
+        int fd = -1;
+        for (struct cmsghdr* header = CMSG_FIRSTHDR(&msg); header; header = CMSG_NXTHDR(&msg, header)) {
+            if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+                memcpy(&fd, CMSG_DATA(header), sizeof(int));
+            }
+        }
+
+        Json::Value message;
+        Json::Reader reader;
+        if ((msg.msg_flags & MSG_TRUNC) || !reader.parse(buffer.data(), buffer.data() + n, message)) {
+            LOG_ERROR << "Skipping unreadable hand-off message (" << n << " bytes)";
+            if (fd >= 0) close(fd);
+            continue;
+        }
+
+        std::string type = message["type"].asString();
+        if (type == "batch") {
+            Json::Value restored;
+            restored[message["id"].asString()] = message["batch"];
+            BatchRegistry::instance().restore(restored);
+            ++batches;
+        } else if (type == "task") {
+            adopt(message, fd);
+            ++tasks;
+        } else if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        close(channel_);
+        channel_ = -1;
+        receiving_ = false;
+    }
+    // Register files the predecessor created after this process scanned storage at startup
+    StorageManager::instance().recover({"./uploads/", "./www/downloads/"});
+    LOG_INFO << "Took over " << batches << " batches and " << tasks << " tasks from the previous process";
+}
+
+void JobAdopter::adopt(const Json::Value& task, int stdoutFd) {
+    const Json::Value& handoff = task["handoff"];
+    if (!handoff.isObject()) {
+        if (stdoutFd >= 0) close(stdoutFd);
+        return;
+    }
+
+    auto trace = JobTrace::instance().begin("adopted");
+    if (trace) {
+        trace->jobId = handoff["job_id"].asString();
+        trace->format = handoff["format"].asString();
+        trace->mediaSeconds = task["media_seconds"].asDouble();
+    }
+    if (handoff.isMember("batch_id")) {
+        BatchRegistry::instance().itemResumed(handoff["batch_id"].asString(), handoff["batch_index"].asUInt64());
+    }
+    std::string streamId = handoff["stream_id"].asString();
+    if (!streamId.empty()) {
+        OutputStreamer::instance().open(streamId, handoff["output"].asString(), handoff["format"].asString());
+    }
+
+    // Its scratch files are still in RAM; the lease returns the budget once it is published
+    auto scratch = ScratchSpace::instance().adopt(handoff["scratch_bytes"].asUInt64());
+
+    if (task["state"].asString() != "running") {
+        if (stdoutFd >= 0) close(stdoutFd);
+        enqueue(task, false, trace, scratch);
+        return;
+    }
+
+    Running running;
+    running.task = task;
+    running.scratch = scratch;
+    running.pid = task["pid"].asInt();
+    running.startTime = task["start_time"].asUInt64();
+    running.stdoutFd = stdoutFd;
+    running.trace = trace;
+    if (trace) trace->markStarted();
+
+    // The start time tells the command apart from a later process reusing its pid
+    bool alive = running.pid > 0 && running.startTime != 0 &&
+                 ProcessRunner::startTime(running.pid) == running.startTime;
+#ifdef SYS_pidfd_open
+    if (alive) {
+        running.pidFd = static_cast<int>(syscall(SYS_pidfd_open, running.pid, 0));
+        // The pid may have been reused before the pidfd was opened
+        if (running.pidFd >= 0 && ProcessRunner::startTime(running.pid) != running.startTime) {
+            close(running.pidFd);
+            running.pidFd = -1;
+            alive = false;
+        }
+    }
+#endif
+    if (running.stdoutFd >= 0) {
+        fcntl(running.stdoutFd, F_SETFL, fcntl(running.stdoutFd, F_GETFL) | O_NONBLOCK);
+    }
+
+    std::string progressId = task["progress_id"].asString();
+    if (!progressId.empty()) {
+        ProgressTracker::instance().start(progressId, task["media_seconds"].asDouble());
+        ProgressTracker::instance().update(progressId, 0);
+    }
+
+    if (!alive) {
+        // Finished between the hand-off and now
+        finishRunning(std::move(running));
+        return;
+    }
+
+    LOG_INFO << "Adopted running command " << running.pid << " writing " << handoff["output"].asString();
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_.push_back(std::move(running));
+    if (!watcher_.joinable()) watcher_ = std::thread(&JobAdopter::watchLoop, this);
+}
+
+void JobAdopter::enqueue(const Json::Value& task, bool fallback, const JobTracePtr& trace,
+                         const ScratchSpace::LeasePtr& scratch) {
+    const Json::Value& handoff = task["handoff"];
+    ConversionTask conversion;
+    for (const auto& arg : task[fallback ? "fallback_args" : "args"]) conversion.args.push_back(arg.asString());
+    if (!fallback) {
+        for (const auto& arg : task["fallback_args"]) conversion.fallbackArgs.push_back(arg.asString());
+    }
+    conversion.inputFilename = handoff["input"].asString();
+    conversion.outputFilename = handoff["output"].asString();
+    conversion.mediaSeconds = task["media_seconds"].asDouble();
+    conversion.cost = task.get("cost", 1.0).asDouble();
+    conversion.progressId = task["progress_id"].asString();
+    conversion.remoteAllowed = task["remote_allowed"].asBool();
+    conversion.trace = trace;
+    conversion.handoff = handoff; // Can be handed on again by another restart
+    conversion.callback = [task, trace, scratch](bool success) { publish(task, success, trace); };
+    ConversionManager::instance().addTask(std::move(conversion));
+}
+
+void JobAdopter::watchLoop() {
+    while (true) {
+        // Entries are only appended while unlocked, so the first pollFds.size() / 2
+        // entries are the ones polled
+        std::vector<struct pollfd> pollFds;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stop_) return;
+            for (const auto& running : running_) {
+                // poll() ignores negative descriptors
+                pollFds.push_back({running.pidFd, POLLIN, 0});
+                pollFds.push_back({running.stdoutFd, POLLIN, 0});
+            }
+        }
+        if (pollFds.empty() || poll(pollFds.data(), pollFds.size(), 500) < 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        }
+
+        std::vector<Running> finished;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::vector<Running> stillRunning;
+            for (size_t i = 0; i < running_.size(); ++i) {
+                Running& running = running_[i];
+                short events = 2 * i < pollFds.size() ? pollFds[2 * i].revents : 0;
+                readProgress(running);
+                if (exited(running, events)) {
+                    finished.push_back(std::move(running));
+                } else {
+                    stillRunning.push_back(std::move(running));
+                }
+            }
+            running_.swap(stillRunning);
+        }
+        for (auto& running : finished) finishRunning(std::move(running));
+    }
+}
+
+void JobAdopter::readProgress(Running& running) {
+    if (running.stdoutFd < 0) return;
+    std::string progressId = running.task["progress_id"].asString();
+    char buf[4096];
+    while (true) {
+        ssize_t n = read(running.stdoutFd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n == 0) {
+            close(running.stdoutFd);
+            running.stdoutFd = -1;
+        }
+        if (n <= 0) return; // EOF, or nothing more for now
+
+        running.pending.append(buf, static_cast<size_t>(n));
+        size_t start = 0, nl;
+        while ((nl = running.pending.find('\n', start)) != std::string::npos) {
+            // Same format as ConversionManager's worker reads (-progress pipe:1)
+            if (running.pending.compare(start, 12, "out_time_us=") == 0) {
+                double processed = std::atof(running.pending.c_str() + start + 12) / 1e6;
+                ProgressTracker::instance().update(progressId, processed);
+            }
+            start = nl + 1;
+        }
+        running.pending.erase(0, start);
+    }
+}
+
+bool JobAdopter::exited(const Running& running, short pidFdEvents) {
+    if (running.pidFd >= 0) return pidFdEvents & POLLIN;
+    return kill(running.pid, 0) != 0 || ProcessRunner::startTime(running.pid) != running.startTime;
+}
+
+void JobAdopter::finishRunning(Running running) {
+    if (running.pidFd >= 0) close(running.pidFd);
+    if (running.stdoutFd >= 0) {
+        readProgress(running);
+        if (running.stdoutFd >= 0) close(running.stdoutFd);
+    }
+
+    // The exit status went to the predecessor (or init), so judge by the output
+    const Json::Value& task = running.task;
+    std::string output = task["handoff"]["output"].asString();
+    bool success = outputComplete(output, task["media_seconds"].asDouble());
+    if (!success && !task["fallback_args"].empty()) {
+        LOG_WARN << "Adopted command for " << output << " failed, running fallback";
+        enqueue(task, true, running.trace, running.scratch);
+        return;
+    }
+
+    LOG_INFO << "Adopted command for " << output << (success ? " finished" : " failed");
+    if (running.trace) running.trace->markFinished(success ? 0 : -1, 0);
+    std::string progressId = task["progress_id"].asString();
+    if (!progressId.empty()) ProgressTracker::instance().finish(progressId, success);
+    publish(task, success, running.trace);
+}
+
+bool JobAdopter::outputComplete(const std::string& path, double mediaSeconds) {
+    std::error_code ec;
+    auto bytes = std::filesystem::file_size(path, ec);
+    if (ec || bytes == 0) return false;
+    if (mediaSeconds <= 0) return true;
+
+    // A command killed halfway leaves a valid but short file
+    MediaInfo info;
+    MediaProbe::Status status = MediaProbe::probe(path, info);
+    if (status == MediaProbe::Status::Unavailable) return true; // Cannot tell; trust a non-empty file
+    return status == MediaProbe::Status::Ok && info.durationSeconds >= mediaSeconds * 0.95;
+}
+
+void JobAdopter::publish(const Json::Value& task, bool success, const JobTracePtr& trace) {
+    const Json::Value& handoff = task["handoff"];
+    std::string output = handoff["output"].asString();
+    std::string publicPath = handoff["publish"].asString();
+    std::string downloadUrl = handoff["download_url"].asString();
+    std::string streamId = handoff["stream_id"].asString();
+    std::string batchId = handoff["batch_id"].asString();
+    size_t batchIndex = handoff["batch_index"].asUInt64();
+
+    StorageManager::instance().remove(handoff["input"].asString());
+    std::error_code ec;
+    if (success && !FileIO::instance().moveFile(output, publicPath, ec)) {
+        LOG_ERROR << "File operation failed: " << ec.message();
+        success = false;
+    }
+    if (!success) {
+        if (trace) trace->error = "Conversion failed";
+        StorageManager::instance().remove(output);
+        OutputStreamer::instance().finish(streamId, false, "", "");
+        if (!batchId.empty()) {
+            BatchRegistry::instance().itemFinished(batchId, batchIndex, false, "", "Conversion failed");
+        }
+        return;
+    }
+
+    // The output may have been registered as an upload by StorageManager::recover()
+    StorageManager::instance().release(output);
+    StorageManager::instance().add(publicPath, handoff["client_ip"].asString());
+    if (trace) {
+        auto bytes = std::filesystem::file_size(publicPath, ec);
+        trace->moved = JobTrace::now();
+        trace->outputBytes = ec ? 0 : bytes;
+        trace->success = true;
+    }
+    ProgressTracker::instance().setDownloadUrl(task["progress_id"].asString(), downloadUrl);
+    OutputStreamer::instance().finish(streamId, true, publicPath, downloadUrl);
+    if (!batchId.empty()) {
+        BatchRegistry::instance().itemFinished(batchId, batchIndex, true, downloadUrl, "");
+    }
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include "JobTrace.h"
+#include "ScratchSpace.h"
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <json/json.h>
+
+/**
+ * @class JobAdopter
+ * @brief Takes over the work of the process this one replaced (see Lifecycle).
+ *
+ * The predecessor sends one JSON message per entry over the hand-off socket,
+ * then closes it and exits:
+ *
+ *   {"type":"batch","id":id,"batch":{...}}        BatchRegistry::snapshot() entry
+ *   {"type":"task","state":"queued",...}          Task that had not started
+ *   {"type":"task","state":"running","pid":n,...} Command still running
+ *
+ * Queued tasks go back into ConversionManager. Running commands cannot be
+ * waited for (they are not children of this process), so they are watched
+ * through a pidfd, or by polling the pid and its start time, and their
+ * ffmpeg progress is read from the pipe passed along with the entry. Whether
+ * one succeeded is judged from its output: a non-empty file whose probed
+ * duration covers the job. A failed remux is retried with its fallback command.
+ *
+ * Finished jobs are published as the predecessor would have: the output moves
+ * to `./www/downloads/` and its URL is reported to ProgressTracker,
+ * OutputStreamer and BatchRegistry, so clients whose request was cut off by
+ * the restart can still fetch it.
+ */
+class JobAdopter {
+public:
+    static JobAdopter& instance() {
+        static JobAdopter inst;
+        return inst;
+    }
+
+    JobAdopter(const JobAdopter&) = delete;
+    JobAdopter& operator=(const JobAdopter&) = delete;
+
+    /**
+     * @brief Reads the predecessor's messages from channel on a background
+     *        thread until it closes the socket. Takes ownership of channel.
+     */
+    void start(int channel);
+
+    // The predecessor is still sending
+    bool receiving() const { return receiving_; }
+    // Still receiving, or watching adopted commands
+    bool busy();
+
+private:
+    JobAdopter() = default;
+    ~JobAdopter();
+
+    // A command started by the predecessor
+    struct Running {
+        Json::Value task;
+        int pid = 0;
+        uint64_t startTime = 0;
+        int pidFd = -1;    // -1 without pidfd_open(); the pid is polled instead
+        int stdoutFd = -1; // Progress pipe, -1 if the task reports no progress
+        std::string pending; // Incomplete progress line
+        JobTracePtr trace;
+        ScratchSpace::LeasePtr scratch; // Held until the job is published
+    };
+
+    void readLoop();
+    void adopt(const Json::Value& task, int stdoutFd);
+    // Queues a task in ConversionManager, or with fallback set the fallback command of a failed one
+    static void enqueue(const Json::Value& task, bool fallback, const JobTracePtr& trace,
+                        const ScratchSpace::LeasePtr& scratch);
+    void watchLoop();
+    // Reports the progress lines ffmpeg has written so far; closes the pipe at EOF
+    static void readProgress(Running& running);
+    static bool exited(const Running& running, short pidFdEvents);
+    // Judges and publishes a command that exited
+    static void finishRunning(Running running);
+    static bool outputComplete(const std::string& path, double mediaSeconds);
+    // Moves the output into place (or removes it) and notifies the services
+    static void publish(const Json::Value& task, bool success, const JobTracePtr& trace);
+
+    int channel_ = -1;
+    std::atomic<bool> receiving_{false};
+    std::thread reader_;
+    std::thread watcher_;
+    std::mutex mutex_;
+    std::vector<Running> running_; // Guarded by mutex_
+    bool stop_ = false; // Guarded by mutex_
+};
@@ -0,0 +1,387 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#include "JobDispatcher.h"
+#include "DispatchConnection.h"
+#include "ProgressTracker.h"
+#include <drogon/drogon.h>
+#include <trantor/utils/Logger.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <vector>
+
+// Compares a worker's token without letting the reply time reveal how much of it matched
+static bool sameToken(const std::string& given, const std::string& expected) {
+    unsigned char diff = given.size() != expected.size();
+    for (size_t i = 0; i < given.size(); ++i) {
+        diff |= static_cast<unsigned char>(given[i] ^ (i < expected.size() ? expected[i] : 0));
+    }
+    return diff == 0;
+}
+
+JobDispatcher::JobDispatcher() {
+    // Constructed first so it outlives the dispatcher threads that call into it
+    ConversionManager::instance();
+
+    // Optional remote executor, configured in config.json (custom_config.remote)
+    auto config = drogon::app().getCustomConfig()["remote"];
+    if (!config.get("enabled", false).asBool()) return;
+
+    leaseDuration_ = std::chrono::seconds(std::max<Json::Int64>(5, config.get("lease_seconds", (Json::Int64)leaseDuration_.count()).asInt64()));
+    address_ = config.get("listen", "unix:/tmp/konvertor-dispatch.sock").asString();
+    token_ = config.get("token", "").asString();
+    bool tcp = address_.rfind("unix:", 0) != 0;
+    if (tcp && token_.empty()) {
+        // Any peer could lease jobs and read users' uploads
+        LOG_ERROR << "Remote workers disabled: listening on TCP (" << address_ << ") needs remote.token";
+        return;
+    }
+    listenFd_ = DispatchConnection::listenOn(address_);
+    if (listenFd_ < 0) {
+        if (!tcp || errno != EADDRINUSE) {
+            LOG_ERROR << "Remote workers disabled: cannot listen on " << address_;
+            return;
+        }
+        // The process this one replaces in a restart still holds the port until it exits
+        LOG_WARN << "Dispatch port " << address_ << " is in use, retrying until it is free";
+    }
+    if (token_.empty()) LOG_WARN << "remote.token is not set: any process of this user can connect as a worker";
+
+    enabled_ = true;
+    acceptThread_ = std::thread(&JobDispatcher::acceptLoop, this);
+    reapThread_ = std::thread(&JobDispatcher::reapLoop, this);
+    LOG_INFO << "JobDispatcher on " << address_ << ", lease " << leaseDuration_.count() << "s";
+}
+
+JobDispatcher::~JobDispatcher() {
+    if (!enabled_) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    condition_.notify_all();
+    if (acceptThread_.joinable()) acceptThread_.join();
+    if (reapThread_.joinable()) reapThread_.join();
+
+    // Wake connection threads blocked on their sockets and wait for them to exit
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (auto& [connection, conn] : connections_) {
+        if (conn) conn->shutdown();
+    }
+    condition_.wait(lock, [this] { return connections_.empty(); });
+    if (listenFd_ >= 0) close(listenFd_);
+}
+
+size_t JobDispatcher::connectedWorkers() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return workers_.size();
+}
+
+size_t JobDispatcher::activeLeases() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return leases_.size();
+}
+
+void JobDispatcher::acceptLoop() {
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stop_) return;
+        }
+        if (listenFd_ < 0) {
+            listenFd_ = DispatchConnection::listenOn(address_);
+            if (listenFd_ < 0) {
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+                continue;
+            }
+            LOG_INFO << "JobDispatcher listening on " << address_;
+        }
+        struct pollfd pfd = {listenFd_, POLLIN, 0};
+        if (poll(&pfd, 1, 500) <= 0) continue;
+
+        int fd = accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+
+        // Blocking transfers to a stalled worker give up instead of pinning the thread
+        struct timeval timeout = {static_cast<time_t>(leaseDuration_.count()), 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        uint64_t connection;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            connection = ++nextConnection_;
+            connections_[connection] = nullptr;
+        }
+        // One thread per worker: jobs are long and workers are few
+        std::thread(&JobDispatcher::serve, this, fd, connection).detach();
+    }
+}
+
+void JobDispatcher::reapLoop() {
+    while (true) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait_for(lock, std::chrono::seconds(1), [this] { return stop_; });
+        if (stop_) return;
+
+        // Expired leases stay put until the old worker lets go, so two ffmpegs never share an output
+        auto now = std::chrono::steady_clock::now();
+        for (auto& [leaseId, lease] : leases_) {
+            if (lease.deadline > now) continue;
+            if (!lease.expired) {
+                LOG_WARN << "Lease " << leaseId << " expired, revoking " << lease.task.outputFilename;
+                lease.expired = true;
+                lease.deadline = now + leaseDuration_;
+                continue;
+            }
+            // Still silent: drop the worker, whose connection thread then requeues the task
+            LOG_WARN << "Worker holding expired lease " << leaseId << " is unresponsive, disconnecting";
+            lease.deadline = std::chrono::steady_clock::time_point::max();
+            auto conn = connections_.find(lease.connection);
+            if (conn != connections_.end() && conn->second) conn->second->shutdown();
+        }
+    }
+}
+
+bool JobDispatcher::release(uint64_t leaseId, uint64_t connection, ConversionTask& task, bool* expired) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = leases_.find(leaseId);
+    if (it == leases_.end() || it->second.connection != connection) return false;
+    task = std::move(it->second.task);
+    if (expired) *expired = it->second.expired;
+    leases_.erase(it);
+    return true;
+}
+
+bool JobDispatcher::sendJob(DispatchConnection& conn, uint64_t leaseId, const ConversionTask& task, bool sharedPath) {
+    Json::Value job;
+    job["type"] = "job";
+    job["lease"] = (Json::UInt64)leaseId;
+    job["input"] = task.inputFilename;
+    job["output"] = task.outputFilename;
+    job["media_seconds"] = task.mediaSeconds;
+    job["progress"] = !task.progressId.empty();
+    for (const auto& arg : task.args) job["args"].append(arg);
+    for (const auto& arg : task.fallbackArgs) job["fallback_args"].append(arg);
+    for (const auto& command : task.followUpArgs) {
+        Json::Value args(Json::arrayValue);
+        for (const auto& arg : command) args.append(arg);
+        job["follow_up_args"].append(args);
+    }
+    if (sharedPath) {
+        job["transfer"] = "shared";
+        return conn.send(job);
+    }
+
+    struct stat st;
+    if (stat(task.inputFilename.c_str(), &st) != 0) return false;
+    job["transfer"] = "inline";
+    job["input_bytes"] = (Json::UInt64)st.st_size;
+    return conn.send(job) && conn.sendFile(task.inputFilename, static_cast<uint64_t>(st.st_size));
+}
+
+void JobDispatcher::serve(int fd, uint64_t connection) {
+    DispatchConnection conn(fd);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections_[connection] = &conn;
+    }
+
+    Json::Value message;
+    bool sharedPath = false;
+    std::string name;
+    if (conn.receive(message, 10000) && message["type"].asString() == "hello" &&
+        sameToken(message.get("token", "").asString(), token_)) {
+        name = message.get("worker", "unnamed").asString();
+        sharedPath = message.get("shared_path", false).asBool();
+
+        Json::Value welcome;
+        welcome["type"] = "welcome";
+        welcome["lease_seconds"] = (Json::Int64)leaseDuration_.count();
+        if (conn.send(welcome)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            workers_.insert(connection);
+            ConversionManager::instance().setRemoteWorkers(workers_.size());
+        }
+    }
+
+    bool registered;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        registered = workers_.count(connection) > 0;
+    }
+    if (registered) {
+        LOG_INFO << "Remote worker " << name << " connected (" << (sharedPath ? "shared path" : "inline transfer") << ")";
+    } else {
+        LOG_WARN << "Rejected a dispatch connection without a valid hello";
+    }
+
+    // Expired leases this worker was told it lost; its next message means the job is dead
+    std::vector<uint64_t> lost;
+    while (registered) {
+        bool timedOut = false;
+        if (!conn.receive(message, 1000, &timedOut)) {
+            if (!timedOut) break;
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stop_) break;
+            continue;
+        }
+
+        for (uint64_t leaseId : lost) {
+            ConversionTask task;
+            if (!release(leaseId, connection, task)) continue;
+            LOG_WARN << "Requeueing " << task.outputFilename << " after " << name << " dropped lease " << leaseId;
+            ConversionManager::instance().requeueRemoteTask(std::move(task));
+        }
+        lost.clear();
+
+        std::string type = message["type"].asString();
+        uint64_t leaseId = message.get("lease", 0).asUInt64();
+        Json::Value reply;
+
+        if (type == "pull") {
+            // Long poll: hold the request until a task qualifies
+            ConversionTask task;
+            if (!ConversionManager::instance().takeRemoteTask(sharedPath, task, std::chrono::seconds(5))) {
+                reply["type"] = "idle";
+                if (!conn.send(reply)) break;
+                continue;
+            }
+            if (task.onStart) task.onStart();
+            if (task.trace) {
+                task.trace->remote = true;
+                task.trace->markStarted();
+            }
+
+            uint64_t id;
+            ConversionTask* leased;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                id = ++nextLease_;
+                Lease& lease = leases_[id];
+                lease.task = std::move(task);
+                lease.connection = connection;
+                // Not renewable until the job is sent, so the first deadline covers the input transfer
+                lease.deadline = std::chrono::steady_clock::time_point::max();
+                leased = &lease.task;
+            }
+            LOG_INFO << "Leased " << leased->outputFilename << " to " << name << " (lease " << id << ")";
+            if (!sendJob(conn, id, *leased, sharedPath)) break;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto it = leases_.find(id);
+                if (it != leases_.end()) it->second.deadline = std::chrono::steady_clock::now() + leaseDuration_;
+            }
+            continue;
+        }
+
+        if (type == "heartbeat") {
+            std::string progressId;
+            size_t progressPart = 0;
+            bool held = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto it = leases_.find(leaseId);
+                if (it != leases_.end() && it->second.connection == connection) {
+                    // An expired lease gets one more period for the worker to kill its job
+                    it->second.deadline = std::chrono::steady_clock::now() + leaseDuration_;
+                    held = !it->second.expired;
+                    if (!held) lost.push_back(leaseId);
+                    progressId = it->second.task.progressId;
+                    progressPart = it->second.task.progressPart;
+                }
+            }
+            if (held && !progressId.empty() && message.isMember("processed")) {
+                ProgressTracker::instance().update(progressId, message["processed"].asDouble(), progressPart);
+            }
+            reply["type"] = held ? "ok" : "lost";
+            if (!conn.send(reply)) break;
+            continue;
+        }
+
+        if (type == "done") {
+            bool success = message.get("success", false).asBool();
+            std::string outputFilename;
+            bool held = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto it = leases_.find(leaseId);
+                if (it != leases_.end() && it->second.connection == connection && !it->second.expired) {
+                    held = true;
+                    // The output transfer below has no heartbeats
+                    it->second.deadline = std::chrono::steady_clock::time_point::max();
+                    outputFilename = it->second.task.outputFilename;
+                }
+            }
+            // The output follows the message even when the lease was lost; it is discarded then
+            if (!sharedPath && success &&
+                !conn.receiveFile(held ? outputFilename : "", message.get("output_bytes", 0).asUInt64())) {
+                break;
+            }
+
+            // The worker's job has ended either way, so an expired lease can be requeued now
+            ConversionTask task;
+            bool expired = false;
+            bool released = release(leaseId, connection, task, &expired);
+            held = released && !expired;
+            reply["type"] = held ? "ok" : "lost";
+            bool sent = conn.send(reply);
+            if (released && expired) {
+                LOG_WARN << "Requeueing " << task.outputFilename << " after " << name << " finished expired lease " << leaseId;
+                ConversionManager::instance().requeueRemoteTask(std::move(task));
+            } else if (held) {
+                LOG_INFO << "Remote worker " << name << " finished lease " << leaseId << (success ? "" : " (failed)");
+                if (task.trace) {
+                    task.trace->markFinished(message.get("exit_code", -1).asInt(),
+                                             static_cast<long>(message.get("peak_rss_kb", 0).asInt64()));
+                }
+                ConversionManager::instance().finishRemoteTask(std::move(task), success);
+            }
+            if (!sent) break;
+            continue;
+        }
+
+        LOG_WARN << "Unexpected message from remote worker " << name << ": " << type;
+        break;
+    }
+
+    // Whatever this worker still held goes back to the queue
+    std::vector<ConversionTask> orphaned;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = leases_.begin(); it != leases_.end();) {
+            if (it->second.connection == connection) {
+                orphaned.push_back(std::move(it->second.task));
+                it = leases_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (workers_.erase(connection) > 0) {
+            ConversionManager::instance().setRemoteWorkers(workers_.size());
+        }
+    }
+    if (registered) {
+        LOG_INFO << "Remote worker " << name << " disconnected";
+    }
+    for (auto& task : orphaned) {
+        LOG_WARN << "Requeueing " << task.outputFilename << " from disconnected worker " << name;
+        ConversionManager::instance().requeueRemoteTask(std::move(task));
+    }
+
+    // Last: the destructor may return (and conn may be closed) as soon as this entry is gone
+    std::lock_guard<std::mutex> lock(mutex_);
+    connections_.erase(connection);
+    condition_.notify_all();
+}
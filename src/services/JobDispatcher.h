@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include "ConversionManager.h"
+#include <string>
+#include <map>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+
+class DispatchConnection;
+
+/**
+ * @class JobDispatcher
+ * @brief Leases queued conversion tasks to remote konvertor_worker processes.
+ *
+ * Workers connect over a Unix or TCP socket (`custom_config.remote.listen`)
+ * and speak line-delimited JSON:
+ *
+ *   worker -> {"type":"hello","worker":name,"shared_path":bool,"token":secret}
+ *   server <- {"type":"welcome","lease_seconds":n}
+ *   worker -> {"type":"pull"}
+ *   server <- {"type":"idle"} or {"type":"job","lease":id,"args":[...],...}
+ *   worker -> {"type":"heartbeat","lease":id,"processed":seconds}
+ *   server <- {"type":"ok"} or {"type":"lost"}
+ *   worker -> {"type":"done","lease":id,"success":bool,"exit_code":n,"peak_rss_kb":n,"output_bytes":n}
+ *   server <- {"type":"ok"} or {"type":"lost"}
+ *
+ * A worker with a shared path runs the commands on the server's own paths.
+ * Otherwise the input follows the job message and the output follows the
+ * done message as raw bytes, and the worker rewrites both paths to local files.
+ *
+ * Workers receive users' uploads and return their outputs, so they must be
+ * trusted. The hello must carry `custom_config.remote.token`, compared in
+ * constant time; a TCP listener is refused without one. A Unix socket is
+ * additionally restricted to the service's user (0600).
+ *
+ * Each lease must be renewed by a heartbeat within lease_seconds. An expired
+ * lease is revoked but not requeued yet: the old worker may still be writing
+ * the output. Its next heartbeat or done is answered "lost", and the task goes
+ * back to the front of ConversionManager's queue once the worker has killed
+ * its job (its next message) or disconnected. A worker that stays silent for
+ * another lease_seconds is disconnected.
+ */
+class JobDispatcher {
+public:
+    static JobDispatcher& instance() {
+        static JobDispatcher instance;
+        return instance;
+    }
+
+    JobDispatcher(const JobDispatcher&) = delete;
+    void operator=(const JobDispatcher&) = delete;
+
+    bool enabled() const { return enabled_; }
+    size_t connectedWorkers();
+    size_t activeLeases();
+
+private:
+    JobDispatcher();
+    ~JobDispatcher();
+
+    struct Lease {
+        ConversionTask task;
+        uint64_t connection = 0;
+        std::chrono::steady_clock::time_point deadline;
+        bool expired = false; // Revoked; waiting for the old worker to let go
+    };
+
+    void acceptLoop();
+    void reapLoop();
+    void serve(int fd, uint64_t connection);
+    // Sends a leased task; false if the connection failed
+    bool sendJob(DispatchConnection& conn, uint64_t leaseId, const ConversionTask& task, bool sharedPath);
+    // Removes a lease held by the connection; false if there is none
+    bool release(uint64_t leaseId, uint64_t connection, ConversionTask& task, bool* expired = nullptr);
+
+    bool enabled_ = false;
+    int listenFd_ = -1; // Owned by the accept thread once it runs
+    std::string address_;
+    std::string token_; // Shared secret every worker's hello must carry
+    std::chrono::seconds leaseDuration_{30};
+
+    std::thread acceptThread_;
+    std::thread reapThread_;
+
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::map<uint64_t, Lease> leases_;
+    std::map<uint64_t, DispatchConnection*> connections_;
+    std::set<uint64_t> workers_; // Connections that completed the hello
+    uint64_t nextLease_ = 0;
+    uint64_t nextConnection_ = 0;
+    bool stop_ = false;
+};
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#include "JobTrace.h"
+#include <drogon/drogon.h>
+#include <trantor/utils/Logger.h>
+#include <json/json.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+
+void JobTraceRecord::markStarted() {
+    int64_t now = JobTrace::now();
+    int64_t expected = 0;
+    started.compare_exchange_strong(expected, now);
+}
+
+void JobTraceRecord::markFinished(int code, long rssKb) {
+    int64_t now = JobTrace::now();
+    int64_t last = finished.load();
+    while (last < now && !finished.compare_exchange_weak(last, now)) {}
+    long peak = peakRssKb.load();
+    while (peak < rssKb && !peakRssKb.compare_exchange_weak(peak, rssKb)) {}
+    exitCode = code;
+}
+
+JobTrace::JobTrace() {
+    // Per-job JSONL trace, configured in config.json (custom_config.trace)
+    auto config = drogon::app().getCustomConfig()["trace"];
+    if (!config.get("enabled", true).asBool()) return;
+
+    std::string path = config.get("path", "./jobs.jsonl").asString();
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        LOG_ERROR << "Job trace disabled: cannot open " << path;
+        return;
+    }
+
+    // Round the capacity up to a power of two so positions map to slots with a mask
+    size_t requested = std::max<Json::UInt64>(16, config.get("ring_capacity", 4096).asUInt64());
+    size_t capacity = 16;
+    while (capacity < requested) capacity <<= 1;
+    slots_.reset(new Slot[capacity]);
+    for (size_t i = 0; i < capacity; ++i) slots_[i].sequence = i;
+    mask_ = capacity - 1;
+    flushInterval_ = std::chrono::milliseconds(std::max<Json::Int64>(10, config.get("flush_interval_ms", 200).asInt64()));
+
+    enabled_ = true;
+    writer_ = std::thread(&JobTrace::writerLoop, this);
+    LOG_INFO << "Writing job trace to " << path << " (ring of " << capacity << ")";
+}
+
+JobTrace::~JobTrace() {
+    flush();
+    if (fd_ >= 0) close(fd_);
+}
+
+void JobTrace::flush() {
+    if (!enabled_) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    condition_.notify_all();
+    if (writer_.joinable()) writer_.join();
+}
+
+JobTracePtr JobTrace::begin(const std::string& kind, int64_t receivedAt) {
+    if (!enabled_) return nullptr;
+    // Whoever drops the last reference hands the record to the writer
+    JobTracePtr record(new JobTraceRecord, [this](JobTraceRecord* released) { submit(released); });
+    record->kind = kind;
+    record->received = receivedAt > 0 ? receivedAt : now();
+    return record;
+}
+
+void JobTrace::submit(JobTraceRecord* record) {
+    if (push(record)) return;
+    ++dropped_;
+    delete record;
+}
+
+bool JobTrace::push(JobTraceRecord* record) {
+    uint64_t pos = head_.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+        slot = &slots_[pos & mask_];
+        uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        int64_t diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(pos);
+        if (diff == 0) {
+            // Slot is free for this position: claim it
+            if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            return false; // The writer has not freed this slot yet: ring is full
+        } else {
+            pos = head_.load(std::memory_order_relaxed); // Another producer took it
+        }
+    }
+    slot->record = record;
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool JobTrace::pop(JobTraceRecord*& record) {
+    Slot* slot = &slots_[tail_ & mask_];
+    if (slot->sequence.load(std::memory_order_acquire) != tail_ + 1) return false;
+    record = slot->record;
+    slot->record = nullptr;
+    // Free the slot for the producer one lap ahead
+    slot->sequence.store(tail_ + mask_ + 1, std::memory_order_release);
+    ++tail_;
+    return true;
+}
+
+void JobTrace::drain(std::string& buffer) {
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    builder["emitUTF8"] = true;
+    // Stage times in ms to the microsecond, without float noise; "decimal" counts digits after the point
+    builder["precision"] = 3;
+    builder["precisionType"] = "decimal";
+
+    buffer.clear();
+    size_t count = 0;
+    JobTraceRecord* record;
+    while (pop(record)) {
+        std::unique_ptr<JobTraceRecord> owned(record);
+        const JobTraceRecord& r = *record;
+        Json::Value json;
+        json["kind"] = r.kind;
+        json["job_id"] = r.jobId;
+        if (!r.format.empty()) json["format"] = r.format;
+        if (!r.codec.empty()) json["codec"] = r.codec;
+        if (!r.preset.empty()) json["preset"] = r.preset;
+        json["success"] = r.success;
+        if (!r.error.empty()) json["error"] = r.error;
+        json["exit_code"] = r.exitCode.load();
+        json["peak_rss_kb"] = (Json::Int64)r.peakRssKb.load();
+        json["remote"] = r.remote.load();
+        json["input_bytes"] = (Json::UInt64)r.inputBytes;
+        json["output_bytes"] = (Json::UInt64)r.outputBytes;
+        json["media_seconds"] = r.mediaSeconds;
+        if (r.segments > 0) json["segments"] = (Json::UInt64)r.segments;
+        json["received_at_us"] = (Json::Int64)r.received;
+
+        // Later stages as milliseconds after the request was received
+        Json::Value stages(Json::objectValue);
+        auto stage = [&](const char* name, int64_t at) {
+            if (at > 0) stages[name] = (at - r.received) / 1000.0;
+        };
+        stage("saved", r.saved);
+        stage("queued", r.queued);
+        stage("started", r.started.load());
+        stage("finished", r.finished.load());
+        stage("moved", r.moved);
+        json["stages_ms"] = stages;
+
+        buffer += Json::writeString(builder, json);
+        buffer += '\n';
+        ++count;
+    }
+    if (count == 0) return;
+
+    // One append per batch
+    size_t offset = 0;
+    while (offset < buffer.size()) {
+        ssize_t n = write(fd_, buffer.data() + offset, buffer.size() - offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            LOG_ERROR << "Job trace write failed, " << count << " records lost";
+            dropped_ += count;
+            return;
+        }
+        offset += static_cast<size_t>(n);
+    }
+    written_ += count;
+}
+
+void JobTrace::writerLoop() {
+    std::string buffer;
+    while (true) {
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait_for(lock, flushInterval_, [this] { return stop_; });
+            stopping = stop_;
+        }
+        drain(buffer);
+        if (stopping) return;
+    }
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @brief Stage timings and outcome of one job, written as one JSONL line.
+ *
+ * Timestamps are microseconds since the epoch (JobTrace::now()), 0 for stages
+ * the job never reached. The request-side fields are filled in order by
+ * whoever owns the job; the execution fields are atomic because the segments
+ * of a split job run on several workers at once.
+ *
+ * The record is written when the last reference to it is released, so every
+ * job that got a record produces exactly one line, whichever path it ends on.
+ */
+struct JobTraceRecord {
+    std::string kind;  // "convert" or "zip"
+    std::string jobId; // Upload UUID or archive name
+    std::string format;
+    std::string codec; // Encoder, or "copy" for a remux
+    std::string preset; // EncoderPreset::name(), e.g. "mp3/medium/fast"
+    uint64_t inputBytes = 0;
+    uint64_t outputBytes = 0;
+    double mediaSeconds = 0;
+    size_t segments = 0; // Parallel segments, 0 if the job was not split
+
+    int64_t received = 0; // Request handler started
+    int64_t saved = 0;    // Upload on disk
+    int64_t queued = 0;   // Handed to ConversionManager
+    int64_t moved = 0;    // Output published to ./www/downloads/
+
+    std::atomic<int64_t> started{0};  // First command started (earliest segment)
+    std::atomic<int64_t> finished{0}; // Last command exited
+    std::atomic<int> exitCode{-1};
+    std::atomic<long> peakRssKb{0};   // Largest child RSS (wait4 rusage)
+    std::atomic<bool> remote{false};  // At least one command ran on a konvertor_worker
+
+    bool success = false;
+    std::string error;
+
+    void markStarted();
+    void markFinished(int code, long rssKb);
+};
+
+using JobTracePtr = std::shared_ptr<JobTraceRecord>;
+
+/**
+ * @class JobTrace
+ * @brief Appends one JSONL record per finished job to the trace file.
+ *
+ * Releasing a record never blocks: it goes into a fixed-size lock-free ring
+ * (bounded MPSC, one sequence number per slot) and is dropped and counted if
+ * the ring is full. A background writer drains the ring every flush interval,
+ * formats the records and appends them with one write() per batch.
+ * Configured by `custom_config.trace`.
+ */
+class JobTrace {
+public:
+    static JobTrace& instance() {
+        static JobTrace instance;
+        return instance;
+    }
+
+    JobTrace(const JobTrace&) = delete;
+    void operator=(const JobTrace&) = delete;
+
+    /**
+     * @brief Starts a record, or returns null when tracing is off.
+     * @param receivedAt Received stage (JobTrace::now() units); 0 means now.
+     */
+    JobTracePtr begin(const std::string& kind, int64_t receivedAt = 0);
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @brief Writes everything buffered and stops the writer. Called before the
+     *        process exits without running destructors (restart hand-off).
+     */
+    void flush();
+
+    bool enabled() const { return enabled_; }
+    uint64_t written() const { return written_; }
+    uint64_t dropped() const { return dropped_; }
+
+private:
+    JobTrace();
+    ~JobTrace();
+
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        JobTraceRecord* record = nullptr;
+    };
+
+    // Takes ownership of a released record
+    void submit(JobTraceRecord* record);
+    bool push(JobTraceRecord* record);
+    bool pop(JobTraceRecord*& record); // Writer thread only
+    void writerLoop();
+    // Formats everything in the ring and appends it to the file
+    void drain(std::string& buffer);
+
+    bool enabled_ = false;
+    int fd_ = -1;
+    std::chrono::milliseconds flushInterval_{200};
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_ = 0;
+    std::atomic<uint64_t> head_{0}; // Next position producers claim
+    uint64_t tail_ = 0;             // Next position the writer reads
+
+    std::atomic<uint64_t> written_{0};
+    std::atomic<uint64_t> dropped_{0};
+
+    std::thread writer_;
+    std::mutex mutex_; // Only for the writer's sleep and shutdown, never taken by submit()
+    std::condition_variable condition_;
+    bool stop_ = false;
+};
@@ -0,0 +1,355 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#include "Lifecycle.h"
+#include "ConversionManager.h"
+#include "BatchRegistry.h"
+#include "JobAdopter.h"
+#include "JobTrace.h"
+#include <drogon/drogon.h>
+#include <trantor/utils/Logger.h>
+#include <json/json.h>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+// Names the successor's end of the hand-off socket pair
+static const char* const HANDOFF_ENV = "KONVERTOR_HANDOFF_FD";
+
+// Tells a systemd unit with Type=notify and NotifyAccess=all about state
+// changes, such as the successor becoming the main process. No-op without
+// $NOTIFY_SOCKET.
+static void notifySupervisor(const std::string& state) {
+    const char* path = getenv("NOTIFY_SOCKET");
+    if (!path || (path[0] != '/' && path[0] != '@')) return;
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    size_t length = strlen(path);
+    if (length >= sizeof(addr.sun_path)) return;
+    memcpy(addr.sun_path, path, length);
+    if (path[0] == '@') addr.sun_path[0] = '\0'; // Abstract namespace
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return;
+    sendto(fd, state.data(), state.size(), MSG_NOSIGNAL, reinterpret_cast<sockaddr*>(&addr),
+           offsetof(struct sockaddr_un, sun_path) + length);
+    close(fd);
+}
+
+Lifecycle::InFlight::~InFlight() {
+    --Lifecycle::instance().inFlight_;
+}
+
+Lifecycle::~Lifecycle() {
+    if (drainThread_.joinable()) drainThread_.join();
+}
+
+void Lifecycle::init(int argc, char* argv[]) {
+    // SIGUSR2 is taken with sigwait() by signalLoop(); blocked here, before any
+    // other thread exists, it is never delivered to a thread that does not expect it.
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &set, nullptr);
+
+    args_.assign(argv, argv + argc);
+    // Resolved now: the successor is started from this path, which a deploy
+    // may since have replaced with a new binary.
+    char path[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    binaryPath_ = length > 0 ? std::string(path, static_cast<size_t>(length)) : args_.at(0);
+
+    const char* handoff = getenv(HANDOFF_ENV);
+    if (handoff) {
+        predecessorChannel_ = atoi(handoff);
+        successor_ = predecessorChannel_ > STDERR_FILENO &&
+                     fcntl(predecessorChannel_, F_SETFD, FD_CLOEXEC) == 0;
+        unsetenv(HANDOFF_ENV);
+    }
+}
+
+void Lifecycle::start() {
+    // Optional overrides from config.json (custom_config.lifecycle)
+    auto config = drogon::app().getCustomConfig()["lifecycle"];
+    drainTimeout_ = std::chrono::seconds(std::max(0, config.get("drain_seconds", (int)drainTimeout_.count()).asInt()));
+    restartTimeout_ = std::chrono::seconds(std::max(1, config.get("restart_timeout_seconds", (int)restartTimeout_.count()).asInt()));
+    retryAfterSeconds_ = std::max(1, config.get("retry_after_seconds", retryAfterSeconds_).asInt());
+
+    // Lets a successor bind the ports while this process still listens
+    if (config.get("reuse_port", true).asBool()) {
+        drogon::app().enableReusePort();
+    }
+    drogon::app().setBeforeListenSockOptCallback([this](int fd) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        listenFds_.push_back(fd);
+    });
+
+    // Drogon runs this on the main event loop, not in the signal handler
+    drogon::app().setTermSignalHandler([this]() { beginDrain(false); });
+    std::thread(&Lifecycle::signalLoop, this).detach();
+
+    if (successor_) {
+        LOG_INFO << "Started as the successor of a restarted server";
+        int channel = predecessorChannel_;
+        drogon::app().registerBeginningAdvice([channel]() {
+            // Listening on the shared ports: the predecessor may close its own
+            static const char ready[] = "{\"type\":\"ready\"}";
+            send(channel, ready, sizeof(ready) - 1, MSG_NOSIGNAL);
+            notifySupervisor("MAINPID=" + std::to_string(getpid()) + "\nREADY=1");
+            JobAdopter::instance().start(channel);
+        });
+    }
+}
+
+Lifecycle::InFlightPtr Lifecycle::admit() {
+    if (draining_) return nullptr;
+    ++inFlight_;
+    return InFlightPtr(new InFlight);
+}
+
+void Lifecycle::signalLoop() {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR2);
+    while (true) {
+        int signal = 0;
+        if (sigwait(&set, &signal) == 0 && signal == SIGUSR2) beginDrain(true);
+    }
+}
+
+void Lifecycle::beginDrain(bool restart) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (active_) {
+        if (restart) {
+            LOG_WARN << "Restart requested while draining, ignored";
+        } else {
+            LOG_WARN << "Second SIGTERM, skipping to the end of the drain";
+            skipToDeadline_ = true;
+            condition_.notify_all();
+        }
+        return;
+    }
+    if (restart && JobAdopter::instance().receiving()) {
+        LOG_WARN << "Restart requested while still taking over from the previous process, ignored";
+        return;
+    }
+
+    active_ = true;
+    skipToDeadline_ = false;
+    // A previous restart attempt that failed has finished its thread
+    if (drainThread_.joinable()) drainThread_.join();
+    drainThread_ = std::thread(&Lifecycle::drainLoop, this, restart);
+}
+
+bool Lifecycle::idle() {
+    return inFlight_ == 0 && ConversionManager::instance().idle() && !JobAdopter::instance().busy();
+}
+
+void Lifecycle::drainLoop(bool restart) {
+    int channel = -1;
+    pid_t successor = 0;
+    if (restart) {
+        LOG_INFO << "Restart requested, starting " << binaryPath_;
+        if (!spawnSuccessor(channel, successor)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            active_ = false;
+            return;
+        }
+        LOG_INFO << "Successor " << successor << " is listening, handing over the ports";
+        retireListeners();
+    } else {
+        notifySupervisor("STOPPING=1");
+    }
+
+    draining_ = true;
+    LOG_INFO << "Draining: refusing new conversions, waiting up to " << drainTimeout_.count()
+             << "s for accepted ones";
+    auto deadline = std::chrono::steady_clock::now() + drainTimeout_;
+    bool drained = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!(drained = idle()) && !skipToDeadline_ && drogon::app().isRunning() &&
+               std::chrono::steady_clock::now() < deadline) {
+            condition_.wait_for(lock, std::chrono::milliseconds(200));
+        }
+    }
+    if (!drogon::app().isRunning()) {
+        // Stopped some other way (SIGINT) while draining
+        if (channel >= 0) close(channel);
+        return;
+    }
+
+    if (channel >= 0) {
+        sendJournal(channel, !drained);
+        close(channel);
+        if (!drained) {
+            // Running commands now belong to the successor. Destructors would
+            // wait for them (or kill them), so leave without running any.
+            LOG_INFO << "Handed remaining work to successor " << successor << ", exiting";
+            JobTrace::instance().flush();
+            _exit(0);
+        }
+    } else if (!drained) {
+        LOG_WARN << "Drain deadline reached, failing remaining work";
+        ConversionManager::instance().abortAll();
+        auto grace = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!idle() && std::chrono::steady_clock::now() < grace) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+    }
+
+    LOG_INFO << (drained ? "Drained, stopping" : "Stopping");
+    // Let the last responses leave the event loops
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    drogon::app().quit();
+}
+
+bool Lifecycle::spawnSuccessor(int& channel, pid_t& pid) {
+    // Sequenced packets keep message boundaries and carry descriptors (see sendJournal)
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) != 0) {
+        LOG_ERROR << "Restart failed: socketpair: " << std::strerror(errno);
+        return false;
+    }
+
+    // Build argv and the environment before forking: only async-signal-safe
+    // calls are allowed in the child of a multi-threaded process.
+    std::vector<char*> argv;
+    for (auto& arg : args_) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+    std::string handoff = std::string(HANDOFF_ENV) + "=" + std::to_string(fds[1]);
+    std::vector<char*> envp;
+    for (char** var = environ; *var; ++var) {
+        if (strncmp(*var, HANDOFF_ENV, strlen(HANDOFF_ENV)) != 0) envp.push_back(*var);
+    }
+    envp.push_back(const_cast<char*>(handoff.c_str()));
+    envp.push_back(nullptr);
+
+    pid = fork();
+    if (pid == -1) {
+        LOG_ERROR << "Restart failed: fork: " << std::strerror(errno);
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        // Only the successor's end survives exec
+        fcntl(fds[1], F_SETFD, 0);
+        execve(binaryPath_.c_str(), argv.data(), envp.data());
+        _exit(127);
+    }
+    close(fds[1]);
+    channel = fds[0];
+
+    // The successor reports ready once it listens on the shared ports
+    struct pollfd pfd = {channel, POLLIN, 0};
+    int ready;
+    while ((ready = poll(&pfd, 1, static_cast<int>(restartTimeout_.count() * 1000))) < 0 && errno == EINTR) {}
+    char message[64];
+    ssize_t n = ready > 0 ? recv(channel, message, sizeof(message), 0) : -1;
+    Json::Value json;
+    Json::Reader reader;
+    if (n > 0 && reader.parse(message, message + n, json) && json["type"].asString() == "ready") {
+        return true;
+    }
+
+    LOG_ERROR << "Restart failed: successor " << pid
+              << (ready == 0 ? " did not start listening in time" : " exited before it was ready")
+              << ", resuming";
+    kill(pid, SIGKILL);
+    while (waitpid(pid, nullptr, 0) == -1 && errno == EINTR) {}
+    close(channel);
+    channel = -1;
+    return false;
+}
+
+void Lifecycle::retireListeners() {
+    std::vector<int> fds;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        fds.swap(listenFds_);
+    }
+    // dup2() closes each listening socket in place: it leaves the SO_REUSEPORT
+    // group and Drogon's epoll set, while the descriptor number Drogon holds
+    // stays valid. Connections still in its accept queue are reset unless the
+    // kernel migrates them to the successor (net.ipv4.tcp_migrate_req = 1).
+    for (int fd : fds) {
+        int placeholder = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (placeholder < 0 || dup2(placeholder, fd) < 0) {
+            LOG_ERROR << "Cannot close listening socket " << fd << ": " << std::strerror(errno);
+        }
+        if (placeholder >= 0) close(placeholder);
+    }
+    LOG_INFO << "Closed " << fds.size() << " listening sockets";
+}
+
+void Lifecycle::sendJournal(int channel, bool handOff) {
+    // Stop the workers first, so batch state no longer changes while it is sent
+    std::vector<HandOffEntry> tasks;
+    if (handOff) tasks = ConversionManager::instance().handOff();
+    Json::Value batches = BatchRegistry::instance().snapshot();
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    size_t sent = 0;
+    // One message per entry, each within the socket's send buffer
+    auto sendMessage = [&](const Json::Value& message, int fd) {
+        std::string data = Json::writeString(builder, message);
+        struct iovec iov = {&data[0], data.size()};
+        struct msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        // A running command's progress pipe travels with its entry (SCM_RIGHTS)
+        char control[CMSG_SPACE(sizeof(int))] = {};
+        if (fd >= 0) {
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            struct cmsghdr* header = CMSG_FIRSTHDR(&msg);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int));
+            memcpy(CMSG_DATA(header), &fd, sizeof(int));
+        }
+        ssize_t n;
+        while ((n = sendmsg(channel, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR) {}
+        if (n == static_cast<ssize_t>(data.size())) {
+            ++sent;
+        } else {
+            LOG_ERROR << "Hand-off message lost: " << (n < 0 ? std::strerror(errno) : "short write");
+        }
+    };
+
+    // Batches first: adopted tasks update their items
+    for (const auto& id : batches.getMemberNames()) {
+        Json::Value message;
+        message["type"] = "batch";
+        message["id"] = id;
+        message["batch"] = batches[id];
+        sendMessage(message, -1);
+    }
+    for (auto& entry : tasks) {
+        entry.task["type"] = "task";
+        sendMessage(entry.task, entry.stdoutFd);
+        if (entry.stdoutFd >= 0) close(entry.stdoutFd);
+    }
+    LOG_INFO << "Sent " << batches.size() << " batches and " << tasks.size() << " tasks to the successor ("
+             << sent << " messages delivered)";
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <sys/types.h>
+
+/**
+ * @class Lifecycle
+ * @brief Graceful drain on SIGTERM and zero-downtime restart on SIGUSR2.
+ *
+ * SIGTERM starts a drain: new conversions are refused with 503 and Retry-After
+ * while accepted ones finish. Once nothing is in flight, or after
+ * `drain_seconds`, the process quits; work still queued or running at the
+ * deadline is failed.
+ *
+ * SIGUSR2 replaces the process with a fresh one started from the same binary
+ * path (so a newly deployed binary is picked up):
+ *
+ *   1. The successor is started with one end of a socket pair, named by the
+ *      KONVERTOR_HANDOFF_FD environment variable. Listeners use SO_REUSEPORT,
+ *      so it binds the same port while this process still listens.
+ *   2. Once it reports ready, this process closes its own listening sockets
+ *      and drains as for SIGTERM; new connections only reach the successor.
+ *      If it fails to start within `restart_timeout_seconds`, it is killed and
+ *      this process resumes normal operation.
+ *   3. Batch state is then sent to the successor. Work still queued or
+ *      running at the drain deadline is handed off as well (see
+ *      ConversionManager::handOff()): running ffmpeg processes are left
+ *      running and adopted by the successor (see JobAdopter).
+ *
+ * A second SIGTERM during a drain skips to the deadline.
+ */
+class Lifecycle {
+public:
+    static Lifecycle& instance() {
+        static Lifecycle inst;
+        return inst;
+    }
+
+    Lifecycle(const Lifecycle&) = delete;
+    Lifecycle& operator=(const Lifecycle&) = delete;
+
+    /**
+     * @brief Records the command line and blocks SIGUSR2. Must run first in
+     *        main(), before any thread is started, so every thread inherits the mask.
+     */
+    void init(int argc, char* argv[]);
+
+    /**
+     * @brief Installs the signal handlers and listener options. In a successor,
+     *        also starts adopting the predecessor's work. Call before app().run().
+     */
+    void start();
+
+    /**
+     * @brief Keeps the drain waiting while a request is being admitted
+     *        (saving its upload, probing, queueing). Released on destruction.
+     */
+    class InFlight {
+    public:
+        ~InFlight();
+    private:
+        friend class Lifecycle;
+        InFlight() = default;
+    };
+    using InFlightPtr = std::shared_ptr<InFlight>;
+
+    /**
+     * @brief Admits a new request.
+     * @return nullptr while draining; the caller answers 503 (see retryAfterSeconds()).
+     */
+    InFlightPtr admit();
+
+    bool draining() const { return draining_; }
+    // Started by a predecessor's restart
+    bool isSuccessor() const { return successor_; }
+    int retryAfterSeconds() const { return retryAfterSeconds_; }
+
+private:
+    Lifecycle() = default;
+    ~Lifecycle();
+
+    // Starts a drain (with a restart) unless one is running
+    void beginDrain(bool restart);
+    void drainLoop(bool restart);
+    // True when no request is being admitted and no task is queued or running
+    bool idle();
+    // Starts the successor and waits for it to report ready
+    bool spawnSuccessor(int& channel, pid_t& pid);
+    // Removes this process's sockets from the listening ports
+    void retireListeners();
+    // Sends batches and, if handOff is set, the remaining tasks to the successor
+    void sendJournal(int channel, bool handOff);
+    void signalLoop();
+
+    std::string binaryPath_;
+    std::vector<std::string> args_;
+    bool successor_ = false;
+    int predecessorChannel_ = -1;
+
+    // Configuration (custom_config.lifecycle in config.json)
+    std::chrono::seconds drainTimeout_{300};
+    std::chrono::seconds restartTimeout_{30};
+    int retryAfterSeconds_ = 5;
+
+    std::atomic<bool> draining_{false};
+    std::atomic<size_t> inFlight_{0};
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool active_ = false;         // Guarded by mutex_; a drain or restart attempt is running
+    bool skipToDeadline_ = false; // Guarded by mutex_
+    std::vector<int> listenFds_;  // Guarded by mutex_
+    std::thread drainThread_;
+};
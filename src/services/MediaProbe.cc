@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#include "MediaProbe.h"
+#include "ProcessRunner.h"
+#include <trantor/utils/Logger.h>
+#include <json/json.h>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+bool MediaInfo::canStreamCopy(const std::string& targetFormat) const {
+    return hasAudio && !audioCodec.empty() && audioCodec == MediaProbe::codecForFormat(targetFormat);
+}
+
+std::string MediaProbe::codecForFormat(const std::string& targetFormat) {
+    if (targetFormat == "mp3") return "mp3";
+    if (targetFormat == "aac" || targetFormat == "m4a") return "aac";
+    if (targetFormat == "ogg") return "vorbis";
+    if (targetFormat == "opus") return "opus";
+    if (targetFormat == "flac") return "flac";
+    if (targetFormat == "wav") return "pcm_s16le";
+    return "";
+}
+
+MediaProbe::Status MediaProbe::probe(const std::string& path, MediaInfo& info) {
+    // Read headers only: cap the probe size and the stream analysis window (0.5s).
+    std::vector<std::string> args = {
+        "ffprobe", "-v", "error",
+        "-probesize", "5000000", "-analyzeduration", "500000",
+        "-show_entries", "format=format_name,duration:stream=codec_type,codec_name,sample_rate,channels,bit_rate",
+        "-of", "json",
+        path
+    };
+
+    std::string output;
+    ProcessResult result = ProcessRunner::run(args,
+        [&output](const std::string& line) { output += line; output += '\n'; },
+        std::chrono::seconds(10));
+
+    if (result.notFound() || result.timedOut || !result.started) {
+        LOG_WARN << "ffprobe unavailable for " << path << ", skipping probe";
+        return Status::Unavailable;
+    }
+    if (!result.success()) {
+        return Status::Invalid;
+    }
+
+    Json::Value root;
+    std::string errs;
+    Json::CharReaderBuilder builder;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    if (!reader->parse(output.data(), output.data() + output.size(), &root, &errs)) {
+        LOG_WARN << "Unparseable ffprobe output for " << path << ": " << errs;
+        return Status::Invalid;
+    }
+
+    const Json::Value& format = root["format"];
+    if (!format.isObject()) return Status::Invalid;
+    info.container = format.get("format_name", "").asString();
+    // ffprobe prints numbers as strings
+    info.durationSeconds = std::atof(format.get("duration", "0").asString().c_str());
+
+    for (const auto& stream : root["streams"]) {
+        if (stream.get("codec_type", "").asString() != "audio") continue;
+        info.hasAudio = true;
+        info.audioCodec = stream.get("codec_name", "").asString();
+        info.sampleRate = std::atoi(stream.get("sample_rate", "0").asString().c_str());
+        info.channels = stream.get("channels", 0).asInt();
+        info.audioBitrate = std::atoll(stream.get("bit_rate", "0").asString().c_str());
+        break; // ffmpeg maps the first audio stream by default
+    }
+
+    return info.hasAudio ? Status::Ok : Status::NoAudio;
+}
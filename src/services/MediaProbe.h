@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+/**
+ * @brief Container and audio stream properties reported by ffprobe.
+ */
+struct MediaInfo {
+    std::string container;      // e.g. "mov,mp4,m4a,3gp,3g2,mj2"
+    double durationSeconds = 0; // 0 if the container does not declare it
+    bool hasAudio = false;
+    std::string audioCodec;     // e.g. "aac", "opus", "mp3"
+    int sampleRate = 0;
+    int channels = 0;
+    int64_t audioBitrate = 0;   // bits/s, 0 if unknown
+
+    /**
+     * @brief True if the source audio is already in the target format's codec,
+     *        so it could be remuxed (`-c:a copy`) instead of re-encoded.
+     */
+    bool canStreamCopy(const std::string& targetFormat) const;
+};
+
+/**
+ * @class MediaProbe
+ * @brief Lightweight pre-queue inspection of uploads using ffprobe.
+ *
+ * Only container headers are read (small probe size, no frame decoding), so a
+ * probe costs milliseconds. Uploads that are not media or have no audio stream
+ * are rejected before they take a worker slot.
+ */
+class MediaProbe {
+public:
+    enum class Status {
+        Ok,          // info is filled in
+        NoAudio,     // valid container but no audio stream
+        Invalid,     // not a media file ffprobe understands
+        Unavailable  // ffprobe is not installed or timed out; caller should proceed without info
+    };
+
+    /**
+     * @brief Probes a file's container headers.
+     * @param path File to inspect.
+     * @param info Filled in when the result is Status::Ok.
+     */
+    static Status probe(const std::string& path, MediaInfo& info);
+
+    /**
+     * @brief Audio codec ffprobe reports for outputs of the given target format.
+     */
+    static std::string codecForFormat(const std::string& targetFormat);
+};
@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#include "OutputStreamer.h"
+#include <drogon/drogon.h>
+#include <trantor/utils/Logger.h>
+#include <algorithm>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool OutputStreamer::isStreamable(const std::string& format) {
+    // M4A keeps its index (moov) at the end and FLAC's header is only complete
+    // after encoding, so neither can be played from a partial file.
+    return format == "mp3" || format == "aac" || format == "ogg" || format == "opus" || format == "wav";
+}
+
+std::string OutputStreamer::mimeType(const std::string& format) {
+    if (format == "mp3") return "audio/mpeg";
+    if (format == "aac") return "audio/aac";
+    if (format == "ogg" || format == "opus") return "audio/ogg";
+    if (format == "wav") return "audio/wav";
+    return "application/octet-stream";
+}
+
+OutputStreamer::OutputStreamer() {
+    thread_ = std::thread(&OutputStreamer::pumpLoop, this);
+}
+
+OutputStreamer::~OutputStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    condition_.notify_all();
+    if (thread_.joinable()) thread_.join();
+
+    for (auto& follower : followers_) closeFollower(follower, false);
+}
+
+void OutputStreamer::open(const std::string& id, const std::string& path, const std::string& format) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry& entry = entries_[id];
+    entry = Entry{};
+    entry.path = path;
+    entry.format = format;
+}
+
+void OutputStreamer::finish(const std::string& id, bool success, const std::string& finalPath,
+                            const std::string& downloadUrl) {
+    if (id.empty()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(id);
+        if (it == entries_.end()) return;
+        it->second.state = success ? State::Done : State::Failed;
+        it->second.finished = std::chrono::steady_clock::now();
+        if (success) {
+            it->second.path = finalPath;
+            it->second.downloadUrl = downloadUrl;
+        }
+    }
+    condition_.notify_all(); // Drain the followers now rather than at the next poll
+}
+
+OutputStreamer::State OutputStreamer::state(const std::string& id, std::string& downloadUrl, std::string& format) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(id);
+    if (it == entries_.end()) return State::Unknown;
+    downloadUrl = it->second.downloadUrl;
+    format = it->second.format;
+    return it->second.state;
+}
+
+void OutputStreamer::attach(const std::string& id, drogon::ResponseStreamPtr stream,
+                            std::weak_ptr<trantor::TcpConnection> connection) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.find(id) == entries_.end()) {
+        stream->close();
+        return;
+    }
+    Follower follower;
+    follower.id = id;
+    follower.stream = std::move(stream);
+    follower.connection = std::move(connection);
+    followers_.push_back(std::move(follower));
+}
+
+void OutputStreamer::pumpLoop() {
+    // Followers are only erased on this thread, so their iterators stay valid
+    // while the I/O runs without the lock
+    using Work = std::pair<std::list<Follower>::iterator, Entry>;
+    std::vector<Work> work;
+    std::vector<std::pair<std::list<Follower>::iterator, PumpResult>> ended;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        condition_.wait_for(lock, POLL_INTERVAL, [this] { return stop_; });
+        if (stop_) break;
+
+        work.clear();
+        ended.clear();
+        for (auto it = followers_.begin(); it != followers_.end(); ++it) {
+            auto entry = entries_.find(it->id);
+            if (entry == entries_.end()) {
+                ended.emplace_back(it, PumpResult::Abort);
+            } else {
+                work.emplace_back(it, entry->second);
+            }
+        }
+
+        lock.unlock();
+        for (auto& [follower, entry] : work) {
+            PumpResult result = pump(*follower, entry);
+            if (result != PumpResult::More) ended.emplace_back(follower, result);
+        }
+        for (auto& [follower, result] : ended) {
+            closeFollower(*follower, result == PumpResult::Complete);
+        }
+        lock.lock();
+
+        for (auto& [follower, result] : ended) followers_.erase(follower);
+
+        // Forget finished jobs once nobody is likely to ask for them again
+        auto cutoff = std::chrono::steady_clock::now() - FINISHED_RETENTION;
+        for (auto it = entries_.begin(); it != entries_.end(); ) {
+            bool inUse = std::any_of(followers_.begin(), followers_.end(),
+                                     [&](const Follower& f) { return f.id == it->first; });
+            if (it->second.state != State::Encoding && it->second.finished < cutoff && !inUse) {
+                it = entries_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+OutputStreamer::PumpResult OutputStreamer::pump(Follower& follower, const Entry& entry) {
+    // The entry was copied before the size is read: once the job is done, the size is final
+    bool done = entry.state != State::Encoding;
+    if (entry.state == State::Failed) return PumpResult::Abort;
+
+    if (follower.fd < 0) {
+        follower.fd = ::open(entry.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (follower.fd < 0) {
+            // ffmpeg has not created the file yet
+            return done ? PumpResult::Abort : PumpResult::More;
+        }
+    }
+
+    struct stat st;
+    if (fstat(follower.fd, &st) != 0) return PumpResult::Abort;
+    if (st.st_size < follower.offset) {
+        LOG_WARN << "Output of stream " << follower.id << " was truncated, ending stream";
+        return PumpResult::Abort;
+    }
+
+    if (entry.format == "wav" && !follower.headerSent) {
+        if (!sendWavHeader(follower, st.st_size, done)) return PumpResult::Abort;
+        if (!follower.headerSent) return PumpResult::More; // Header not fully written yet
+    }
+
+    size_t budget = MAX_BYTES_PER_POLL;
+    char buffer[64 * 1024];
+    while (follower.offset < st.st_size && budget > 0) {
+        size_t want = std::min({sizeof(buffer), budget, static_cast<size_t>(st.st_size - follower.offset)});
+        ssize_t n = pread(follower.fd, buffer, want, follower.offset);
+        if (n <= 0) break;
+        if (!follower.stream->send(std::string(buffer, static_cast<size_t>(n)))) {
+            return PumpResult::Abort; // Client went away
+        }
+        follower.offset += n;
+        budget -= static_cast<size_t>(n);
+    }
+
+    return done && follower.offset >= st.st_size ? PumpResult::Complete : PumpResult::More;
+}
+
+bool OutputStreamer::sendWavHeader(Follower& follower, off_t fileSize, bool done) {
+    // ffmpeg writes zero sizes and patches them when it finishes. A streamed
+    // header cannot be patched later, so mark both sizes as unknown instead.
+    char buffer[4096];
+    size_t want = std::min(sizeof(buffer), static_cast<size_t>(fileSize));
+    ssize_t n = pread(follower.fd, buffer, want, 0);
+    if (n < 0) return false;
+
+    std::string header(buffer, static_cast<size_t>(n));
+    size_t data = header.size() >= 12 ? header.find("data", 12) : std::string::npos;
+    if (data == std::string::npos || data + 8 > header.size()) {
+        if (!done) return true; // Wait for the rest of the header
+        follower.headerSent = true; // Finished but odd layout: send the file as is
+        return true;
+    }
+
+    header.resize(data + 8);
+    std::fill(header.begin() + 4, header.begin() + 8, '\xff');               // RIFF chunk size
+    std::fill(header.begin() + data + 4, header.begin() + data + 8, '\xff'); // data chunk size
+    if (!follower.stream->send(header)) return false;
+
+    follower.offset = static_cast<off_t>(header.size());
+    follower.headerSent = true;
+    return true;
+}
+
+void OutputStreamer::closeFollower(Follower& follower, bool complete) {
+    if (follower.fd >= 0) {
+        ::close(follower.fd);
+        follower.fd = -1;
+    }
+    if (!complete) {
+        // Queued on the connection's loop ahead of the final chunk that close()
+        // sends, which a closed connection then drops
+        if (auto connection = follower.connection.lock()) connection->forceClose();
+    }
+    if (follower.stream) {
+        follower.stream->close();
+        follower.stream.reset();
+    }
+}
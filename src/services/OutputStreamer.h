@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <drogon/HttpResponse.h>
+#include <trantor/net/TcpConnection.h>
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <sys/types.h>
+
+/**
+ * @class OutputStreamer
+ * @brief Serves a conversion output over HTTP while ffmpeg is still writing it.
+ *
+ * For formats that can be decoded from the first byte (MP3, ADTS AAC, Ogg
+ * Vorbis/Opus, WAV), the client gets a stream URL as soon as a worker starts
+ * the job. Each connected client is a follower with its own file descriptor and
+ * offset. A single pump thread polls the file size, sends the bytes written
+ * since the last poll as chunked transfer, and closes the stream once the job
+ * has finished and everything has been sent. If the job fails, the connection
+ * is cut without the final chunk, so clients see the file as incomplete.
+ *
+ * Followers read through their own descriptor, so they are not affected when
+ * the finished output is moved into `./www/downloads/`.
+ */
+class OutputStreamer {
+public:
+    static OutputStreamer& instance() {
+        static OutputStreamer inst;
+        return inst;
+    }
+
+    enum class State { Unknown, Encoding, Done, Failed };
+
+    /**
+     * @brief Whether the format can be played while it is being written.
+     */
+    static bool isStreamable(const std::string& format);
+
+    /**
+     * @brief Content type sent with the stream.
+     */
+    static std::string mimeType(const std::string& format);
+
+    /**
+     * @brief Registers the output of a job that has been queued.
+     * @param id Stream id used in `/api/stream/{id}`.
+     * @param path File ffmpeg writes to.
+     */
+    void open(const std::string& id, const std::string& path, const std::string& format);
+
+    /**
+     * @brief Marks the job as finished; followers drain the rest of the file and end.
+     * @param finalPath Where the output now lives (empty on failure).
+     * @param downloadUrl Public URL of the finished file, for late requests.
+     */
+    void finish(const std::string& id, bool success, const std::string& finalPath,
+                const std::string& downloadUrl);
+
+    /**
+     * @brief Looks up a stream.
+     * @param downloadUrl Set when the job is done.
+     * @param format Set for known streams.
+     */
+    State state(const std::string& id, std::string& downloadUrl, std::string& format);
+
+    /**
+     * @brief Adds a client to a stream. Unknown ids close the stream immediately.
+     * @param connection The client's connection, cut if the stream cannot be completed.
+     */
+    void attach(const std::string& id, drogon::ResponseStreamPtr stream,
+                std::weak_ptr<trantor::TcpConnection> connection);
+
+private:
+    OutputStreamer();
+    ~OutputStreamer();
+    OutputStreamer(const OutputStreamer&) = delete;
+    OutputStreamer& operator=(const OutputStreamer&) = delete;
+
+    struct Entry {
+        std::string path;
+        std::string format;
+        std::string downloadUrl;
+        State state = State::Encoding;
+        std::chrono::steady_clock::time_point finished;
+    };
+
+    // Only the pump thread touches a follower once it is in followers_
+    struct Follower {
+        std::string id;
+        drogon::ResponseStreamPtr stream;
+        std::weak_ptr<trantor::TcpConnection> connection;
+        int fd = -1;
+        off_t offset = 0;
+        bool headerSent = false; // WAV only: header patched and sent
+    };
+
+    enum class PumpResult { More, Complete, Abort };
+
+    void pumpLoop();
+    // Sends newly written bytes. Runs without mutex_ held, on a copy of the entry.
+    PumpResult pump(Follower& follower, const Entry& entry);
+    // Sends the WAV header with its size fields set to "unknown" (0xFFFFFFFF)
+    bool sendWavHeader(Follower& follower, off_t fileSize, bool done);
+    // Ends the response; without complete, cuts the connection before the final chunk
+    void closeFollower(Follower& follower, bool complete);
+
+    std::unordered_map<std::string, Entry> entries_;
+    std::list<Follower> followers_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::thread thread_;
+    bool stop_ = false;
+
+    const std::chrono::milliseconds POLL_INTERVAL{100};
+    const size_t MAX_BYTES_PER_POLL = 1024 * 1024; // Per follower, bounds the time spent per poll
+    const std::chrono::minutes FINISHED_RETENTION{10};
+};
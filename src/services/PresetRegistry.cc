@@ -0,0 +1,310 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#include "PresetRegistry.h"
+#include "ProcessRunner.h"
+#include <drogon/drogon.h>
+#include <trantor/utils/Logger.h>
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <set>
+#include <sstream>
+
+namespace {
+
+struct BuiltinPreset {
+    const char* format;
+    const char* quality;
+    const char* variant;
+    const char* codec;
+    const char* args; // Space-separated
+    int bitrateKbps;  // Typical average for VBR presets (LAME -q:a 2 ~190k, Vorbis -q:a 4 ~128k)
+    double cost;
+    double sizeRatio; // Lossy formats rarely exceed the source video; PCM and FLAC can be several times larger
+    const char* extension;
+};
+
+// Fast variants trade a little quality per bit for encode speed: a cheaper LAME
+// psychoacoustic model, the fast AAC coder, lower Opus and FLAC complexity.
+// Costs are relative encode times per media second measured against mp3/medium.
+constexpr BuiltinPreset BUILTIN_PRESETS[] = {
+    // format, quality, variant, codec, args, kbps, cost, size ratio, extension
+    {"mp3", "high",    "",     "libmp3lame", "-b:a 320k",                              320, 1.0, 1, "mp3"},
+    {"mp3", "medium",  "",     "libmp3lame", "-q:a 2",                                 190, 1.0, 1, "mp3"},
+    {"mp3", "low",     "",     "libmp3lame", "-q:a 5",                                 130, 1.0, 1, "mp3"},
+    {"mp3", "podcast", "",     "libmp3lame", "-b:a 64k -ac 1",                          64, 0.8, 1, "mp3"},
+    {"mp3", "high",    "fast", "libmp3lame", "-b:a 320k -compression_level 7",         320, 0.6, 1, "mp3"},
+    {"mp3", "medium",  "fast", "libmp3lame", "-q:a 2 -compression_level 7",            190, 0.6, 1, "mp3"},
+    {"mp3", "low",     "fast", "libmp3lame", "-q:a 5 -compression_level 7",            130, 0.6, 1, "mp3"},
+    {"mp3", "podcast", "fast", "libmp3lame", "-b:a 64k -ac 1 -compression_level 7",     64, 0.5, 1, "mp3"},
+
+    {"wav", "high",    "",     "pcm_s16le",  "",                                         0, 0.1, 4, "wav"},
+    {"wav", "medium",  "",     "pcm_s16le",  "",                                         0, 0.1, 4, "wav"},
+    {"wav", "low",     "",     "pcm_s16le",  "",                                         0, 0.1, 4, "wav"},
+    {"wav", "podcast", "",     "pcm_s16le",  "-ar 22050 -ac 1",                          0, 0.1, 4, "wav"},
+
+    {"ogg", "high",    "",     "libvorbis",  "-q:a 6",                                 192, 1.4, 1, "ogg"},
+    {"ogg", "medium",  "",     "libvorbis",  "-q:a 4",                                 128, 1.4, 1, "ogg"},
+    {"ogg", "low",     "",     "libvorbis",  "-q:a 3",                                 112, 1.4, 1, "ogg"},
+    {"ogg", "podcast", "",     "libvorbis",  "-q:a 1 -ac 1",                            64, 1.0, 1, "ogg"},
+
+    {"aac", "high",    "",     "aac",        "-b:a 256k",                              256, 0.9, 1, "aac"},
+    {"aac", "medium",  "",     "aac",        "-b:a 192k",                              192, 0.9, 1, "aac"},
+    {"aac", "low",     "",     "aac",        "-b:a 128k",                              128, 0.9, 1, "aac"},
+    {"aac", "podcast", "",     "aac",        "-b:a 64k -ac 1",                          64, 0.7, 1, "aac"},
+    {"aac", "high",    "fast", "aac",        "-b:a 256k -aac_coder fast",              256, 0.6, 1, "aac"},
+    {"aac", "medium",  "fast", "aac",        "-b:a 192k -aac_coder fast",              192, 0.6, 1, "aac"},
+    {"aac", "low",     "fast", "aac",        "-b:a 128k -aac_coder fast",              128, 0.6, 1, "aac"},
+    {"aac", "podcast", "fast", "aac",        "-b:a 64k -ac 1 -aac_coder fast",          64, 0.5, 1, "aac"},
+
+    {"flac", "high",    "",     "flac",      "",                                         0, 0.3, 2, "flac"},
+    {"flac", "medium",  "",     "flac",      "",                                         0, 0.3, 2, "flac"},
+    {"flac", "low",     "",     "flac",      "",                                         0, 0.3, 2, "flac"},
+    {"flac", "podcast", "",     "flac",      "-ar 22050 -ac 1",                          0, 0.2, 2, "flac"},
+    {"flac", "high",    "fast", "flac",      "-compression_level 0",                     0, 0.15, 2, "flac"},
+    {"flac", "medium",  "fast", "flac",      "-compression_level 0",                     0, 0.15, 2, "flac"},
+    {"flac", "low",     "fast", "flac",      "-compression_level 0",                     0, 0.15, 2, "flac"},
+    {"flac", "podcast", "fast", "flac",      "-ar 22050 -ac 1 -compression_level 0",     0, 0.1, 2, "flac"},
+
+    {"m4a", "high",    "",     "aac",        "-b:a 256k",                              256, 0.9, 1, "m4a"},
+    {"m4a", "medium",  "",     "aac",        "-b:a 192k",                              192, 0.9, 1, "m4a"},
+    {"m4a", "low",     "",     "aac",        "-b:a 128k",                              128, 0.9, 1, "m4a"},
+    {"m4a", "podcast", "",     "aac",        "-b:a 64k -ac 1",                          64, 0.7, 1, "m4a"},
+    {"m4a", "high",    "fast", "aac",        "-b:a 256k -aac_coder fast",              256, 0.6, 1, "m4a"},
+    {"m4a", "medium",  "fast", "aac",        "-b:a 192k -aac_coder fast",              192, 0.6, 1, "m4a"},
+    {"m4a", "low",     "fast", "aac",        "-b:a 128k -aac_coder fast",              128, 0.6, 1, "m4a"},
+    {"m4a", "podcast", "fast", "aac",        "-b:a 64k -ac 1 -aac_coder fast",          64, 0.5, 1, "m4a"},
+
+    {"opus", "high",    "",     "libopus",   "-b:a 192k",                              192, 0.8, 1, "opus"},
+    {"opus", "medium",  "",     "libopus",   "-b:a 128k",                              128, 0.8, 1, "opus"},
+    {"opus", "low",     "",     "libopus",   "-b:a 96k",                                96, 0.8, 1, "opus"},
+    {"opus", "podcast", "",     "libopus",   "-b:a 48k -ac 1",                          48, 0.6, 1, "opus"},
+    {"opus", "high",    "fast", "libopus",   "-b:a 192k -compression_level 5",         192, 0.5, 1, "opus"},
+    {"opus", "medium",  "fast", "libopus",   "-b:a 128k -compression_level 5",         128, 0.5, 1, "opus"},
+    {"opus", "low",     "fast", "libopus",   "-b:a 96k -compression_level 5",           96, 0.5, 1, "opus"},
+    {"opus", "podcast", "fast", "libopus",   "-b:a 48k -ac 1 -compression_level 5",     48, 0.4, 1, "opus"},
+};
+
+constexpr const char* BASE_QUALITIES[] = {"high", "medium", "low", "podcast"};
+
+constexpr bool sameText(const char* a, const char* b) {
+    while (*a != '\0' && *a == *b) {
+        ++a;
+        ++b;
+    }
+    return *a == *b;
+}
+
+constexpr bool hasPreset(const char* format, const char* quality, const char* variant) {
+    for (const auto& p : BUILTIN_PRESETS) {
+        if (sameText(p.format, format) && sameText(p.quality, quality) && sameText(p.variant, variant)) return true;
+    }
+    return false;
+}
+
+constexpr bool fieldsValid() {
+    for (const auto& p : BUILTIN_PRESETS) {
+        if (*p.format == '\0' || *p.quality == '\0' || *p.codec == '\0' || *p.extension == '\0') return false;
+        if (p.bitrateKbps < 0 || p.cost <= 0 || p.sizeRatio <= 0) return false;
+    }
+    return true;
+}
+
+constexpr bool noDuplicates() {
+    constexpr size_t count = std::size(BUILTIN_PRESETS);
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t j = i + 1; j < count; ++j) {
+            const auto& a = BUILTIN_PRESETS[i];
+            const auto& b = BUILTIN_PRESETS[j];
+            if (sameText(a.format, b.format) && sameText(a.quality, b.quality) && sameText(a.variant, b.variant)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Requests fall back to "medium" and to the default variant, so both must exist
+constexpr bool qualitiesComplete() {
+    for (const auto& p : BUILTIN_PRESETS) {
+        for (const char* quality : BASE_QUALITIES) {
+            if (!hasPreset(p.format, quality, "")) return false;
+        }
+        if (*p.variant != '\0' && !hasPreset(p.format, p.quality, "")) return false;
+    }
+    return true;
+}
+
+static_assert(fieldsValid(), "Built-in preset with an empty field or a non-positive cost");
+static_assert(noDuplicates(), "Built-in preset listed twice");
+static_assert(qualitiesComplete(), "Built-in format missing a quality or the default of a variant");
+
+std::vector<std::string> splitArgs(const char* text) {
+    std::vector<std::string> args;
+    std::istringstream stream(text);
+    std::string arg;
+    while (stream >> arg) args.push_back(arg);
+    return args;
+}
+
+// Names end up in file names and URLs: lowercase letters, digits and underscores only
+bool validToken(const std::string& text) {
+    return !text.empty() && text.size() <= 16 &&
+           std::all_of(text.begin(), text.end(), [](char c) {
+               return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_';
+           });
+}
+
+} // namespace
+
+std::vector<std::string> EncoderPreset::codecArgs() const {
+    std::vector<std::string> result = {"-acodec", codec};
+    result.insert(result.end(), args.begin(), args.end());
+    return result;
+}
+
+std::string EncoderPreset::name() const {
+    return variant.empty() ? format + "/" + quality : format + "/" + quality + "/" + variant;
+}
+
+PresetRegistry::PresetRegistry() {
+    for (const auto& builtin : BUILTIN_PRESETS) {
+        EncoderPreset preset;
+        preset.format = builtin.format;
+        preset.quality = builtin.quality;
+        preset.variant = builtin.variant;
+        preset.codec = builtin.codec;
+        preset.args = splitArgs(builtin.args);
+        preset.bitrate = static_cast<int64_t>(builtin.bitrateKbps) * 1000;
+        preset.cost = builtin.cost;
+        preset.sizeRatio = builtin.sizeRatio;
+        preset.extension = builtin.extension;
+        presets_[preset.name()] = preset;
+        if (std::find(formats_.begin(), formats_.end(), preset.format) == formats_.end()) {
+            formats_.push_back(preset.format);
+        }
+    }
+
+    // Optional overrides from config.json (custom_config.presets)
+    auto config = drogon::app().getCustomConfig()["presets"];
+    fastFraction_ = std::clamp(config.get("fast_fraction", 0.0).asDouble(), 0.0, 1.0);
+    loadCustom();
+    validateEncoders();
+
+    // A format stays available while it still has a default preset
+    formats_.erase(std::remove_if(formats_.begin(), formats_.end(),
+                                  [this](const std::string& format) { return !hasFormat(format); }),
+                   formats_.end());
+    for (const auto& format : formats_) {
+        if (!formatList_.empty()) formatList_ += ", ";
+        formatList_ += format;
+    }
+    LOG_INFO << "Loaded " << presets_.size() << " encoder presets for " << formatList_;
+}
+
+void PresetRegistry::loadCustom() {
+    const Json::Value& custom = drogon::app().getCustomConfig()["presets"]["custom"];
+    if (!custom.isArray()) return;
+
+    for (const auto& entry : custom) {
+        EncoderPreset preset;
+        preset.format = entry.get("format", "").asString();
+        preset.quality = entry.get("quality", "").asString();
+        preset.variant = entry.get("variant", "").asString();
+        if (!validToken(preset.format) || !validToken(preset.quality) ||
+            (!preset.variant.empty() && !validToken(preset.variant))) {
+            LOG_ERROR << "Ignoring custom preset with an invalid format, quality or variant";
+            continue;
+        }
+
+        // Unset fields come from the preset being replaced, or from the default variant
+        auto base = presets_.find(preset.name());
+        if (base == presets_.end()) base = presets_.find(preset.format + "/" + preset.quality);
+        if (base != presets_.end()) {
+            std::string variant = preset.variant;
+            preset = base->second;
+            preset.variant = variant;
+        } else {
+            preset.extension = preset.format;
+        }
+
+        if (entry.isMember("codec")) preset.codec = entry["codec"].asString();
+        if (entry["args"].isArray()) {
+            preset.args.clear();
+            for (const auto& arg : entry["args"]) preset.args.push_back(arg.asString());
+        }
+        if (entry.isMember("bitrate_kbps")) preset.bitrate = entry["bitrate_kbps"].asInt64() * 1000;
+        if (entry.isMember("cost")) preset.cost = entry["cost"].asDouble();
+        if (entry.isMember("size_ratio")) preset.sizeRatio = entry["size_ratio"].asDouble();
+        if (entry.isMember("extension")) preset.extension = entry["extension"].asString();
+
+        if (preset.codec.empty() || !validToken(preset.extension) || preset.cost <= 0 || preset.sizeRatio <= 0) {
+            LOG_ERROR << "Ignoring custom preset " << preset.name() << ": needs a codec, an extension and positive cost and size_ratio";
+            continue;
+        }
+        LOG_INFO << (presets_.count(preset.name()) ? "Overriding" : "Adding") << " preset " << preset.name();
+        presets_[preset.name()] = preset;
+        if (std::find(formats_.begin(), formats_.end(), preset.format) == formats_.end()) {
+            formats_.push_back(preset.format);
+        }
+    }
+}
+
+void PresetRegistry::validateEncoders() {
+    // Encoder lines look like " A....D libmp3lame           libmp3lame MP3 (MPEG audio layer 3)"
+    std::set<std::string> encoders;
+    ProcessResult result = ProcessRunner::run({"ffmpeg", "-hide_banner", "-encoders"},
+        [&encoders](const std::string& line) {
+            std::istringstream stream(line);
+            std::string flags, name;
+            if (!(stream >> flags >> name) || flags.size() != 6 || flags == "------") return;
+            if (flags[0] == 'A') encoders.insert(name);
+        },
+        std::chrono::seconds(10));
+
+    if (!result.success() || encoders.empty()) {
+        LOG_WARN << "Cannot list ffmpeg encoders, presets are not validated";
+        return;
+    }
+
+    for (auto it = presets_.begin(); it != presets_.end(); ) {
+        if (encoders.count(it->second.codec) == 0) {
+            LOG_WARN << "Disabling preset " << it->first << ": ffmpeg has no " << it->second.codec << " encoder";
+            it = presets_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+const EncoderPreset* PresetRegistry::find(const std::string& format, const std::string& quality,
+                                          const std::string& variant) const {
+    if (!variant.empty()) {
+        auto it = presets_.find(format + "/" + quality + "/" + variant);
+        if (it != presets_.end()) return &it->second;
+    }
+    auto it = presets_.find(format + "/" + quality);
+    return it == presets_.end() ? nullptr : &it->second;
+}
+
+bool PresetRegistry::hasFormat(const std::string& format) const {
+    // Names start with "format/", so one format's presets are adjacent in the map
+    auto it = presets_.lower_bound(format + "/");
+    for (; it != presets_.end() && it->second.format == format; ++it) {
+        if (it->second.variant.empty()) return true;
+    }
+    return false;
+}
+
+std::string PresetRegistry::defaultVariant() const {
+    if (fastFraction_ <= 0) return "";
+    thread_local std::mt19937 generator(std::random_device{}());
+    return std::uniform_real_distribution<double>(0, 1)(generator) < fastFraction_ ? "fast" : "";
+}
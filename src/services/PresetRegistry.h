@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+/**
+ * @brief Encoder settings for one (format, quality, variant) combination.
+ */
+struct EncoderPreset {
+    std::string format;
+    std::string quality;
+    std::string variant;           // Empty for the default variant, e.g. "fast"
+    std::string codec;             // ffmpeg encoder name
+    std::vector<std::string> args; // Encoder options after `-acodec <codec>`
+    int64_t bitrate = 0;           // Typical output bits/s, 0 for lossless formats
+    double cost = 1.0;             // Encode time per media second, relative to mp3/medium
+    double sizeRatio = 1.0;        // Upper bound of output bytes per input byte
+    std::string extension;         // Output file extension, without the dot
+
+    // `-acodec <codec>` followed by args
+    std::vector<std::string> codecArgs() const;
+    // "format/quality" or "format/quality/variant"
+    std::string name() const;
+};
+
+/**
+ * @class PresetRegistry
+ * @brief Table of encoder presets for every supported format and quality.
+ *
+ * The built-in presets are a constexpr table checked with static_assert (every
+ * format has all four qualities, every speed variant has a default to fall back
+ * to). `custom_config.presets.custom` adds or overrides entries at startup. Each
+ * preset's encoder is then checked against `ffmpeg -encoders`, and presets whose
+ * encoder this ffmpeg lacks are dropped, so requests fail validation instead of
+ * failing in a worker.
+ *
+ * The table is built once in the constructor and never modified, so lookups
+ * need no locking.
+ */
+class PresetRegistry {
+public:
+    static PresetRegistry& instance() {
+        static PresetRegistry instance;
+        return instance;
+    }
+
+    PresetRegistry(const PresetRegistry&) = delete;
+    void operator=(const PresetRegistry&) = delete;
+
+    /**
+     * @brief Looks up a preset.
+     * @param variant Speed variant; falls back to the default variant if the
+     *        format has no such variant for this quality.
+     * @return nullptr if the format or quality is unknown.
+     */
+    const EncoderPreset* find(const std::string& format, const std::string& quality,
+                              const std::string& variant = "") const;
+
+    bool hasFormat(const std::string& format) const;
+
+    // Supported formats in table order, e.g. "mp3, wav, ogg"
+    const std::string& formatList() const { return formatList_; }
+
+    /**
+     * @brief Variant for a request that did not ask for one: "fast" for
+     *        `fast_fraction` of requests, so both can be compared in the job trace.
+     */
+    std::string defaultVariant() const;
+
+private:
+    PresetRegistry();
+    ~PresetRegistry() = default;
+
+    // Reads custom_config.presets.custom; entries replace built-ins with the same name
+    void loadCustom();
+    // Drops presets whose encoder `ffmpeg -encoders` does not list
+    void validateEncoders();
+
+    std::map<std::string, EncoderPreset> presets_; // By name()
+    std::vector<std::string> formats_;             // Table order
+    std::string formatList_;
+    double fastFraction_ = 0;
+};
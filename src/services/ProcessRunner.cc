@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#include "ProcessRunner.h"
+#include <trantor/utils/Logger.h>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+ProcessResult ProcessRunner::run(const std::vector<std::string>& args,
+                                 const LineCallback& onStdoutLine,
+                                 std::chrono::milliseconds timeout,
+                                 const std::atomic<bool>* cancel,
+                                 ChildHandle* child) {
+    ProcessResult result;
+    if (args.empty()) return result;
+
+    // Build argv before forking: only async-signal-safe calls are allowed in
+    // the child of a multi-threaded process.
+    std::vector<char*> cargs;
+    for (const auto& arg : args) {
+        cargs.push_back(const_cast<char*>(arg.c_str()));
+    }
+    cargs.push_back(nullptr);
+
+    int pipeFds[2] = {-1, -1};
+    if (onStdoutLine && pipe2(pipeFds, O_CLOEXEC) != 0) {
+        LOG_ERROR << "Failed to create pipe for " << args[0];
+        return result;
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        LOG_ERROR << "Failed to fork";
+        if (pipeFds[0] != -1) {
+            close(pipeFds[0]);
+            close(pipeFds[1]);
+        }
+        return result;
+    }
+
+    if (pid == 0) {
+        // Child process: stdout goes to the pipe (if requested), stderr to /dev/null.
+        // Low-level dup2 avoids "ignoring return value of freopen" warnings and is safer after fork.
+        int devNull = open("/dev/null", O_WRONLY);
+        if (pipeFds[1] != -1) {
+            dup2(pipeFds[1], STDOUT_FILENO);
+        } else if (devNull != -1) {
+            dup2(devNull, STDOUT_FILENO);
+        }
+        if (devNull != -1) {
+            dup2(devNull, STDERR_FILENO);
+            close(devNull);
+        }
+
+        execvp(cargs[0], cargs.data());
+
+        // If execvp returns, it failed
+        _exit(127);
+    }
+
+    // Parent process
+    result.started = true;
+    if (child) {
+        child->stdoutFd = pipeFds[0];
+        child->pid = pid;
+    }
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    bool limited = timeout.count() > 0;
+    // With a cancel flag, waits are cut into short slices so the flag is seen promptly
+    const int cancelSliceMs = 200;
+
+    if (pipeFds[0] != -1) {
+        close(pipeFds[1]);
+        std::string pending;
+        char buf[4096];
+        while (true) {
+            int waitMs = -1;
+            if (limited) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now()).count();
+                if (left <= 0) {
+                    result.timedOut = true;
+                    break;
+                }
+                waitMs = static_cast<int>(left);
+            }
+            if (cancel) {
+                if (cancel->load()) {
+                    result.cancelled = true;
+                    break;
+                }
+                if (waitMs < 0 || waitMs > cancelSliceMs) waitMs = cancelSliceMs;
+            }
+
+            struct pollfd pfd = {pipeFds[0], POLLIN, 0};
+            int ready = poll(&pfd, 1, waitMs);
+            if (ready < 0 && errno == EINTR) continue;
+            if (ready == 0) continue; // Deadline is re-checked above
+
+            ssize_t n = read(pipeFds[0], buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break; // EOF: child closed stdout
+
+            pending.append(buf, static_cast<size_t>(n));
+            size_t start = 0, nl;
+            while ((nl = pending.find('\n', start)) != std::string::npos) {
+                onStdoutLine(pending.substr(start, nl - start));
+                start = nl + 1;
+            }
+            pending.erase(0, start);
+        }
+        if (!pending.empty() && !result.timedOut && !result.cancelled) onStdoutLine(pending);
+        if (child) child->stdoutFd = -1;
+        close(pipeFds[0]);
+    } else if (limited || cancel) {
+        // No output to read: poll for exit until the deadline or cancellation
+        while (!result.timedOut && !result.cancelled) {
+            int status = 0;
+            struct rusage usage = {};
+            pid_t r = wait4(pid, &status, WNOHANG, &usage);
+            if (r == pid) {
+                if (child) child->pid = 0;
+                result.exited = WIFEXITED(status);
+                result.exitCode = result.exited ? WEXITSTATUS(status) : -1;
+                result.peakRssKb = usage.ru_maxrss;
+                return result;
+            }
+            if (limited && std::chrono::steady_clock::now() >= deadline) {
+                result.timedOut = true;
+            } else if (cancel && cancel->load()) {
+                result.cancelled = true;
+            } else {
+                usleep(20000);
+            }
+        }
+    }
+
+    if (result.timedOut) {
+        LOG_WARN << args[0] << " timed out, killing pid " << pid;
+        kill(pid, SIGKILL);
+    } else if (result.cancelled) {
+        LOG_INFO << args[0] << " cancelled, killing pid " << pid;
+        kill(pid, SIGKILL);
+    }
+
+    // wait4 also reaps the child's resource usage; ru_maxrss is in kilobytes on Linux
+    int status = 0;
+    struct rusage usage = {};
+    while (wait4(pid, &status, 0, &usage) == -1 && errno == EINTR) {}
+    if (child) child->pid = 0;
+    result.exited = WIFEXITED(status);
+    result.exitCode = result.exited ? WEXITSTATUS(status) : -1;
+    result.peakRssKb = usage.ru_maxrss;
+    return result;
+}
+
+uint64_t ProcessRunner::startTime(int pid) {
+    std::ifstream file("/proc/" + std::to_string(pid) + "/stat");
+    std::string stat;
+    if (pid <= 0 || !std::getline(file, stat)) return 0;
+
+    // The command name in parentheses may contain spaces; fields resume after the last ')'
+    size_t end = stat.rfind(')');
+    if (end == std::string::npos) return 0;
+    std::istringstream fields(stat.substr(end + 2));
+    std::string field;
+    // starttime is field 22 of the line, the 20th after the command name
+    for (int i = 0; i < 20 && fields >> field; ++i) {}
+    return fields ? std::strtoull(field.c_str(), nullptr, 10) : 0;
+}
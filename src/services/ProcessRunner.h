@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @brief Outcome of a child process started by ProcessRunner.
+ */
+struct ProcessResult {
+    bool started = false;   // fork() succeeded
+    bool exited = false;    // Child exited normally (not killed by a signal)
+    int exitCode = -1;
+    bool timedOut = false;  // Killed because the timeout elapsed
+    bool cancelled = false; // Killed because the cancel flag was set
+    long peakRssKb = 0;     // Maximum resident set size of the child (wait4 rusage)
+
+    bool success() const { return exited && exitCode == 0; }
+    // execvp() failed in the child (command not installed)
+    bool notFound() const { return exited && exitCode == 127; }
+};
+
+/**
+ * @brief A running child as seen from other threads than the one waiting for it.
+ */
+struct ChildHandle {
+    std::atomic<int> pid{0};       // 0 before the fork and once the child is reaped
+    std::atomic<int> stdoutFd{-1}; // Read end of the stdout pipe, -1 without one
+};
+
+/**
+ * @class ProcessRunner
+ * @brief Runs external commands (ffmpeg, ffprobe, zip) without a shell.
+ *
+ * Uses fork/execvp so arguments are passed directly to the executable and are
+ * never interpreted by `/bin/sh`. stderr is discarded; stdout is discarded
+ * unless a line callback is given, in which case it is read through a pipe
+ * and delivered line by line (used for `ffprobe` output and `ffmpeg -progress`).
+ */
+class ProcessRunner {
+public:
+    using LineCallback = std::function<void(const std::string& line)>;
+
+    /**
+     * @brief Runs a command and waits for it to finish.
+     * @param args Command and arguments (args[0] is looked up in PATH).
+     * @param onStdoutLine Optional callback receiving each line written to stdout.
+     * @param timeout Kill the child after this long (0 = no limit).
+     * @param cancel Optional flag checked while waiting; the child is killed once it is set.
+     * @param child Optional; describes the child while it runs (see ChildHandle).
+     */
+    static ProcessResult run(const std::vector<std::string>& args,
+                             const LineCallback& onStdoutLine = nullptr,
+                             std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+                             const std::atomic<bool>* cancel = nullptr,
+                             ChildHandle* child = nullptr);
+
+    /**
+     * @brief Start time of a process in clock ticks since boot (`/proc/<pid>/stat`),
+     *        0 if it does not exist. Together with the pid it identifies a process
+     *        even after the pid is reused.
+     */
+    static uint64_t startTime(int pid);
+};
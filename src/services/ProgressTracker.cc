@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#include "ProgressTracker.h"
+#include <algorithm>
+#include <cctype>
+
+ProgressTracker::ClaimResult ProgressTracker::claim(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (jobs_.size() > MAX_ENTRIES_BEFORE_CLEANUP) {
+        cleanupStaleEntries();
+    }
+
+    auto it = jobs_.find(id);
+    if (it != jobs_.end() && live(it->second.state)) return ClaimResult::InUse;
+    // Live entries are never cleaned up, so each client may only hold a few
+    auto count = liveCount_.find(id.substr(0, id.rfind('/') + 1));
+    if (count != liveCount_.end() && count->second >= MAX_LIVE_PER_CLIENT) return ClaimResult::TooMany;
+    reset(id);
+    return ClaimResult::Claimed;
+}
+
+ProgressTracker::Entry& ProgressTracker::reset(const std::string& id) {
+    auto [it, inserted] = jobs_.try_emplace(id);
+    Entry& entry = it->second;
+    if (inserted) {
+        entry.client = id.substr(0, id.rfind('/') + 1);
+        entry.state = State::Failed; // Not live until the reset below
+    }
+    setState(entry, State::Queued);
+    entry.durationSeconds = 0;
+    entry.processedSeconds = 0;
+    entry.parts.clear();
+    entry.downloadUrl.clear();
+    entry.updated = std::chrono::steady_clock::now();
+    return entry;
+}
+
+void ProgressTracker::setState(Entry& entry, State state) {
+    if (live(entry.state) && !live(state)) {
+        auto count = liveCount_.find(entry.client);
+        if (count != liveCount_.end() && --count->second == 0) liveCount_.erase(count);
+    } else if (!live(entry.state) && live(state)) {
+        ++liveCount_[entry.client];
+    }
+    entry.state = state;
+}
+
+void ProgressTracker::start(const std::string& id, double durationSeconds) {
+    if (id.empty()) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Periodic cleanup to prevent memory growth, same policy as RateLimiter
+    if (jobs_.size() > MAX_ENTRIES_BEFORE_CLEANUP) {
+        cleanupStaleEntries();
+    }
+
+    reset(id).durationSeconds = durationSeconds;
+}
+
+void ProgressTracker::update(const std::string& id, double processedSeconds, size_t part) {
+    if (id.empty()) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = jobs_.find(id);
+    if (it == jobs_.end()) return;
+
+    Entry& entry = it->second;
+    if (!live(entry.state)) return; // A late report must not revive a finished job
+    if (entry.parts.size() <= part) entry.parts.resize(part + 1, 0);
+    entry.parts[part] = processedSeconds;
+
+    setState(entry, State::Running);
+    entry.processedSeconds = 0;
+    for (double seconds : entry.parts) entry.processedSeconds += seconds;
+    entry.updated = std::chrono::steady_clock::now();
+}
+
+void ProgressTracker::finish(const std::string& id, bool success) {
+    if (id.empty()) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = jobs_.find(id);
+    if (it == jobs_.end()) return;
+    setState(it->second, success ? State::Done : State::Failed);
+    if (success) it->second.processedSeconds = it->second.durationSeconds;
+    it->second.updated = std::chrono::steady_clock::now();
+}
+
+void ProgressTracker::setDownloadUrl(const std::string& id, const std::string& url) {
+    if (id.empty()) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = jobs_.find(id);
+    if (it == jobs_.end()) return;
+    it->second.downloadUrl = url;
+    it->second.updated = std::chrono::steady_clock::now();
+}
+
+Json::Value ProgressTracker::get(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = jobs_.find(id);
+    if (it == jobs_.end()) return Json::Value();
+
+    static const char* stateNames[] = {"queued", "running", "done", "failed"};
+    const Entry& entry = it->second;
+
+    Json::Value json;
+    json["state"] = stateNames[static_cast<int>(entry.state)];
+    json["duration"] = entry.durationSeconds;
+    json["processed"] = entry.processedSeconds;
+    if (entry.durationSeconds > 0) {
+        double percent = 100.0 * entry.processedSeconds / entry.durationSeconds;
+        json["percent"] = std::min(100, static_cast<int>(percent));
+    }
+    if (!entry.downloadUrl.empty()) json["download_url"] = entry.downloadUrl;
+    return json;
+}
+
+bool ProgressTracker::isValidId(const std::string& id) {
+    if (id.empty() || id.size() > 64) return false;
+    return std::all_of(id.begin(), id.end(), [](char c) { return isalnum(c) || c == '-'; });
+}
+
+std::string ProgressTracker::key(const std::string& clientIP, const std::string& id) {
+    return clientIP + "/" + id;
+}
+
+void ProgressTracker::cleanupStaleEntries() {
+    auto cutoff = std::chrono::steady_clock::now() - FINISHED_RETENTION;
+    for (auto it = jobs_.begin(); it != jobs_.end(); ) {
+        // A job waiting in a deep queue must keep its entry (and its claim on the id)
+        if (!live(it->second.state) && it->second.updated < cutoff) {
+            it = jobs_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
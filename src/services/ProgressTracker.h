@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <json/json.h>
+
+/**
+ * @class ProgressTracker
+ * @brief Thread-safe registry of per-job conversion progress.
+ *
+ * The expected duration comes from the upload probe, and workers report how
+ * much media ffmpeg has processed (`-progress pipe:1`). Clients poll
+ * `/api/progress/{id}` with the id they submitted, so the UI shows real
+ * progress instead of a simulated bar. Entries are stored under key(), which
+ * scopes the client-chosen id to the submitting IP.
+ */
+class ProgressTracker {
+public:
+    static ProgressTracker& instance() {
+        static ProgressTracker inst;
+        return inst;
+    }
+
+    enum class State { Queued, Running, Done, Failed };
+
+    enum class ClaimResult { Claimed, InUse, TooMany };
+
+    /**
+     * @brief Reserves a client supplied id for a new job as soon as the request
+     *        arrives, so two jobs never share an entry.
+     * @param id Entry key (see key()).
+     * @return InUse while another job with this id is queued or running, TooMany
+     *         when the client already has MAX_LIVE_PER_CLIENT queued or running entries.
+     */
+    ClaimResult claim(const std::string& id);
+
+    /**
+     * @brief Registers a job when it is queued, replacing the entry claimed for it.
+     * @param id Progress id (see claim()).
+     * @param durationSeconds Expected media duration (0 if unknown).
+     */
+    void start(const std::string& id, double durationSeconds);
+
+    /**
+     * @brief Records how many seconds of media have been processed.
+     * @param part Index of the reporting part when a job is split into segments;
+     *             the job's progress is the sum over its parts.
+     */
+    void update(const std::string& id, double processedSeconds, size_t part = 0);
+
+    void finish(const std::string& id, bool success);
+
+    /**
+     * @brief Publishes the output URL of a finished job in get(), so a client
+     *        whose request was cut off (e.g. by a restart) can still fetch it.
+     */
+    void setDownloadUrl(const std::string& id, const std::string& url);
+
+    /**
+     * @brief Progress snapshot as JSON, or a null value if the id is unknown.
+     */
+    Json::Value get(const std::string& id);
+
+    /**
+     * @brief Accepts only short alphanumeric/dash ids (e.g. a UUID).
+     */
+    static bool isValidId(const std::string& id);
+
+    /**
+     * @brief Entry key of a client's progress id. Ids are chosen by clients, so
+     *        another client guessing one must not see its entry (or download_url).
+     */
+    static std::string key(const std::string& clientIP, const std::string& id);
+
+private:
+    ProgressTracker() = default;
+    ~ProgressTracker() = default;
+    ProgressTracker(const ProgressTracker&) = delete;
+    ProgressTracker& operator=(const ProgressTracker&) = delete;
+
+    struct Entry {
+        std::string client; // Part of the key before the id, for the per-client count
+        State state = State::Queued;
+        double durationSeconds = 0;
+        double processedSeconds = 0;
+        std::vector<double> parts; // Per-segment progress, summed into processedSeconds
+        std::string downloadUrl;
+        std::chrono::steady_clock::time_point updated;
+    };
+
+    static bool live(State state) { return state == State::Queued || state == State::Running; }
+
+    // Resets the entry of a new job, counting it as live for its client
+    Entry& reset(const std::string& id);
+    // Moves an entry to a new state and keeps liveCount_ in step
+    void setState(Entry& entry, State state);
+
+    // Remove finished entries nobody has polled for a while; live ones stay
+    void cleanupStaleEntries();
+
+    std::unordered_map<std::string, Entry> jobs_;
+    std::unordered_map<std::string, size_t> liveCount_; // Queued or running entries per client
+    std::mutex mutex_;
+
+    const size_t MAX_ENTRIES_BEFORE_CLEANUP = 1000;
+    const size_t MAX_LIVE_PER_CLIENT = 32;
+    const std::chrono::minutes FINISHED_RETENTION{10};
+};
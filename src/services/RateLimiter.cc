@@ -9,6 +9,8 @@
 
 #include "RateLimiter.h"
 #include <trantor/utils/Logger.h>
+#include <algorithm>
+#include <iterator>
 
 bool RateLimiter::isAllowed(const std::string& ipAddress) {
     std::lock_guard<std::mutex> lock(mutex_);
@@ -38,6 +40,53 @@ bool RateLimiter::isAllowed(const std::string& ipAddress) {
     return true;
 }
 
+bool RateLimiter::consumeMediaSeconds(const std::string& ipAddress, double seconds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto& history = ipHistory_[ipAddress];
+    cleanup(history);
+
+    if (history.mediaTotal + seconds > MAX_MEDIA_SECONDS_PER_WINDOW) {
+        LOG_WARN << "Media budget exceeded for IP: " << ipAddress
+                 << " (" << history.mediaTotal << "s used, " << seconds << "s requested)";
+        return false;
+    }
+
+    history.mediaSeconds.emplace_back(std::chrono::steady_clock::now(), seconds);
+    history.mediaTotal += seconds;
+    return true;
+}
+
+void RateLimiter::refundMediaSeconds(const std::string& ipAddress, double seconds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = ipHistory_.find(ipAddress);
+    if (it == ipHistory_.end()) return;
+
+    // Newest matching charge; nothing to refund once it has left the window
+    auto& entries = it->second.mediaSeconds;
+    for (auto entry = entries.rbegin(); entry != entries.rend(); ++entry) {
+        if (entry->second == seconds) {
+            it->second.mediaTotal -= seconds;
+            entries.erase(std::next(entry).base());
+            break;
+        }
+    }
+    if (entries.empty()) it->second.mediaTotal = 0;
+}
+
+double RateLimiter::getRemainingMediaSeconds(const std::string& ipAddress) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = ipHistory_.find(ipAddress);
+    if (it == ipHistory_.end()) {
+        return MAX_MEDIA_SECONDS_PER_WINDOW;
+    }
+
+    cleanup(it->second);
+    return std::max(0.0, MAX_MEDIA_SECONDS_PER_WINDOW - it->second.mediaTotal);
+}
+
 void RateLimiter::cleanupStaleEntries() {
     auto now = std::chrono::steady_clock::now();
     auto cutoff = now - TIME_WINDOW;
@@ -46,7 +95,7 @@ void RateLimiter::cleanupStaleEntries() {
         cleanup(it->second); // Remove old timestamps
         
         // If no timestamps left, or all are old (which cleanup handles), remove the entry
-        if (it->second.timestamps.empty()) {
+        if (it->second.timestamps.empty() && it->second.mediaSeconds.empty()) {
             it = ipHistory_.erase(it);
         } else {
             ++it;
@@ -74,4 +123,14 @@ void RateLimiter::cleanup(RequestHistory& history) {
     while (!history.timestamps.empty() && history.timestamps.front() < cutoff) {
         history.timestamps.pop_front();
     }
+    while (!history.mediaSeconds.empty() && history.mediaSeconds.front().first < cutoff) {
+        history.mediaTotal -= history.mediaSeconds.front().second;
+        history.mediaSeconds.pop_front();
+    }
+    if (history.mediaSeconds.empty()) history.mediaTotal = 0; // Drop accumulated rounding
+}
+
+size_t RateLimiter::trackedClients() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ipHistory_.size();
 }
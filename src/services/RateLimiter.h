@@ -41,6 +41,32 @@ public:
      */
     int getRemainingRequests(const std::string& ipAddress);
 
+    /**
+     * @brief Charges decoded media time against the IP's budget for the window.
+     *
+     * Requests are counted by isAllowed(); this additionally limits how much
+     * media an IP can have transcoded, so a short clip of a long video costs
+     * only the span that is actually decoded.
+     * @param seconds Media seconds the job will decode.
+     * @return true if charged, false if the budget would be exceeded (nothing is charged).
+     */
+    bool consumeMediaSeconds(const std::string& ipAddress, double seconds);
+
+    /**
+     * @brief Returns a charge made by consumeMediaSeconds() for a job that failed.
+     */
+    void refundMediaSeconds(const std::string& ipAddress, double seconds);
+
+    /**
+     * @brief Gets the media seconds an IP can still have transcoded in the current window.
+     */
+    double getRemainingMediaSeconds(const std::string& ipAddress);
+
+    /**
+     * @brief Number of IPs with history in memory, for stats.
+     */
+    size_t trackedClients();
+
 private:
     RateLimiter() = default;
     ~RateLimiter() = default;
@@ -49,6 +75,8 @@ private:
 
     struct RequestHistory {
         std::deque<std::chrono::steady_clock::time_point> timestamps;
+        std::deque<std::pair<std::chrono::steady_clock::time_point, double>> mediaSeconds;
+        double mediaTotal = 0; // Sum of mediaSeconds
     };
 
     std::unordered_map<std::string, RequestHistory> ipHistory_;
@@ -57,6 +85,7 @@ private:
     // Configuration
     const int MAX_REQUESTS_PER_WINDOW = 10; // 10 requests
     const std::chrono::minutes TIME_WINDOW{60}; // per hour
+    const double MAX_MEDIA_SECONDS_PER_WINDOW = 6 * 3600; // 6 hours of decoded media per hour
     
     // Remove timestamps that are older than the time window
     void cleanup(RequestHistory& history);
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#include "ScratchSpace.h"
+#include "Lifecycle.h"
+#include <drogon/drogon.h>
+#include <trantor/utils/Logger.h>
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
+
+namespace fs = std::filesystem;
+
+static const uint64_t MB = 1024 * 1024;
+
+ScratchSpace::ScratchSpace() {
+    // Optional overrides from config.json (custom_config.scratch)
+    auto config = drogon::app().getCustomConfig()["scratch"];
+    enabled_ = config.get("enabled", enabled_).asBool();
+    directory_ = config.get("path", directory_).asString();
+    budgetBytes_ = config.get("ram_budget_mb", (Json::UInt64)(budgetBytes_ / MB)).asUInt64() * MB;
+    maxJobBytes_ = config.get("max_job_mb", (Json::UInt64)(maxJobBytes_ / MB)).asUInt64() * MB;
+
+    if (!enabled_) return;
+
+    // scratch.path may be a shared mount such as /dev/shm, so files go in a
+    // subdirectory of our own and only that is ever wiped
+    std::error_code ec;
+    std::string parent = directory_;
+    if (!parent.empty() && parent.back() != '/') parent += '/';
+    directory_ = parent + "konvertor-" + std::to_string(getuid()) + "/";
+    fs::create_directories(parent, ec);
+    struct stat st;
+    if (!ec && mkdir(directory_.c_str(), 0700) != 0 && errno != EEXIST) {
+        ec.assign(errno, std::generic_category());
+    }
+    if (!ec && lstat(directory_.c_str(), &st) != 0) {
+        ec.assign(errno, std::generic_category());
+    }
+    if (!ec && (!S_ISDIR(st.st_mode) || st.st_uid != getuid())) {
+        // Someone else created it first; do not write into, or wipe, their directory
+        ec = std::make_error_code(std::errc::permission_denied);
+    }
+    if (ec) {
+        LOG_WARN << "Scratch directory " << directory_ << " unavailable (" << ec.message()
+                 << "), intermediate files will stay on disk.";
+        enabled_ = false;
+        return;
+    }
+    chmod(directory_.c_str(), 0700);
+
+    // Whatever is left here belongs to a previous run and can no longer complete,
+    // unless that run handed its jobs to this process in a restart (see JobAdopter)
+    if (Lifecycle::instance().isSuccessor()) {
+        // Still in RAM, so they count against the budget until their jobs finish
+        for (const auto& entry : fs::recursive_directory_iterator(directory_, ec)) {
+            std::error_code sizeError;
+            if (!entry.is_regular_file(sizeError)) continue;
+            uint64_t bytes = entry.file_size(sizeError);
+            if (!sizeError) unclaimedBytes_ += bytes;
+        }
+        usedBytes_ = unclaimedBytes_;
+        LOG_INFO << "Keeping " << (unclaimedBytes_ / MB) << "MB of scratch files of the replaced process";
+    } else {
+        for (const auto& entry : fs::directory_iterator(directory_, ec)) {
+            fs::remove_all(entry.path(), ec);
+        }
+    }
+
+    struct statfs sfs;
+    if (statfs(directory_.c_str(), &sfs) == 0 && sfs.f_type != TMPFS_MAGIC) {
+        LOG_WARN << "Scratch directory " << directory_ << " is not on tmpfs; files will not be held in RAM.";
+    }
+
+    LOG_INFO << "Scratch tier enabled at " << directory_ << " with " << (budgetBytes_ / MB) << "MB budget.";
+}
+
+ScratchSpace::Lease::~Lease() {
+    ScratchSpace::instance().release(bytes_);
+}
+
+ScratchSpace::LeasePtr ScratchSpace::acquire(uint64_t bytes) {
+    if (!enabled_ || bytes > maxJobBytes_) return nullptr;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (usedBytes_ + bytes > budgetBytes_) return nullptr; // Spill to disk
+    usedBytes_ += bytes;
+    return LeasePtr(new Lease(directory_, bytes));
+}
+
+bool ScratchSpace::extend(Lease& lease, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (lease.bytes_ + bytes > maxJobBytes_ || usedBytes_ + bytes > budgetBytes_) return false;
+    usedBytes_ += bytes;
+    lease.bytes_ += bytes;
+    return true;
+}
+
+ScratchSpace::LeasePtr ScratchSpace::adopt(uint64_t bytes) {
+    if (!enabled_ || bytes == 0) return nullptr;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t claimed = std::min(unclaimedBytes_, bytes);
+    unclaimedBytes_ -= claimed;
+    usedBytes_ += bytes - claimed;
+    return LeasePtr(new Lease(directory_, bytes));
+}
+
+void ScratchSpace::release(uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    usedBytes_ -= std::min(usedBytes_, bytes);
+}
+
+uint64_t ScratchSpace::usedBytes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return usedBytes_;
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+
+/**
+ * @class ScratchSpace
+ * @brief Singleton service providing a RAM-backed (tmpfs) tier for intermediate files.
+ *
+ * Short clips spend more time writing their upload and ffmpeg output to disk
+ * than being transcoded. When enabled, jobs whose input and expected output
+ * fit within the configured RAM budget keep both in a tmpfs directory, the
+ * private `konvertor-<uid>/` subdirectory of `scratch.path` (`/dev/shm` by
+ * default). Larger jobs, or jobs arriving while the budget is in
+ * use, spill to `./uploads/` as before.
+ *
+ * The budget is held through a `Lease` for the job's lifetime, in the same way
+ * `StorageManager::Reservation` holds disk space.
+ */
+class ScratchSpace {
+public:
+    static ScratchSpace& instance() {
+        static ScratchSpace inst;
+        return inst;
+    }
+
+    ScratchSpace(const ScratchSpace&) = delete;
+    ScratchSpace& operator=(const ScratchSpace&) = delete;
+
+    /**
+     * @brief RAM budget held by one job; returned on destruction.
+     */
+    class Lease {
+    public:
+        ~Lease();
+        const std::string& directory() const { return directory_; }
+        uint64_t bytes() const { return bytes_; }
+    private:
+        friend class ScratchSpace;
+        Lease(std::string directory, uint64_t bytes) : directory_(std::move(directory)), bytes_(bytes) {}
+        std::string directory_;
+        uint64_t bytes_;
+    };
+    using LeasePtr = std::shared_ptr<Lease>;
+
+    /**
+     * @brief Tries to place a job's intermediate files in RAM.
+     * @param bytes Expected size of the input plus output.
+     * @return A lease whose directory() should be used, or nullptr to spill to disk.
+     */
+    LeasePtr acquire(uint64_t bytes);
+
+    /**
+     * @brief Adds bytes to a job's lease, for files it decides to write later
+     *        (e.g. the segments of a split job).
+     * @return false if they do not fit; the lease is unchanged.
+     */
+    bool extend(Lease& lease, uint64_t bytes);
+
+    /**
+     * @brief Re-creates the lease of a job handed over by the replaced process
+     *        (see JobAdopter), whose files are already in the directory.
+     * @param bytes The size of the job's lease in the predecessor.
+     * @return The lease, or nullptr if bytes is 0 or the tier is disabled.
+     *
+     * The budget is not checked, since the files exist either way. Bytes
+     * counted for the files found at startup are moved into the lease first.
+     */
+    LeasePtr adopt(uint64_t bytes);
+
+    bool enabled() const { return enabled_; }
+    uint64_t usedBytes();
+
+private:
+    ScratchSpace();
+    ~ScratchSpace() = default;
+
+    void release(uint64_t bytes);
+
+    std::mutex mutex_;
+    uint64_t usedBytes_ = 0;
+    // Part of usedBytes_ counting files kept from the replaced process that no
+    // adopted lease has taken over yet
+    uint64_t unclaimedBytes_ = 0;
+
+    // Configuration (overridable via custom_config.scratch in config.json)
+    bool enabled_ = false;
+    std::string directory_ = "/dev/shm/"; // Parent; konvertor-<uid>/ is appended
+    uint64_t budgetBytes_ = 512ULL * 1024 * 1024; // 512MB of RAM in total
+    uint64_t maxJobBytes_ = 64ULL * 1024 * 1024;  // larger jobs always go to disk
+};
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#include "SegmentPlanner.h"
+#include <drogon/drogon.h>
+#include <trantor/utils/Logger.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
+// Formats a sample position as seconds with microsecond precision
+static std::string seconds(double samples, int sampleRate) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.6f", samples / sampleRate);
+    return buf;
+}
+
+// Sample rate of the encoded output: an explicit -ar in the preset wins,
+// otherwise the source rate (mapped to one LAME supports for MP3).
+static int outputSampleRate(const MediaInfo& info, const std::string& format,
+                            const std::vector<std::string>& codecArgs, bool& explicitRate) {
+    auto it = std::find(codecArgs.begin(), codecArgs.end(), "-ar");
+    explicitRate = it != codecArgs.end() && (it + 1) != codecArgs.end();
+    if (explicitRate) return std::atoi((it + 1)->c_str());
+
+    if (format == "mp3") {
+        static const int lameRates[] = {8000, 11025, 12000, 16000, 22050, 24000, 32000, 44100, 48000};
+        if (std::find(std::begin(lameRates), std::end(lameRates), info.sampleRate) == std::end(lameRates)) {
+            return 44100;
+        }
+    }
+    return info.sampleRate;
+}
+
+bool SegmentPlanner::build(const MediaInfo& info, const std::string& format,
+                           const std::vector<std::string>& codecArgs,
+                           const std::string& inputFilename, const std::string& outputFilename,
+                           size_t spareWorkers, bool reportProgress,
+                           double startSeconds, double endSeconds, Plan& plan) {
+    // Optional overrides from config.json (custom_config.segmenting)
+    auto config = drogon::app().getCustomConfig()["segmenting"];
+    if (!config.get("enabled", true).asBool()) return false;
+    double minDuration = config.get("min_duration_seconds", 900).asDouble();
+    double minSegment = config.get("min_segment_seconds", 180).asDouble();
+    size_t maxSegments = config.get("max_segments", 8).asUInt();
+
+    // The MP3 trimming relies on LAME options, and WAV joins on PCM
+    auto codecIt = std::find(codecArgs.begin(), codecArgs.end(), "-acodec");
+    std::string codec = codecIt != codecArgs.end() && (codecIt + 1) != codecArgs.end() ? *(codecIt + 1) : "";
+    bool isMp3 = format == "mp3" && codec == "libmp3lame";
+    if (!isMp3 && (format != "wav" || codec.rfind("pcm_", 0) != 0)) return false;
+    bool toEnd = endSeconds <= 0;
+    double spanSeconds = (toEnd ? info.durationSeconds : endSeconds) - startSeconds;
+    if (spanSeconds < minDuration || info.sampleRate <= 0 || minSegment <= 0) return false;
+
+    size_t count = std::min({maxSegments, spareWorkers,
+                             static_cast<size_t>(spanSeconds / minSegment)});
+    if (count < 2) return false;
+
+    bool explicitRate = false;
+    int rate = outputSampleRate(info, format, codecArgs, explicitRate);
+    if (rate <= 0) return false;
+
+    // Cut points are whole MP3 frames (1152 samples for MPEG-1, 576 below 32kHz)
+    // so every segment starts on a frame boundary of the final stream.
+    const int64_t frame = isMp3 ? (rate >= 32000 ? 1152 : 576) : 1;
+    const int64_t prerollFrames = isMp3 ? 16 : 0; // ~0.4s of context before each cut
+    const int64_t tailFrames = isMp3 ? 4 : 0;     // look-ahead so the last kept frame is complete
+    const int64_t totalSamples = static_cast<int64_t>(spanSeconds * rate);
+    const int64_t offset = static_cast<int64_t>(startSeconds * rate);
+    const int64_t segmentSamples = (totalSamples / static_cast<int64_t>(count)) / frame * frame;
+    if (segmentSamples <= 0) return false;
+
+    std::filesystem::path outPath(outputFilename);
+    std::string base = (outPath.parent_path() / outPath.stem()).string();
+    std::string ext = outPath.extension().string();
+    std::string listFile = base + ".concat.txt";
+
+    std::ofstream list(listFile);
+    if (!list) {
+        LOG_WARN << "Cannot write concat list " << listFile << ", not segmenting";
+        return false;
+    }
+    plan.tempFiles.push_back(listFile);
+
+    for (size_t i = 0; i < count; ++i) {
+        bool last = i + 1 == count;
+        int64_t start = static_cast<int64_t>(i) * segmentSamples;
+        int64_t length = last ? totalSamples - start : segmentSamples;
+        int64_t preroll = std::min(start, prerollFrames * frame);
+        int64_t encodeStart = start - preroll;
+        int64_t encodeLength = preroll + length + tailFrames * frame;
+
+        std::string segment = base + ".part" + std::to_string(i) + ext;
+        std::string encoded = isMp3 ? base + ".part" + std::to_string(i) + ".raw" + ext : segment;
+
+        ConversionTask part;
+        part.inputFilename = inputFilename;
+        part.outputFilename = segment;
+        part.mediaSeconds = static_cast<double>(length) / rate;
+        part.remoteAllowed = true;
+
+        // Input-side seeking: only this range is demuxed and decoded. The last
+        // part runs to the end of the input unless a range end was requested.
+        part.args = {"ffmpeg", "-nostdin", "-ss", seconds(offset + encodeStart, rate)};
+        if (!last || !toEnd) {
+            part.args.push_back("-t"); part.args.push_back(seconds(encodeLength, rate));
+        }
+        part.args.insert(part.args.end(), {"-i", inputFilename, "-vn"});
+        part.args.insert(part.args.end(), codecArgs.begin(), codecArgs.end());
+        if (!explicitRate) {
+            part.args.push_back("-ar"); part.args.push_back(std::to_string(rate));
+        }
+        if (isMp3) {
+            // No bit reservoir, so frames can be dropped without breaking their neighbours;
+            // no Xing/ID3 headers, since the segments are only intermediate streams.
+            part.args.insert(part.args.end(), {"-reservoir", "0", "-write_xing", "0", "-id3v2_version", "0"});
+        }
+        if (reportProgress) {
+            part.args.insert(part.args.end(), {"-progress", "pipe:1", "-nostats"});
+        }
+        part.args.push_back(encoded);
+        part.args.push_back("-y");
+
+        if (isMp3) {
+            // Keep frames [preroll, preroll + length). Packet timestamps are exact
+            // multiples of the frame duration; cutting half a frame early keeps the
+            // comparison robust to rounding.
+            double keepFrom = preroll > 0 ? static_cast<double>(preroll) - frame / 2.0 : 0;
+            double keepTo = static_cast<double>(preroll + length) - frame / 2.0;
+            std::vector<std::string> trim = {"ffmpeg", "-nostdin", "-i", encoded};
+            if (preroll > 0) {
+                trim.push_back("-ss"); trim.push_back(seconds(keepFrom, rate));
+            }
+            if (!last || !toEnd) {
+                trim.push_back("-t"); trim.push_back(seconds(keepTo - keepFrom, rate));
+            }
+            trim.insert(trim.end(), {"-c", "copy", "-write_xing", "0", "-id3v2_version", "0", segment, "-y"});
+            part.followUpArgs.push_back(trim);
+            plan.tempFiles.push_back(encoded);
+        }
+        plan.tempFiles.push_back(segment);
+        plan.parts.push_back(std::move(part));
+
+        // Paths are relative to the list file, which sits next to the segments.
+        // The explicit duration keeps concat timestamps exact for VBR segments.
+        list << "file '" << std::filesystem::path(segment).filename().string() << "'\n";
+        if (!last) list << "duration " << seconds(length, rate) << "\n";
+    }
+    list.close();
+
+    plan.join.args = {"ffmpeg", "-nostdin", "-f", "concat", "-safe", "0", "-i", listFile,
+                      "-c", "copy", outputFilename, "-y"};
+    plan.join.inputFilename = inputFilename;
+    plan.join.outputFilename = outputFilename;
+    // MP3 keeps each part twice (.raw and trimmed) until the join
+    plan.tempOutputCopies = isMp3 ? 2 : 1;
+    return true;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include "ConversionManager.h"
+#include "MediaProbe.h"
+#include <string>
+#include <vector>
+
+/**
+ * @class SegmentPlanner
+ * @brief Splits long transcodes into time segments that run on several workers.
+ *
+ * A long input is normally one ffmpeg job on one core. When workers are idle,
+ * SegmentPlanner cuts the input into N ranges, encodes each one as a separate
+ * task, and joins the results with the concat demuxer (`-c copy`), so latency
+ * drops from O(duration) to O(duration / N).
+ *
+ * Only formats whose joins are exact are split:
+ * - WAV: PCM segments cut on sample boundaries concatenate losslessly.
+ * - MP3: segment boundaries are aligned to whole MP3 frames. Each segment is
+ *   encoded with a pre-roll of earlier audio and without the bit reservoir,
+ *   and a `-c copy` pass then drops the pre-roll frames. Every kept frame is
+ *   therefore encoded with full context, and the joins are gapless.
+ *
+ * Other codecs (AAC, Vorbis, Opus) carry per-stream priming or page state that
+ * cannot be stitched without re-encoding, and FLAC frame numbers restart in
+ * every segment, so those still run as a single task.
+ */
+class SegmentPlanner {
+public:
+    struct Plan {
+        std::vector<ConversionTask> parts;
+        ConversionTask join;
+        std::vector<std::string> tempFiles;
+        // Peak size of the temp files next to the output, in multiples of the output size
+        double tempOutputCopies = 0;
+    };
+
+    /**
+     * @brief Builds a segmented plan for a job, if splitting is worthwhile.
+     * @param info Probed media information (duration and sample rate are required).
+     * @param format Target format.
+     * @param codecArgs Encoder arguments of the preset (EncoderPreset::codecArgs()).
+     * @param inputFilename Source file.
+     * @param outputFilename Final output path; segments are written next to it.
+     * @param spareWorkers Workers currently idle.
+     * @param reportProgress Add `-progress pipe:1` to the segment encodes.
+     * @param startSeconds Start of the requested range in the input.
+     * @param endSeconds End of the requested range, 0 for the end of the input.
+     * @param plan Filled in when the function returns true. The join task's
+     *             callback and progress id are left for the caller to set.
+     * @return false if the job should run as a single task.
+     */
+    static bool build(const MediaInfo& info, const std::string& format,
+                      const std::vector<std::string>& codecArgs,
+                      const std::string& inputFilename, const std::string& outputFilename,
+                      size_t spareWorkers, bool reportProgress,
+                      double startSeconds, double endSeconds, Plan& plan);
+};
@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#include "StorageManager.h"
+#include "FileExpiry.h"
+#include "FileIO.h"
+#include <drogon/drogon.h>
+#include <trantor/utils/Logger.h>
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <sys/statvfs.h>
+
+namespace fs = std::filesystem;
+
+static const uint64_t MB = 1024 * 1024;
+
+StorageManager::StorageManager() {
+    // Optional overrides from config.json (custom_config.storage)
+    auto config = drogon::app().getCustomConfig()["storage"];
+    uploadsQuota_ = config.get("uploads_quota_mb", (Json::UInt64)(uploadsQuota_ / MB)).asUInt64() * MB;
+    downloadsQuota_ = config.get("downloads_quota_mb", (Json::UInt64)(downloadsQuota_ / MB)).asUInt64() * MB;
+    clientQuota_ = config.get("client_quota_mb", (Json::UInt64)(clientQuota_ / MB)).asUInt64() * MB;
+    minFreeBytes_ = config.get("min_free_mb", (Json::UInt64)(minFreeBytes_ / MB)).asUInt64() * MB;
+    highWatermark_ = config.get("high_watermark", highWatermark_).asDouble();
+    lowWatermark_ = std::min(config.get("low_watermark", lowWatermark_).asDouble(), highWatermark_);
+}
+
+StorageManager::Reservation::~Reservation() {
+    StorageManager::instance().releaseReservation(*this);
+}
+
+StorageManager::ReservationPtr StorageManager::reserve(const std::string& client, uint64_t uploadBytes,
+                                                       uint64_t outputBytes, std::string& reason) {
+    uint64_t total = uploadBytes + outputBytes;
+    std::vector<std::string> victims;
+    ReservationPtr reservation;
+    // statvfs stays outside the lock; reservations committed meanwhile are
+    // still counted below through reservedUploadBytes_/reservedOutputBytes_
+    uint64_t diskFree = availableBytes();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t& clientUsage = clientBytes_[client];
+
+        // Quotas that evicting old outputs cannot help come first, so a refused
+        // request never costs other clients their files
+        if (uploadBytes_ + reservedUploadBytes_ + uploadBytes > uploadsQuota_) {
+            reason = "Upload storage is full. Please try again later.";
+        } else if (clientUsage + total > clientQuota_) {
+            reason = "Storage quota exceeded for this client. Wait for older files to expire.";
+        } else {
+            // Count the room eviction would make among old outputs, so a full
+            // downloads dir does not reject new work. That room is freed on disk
+            // when the victims are unlinked. Their sizes come from files_, so
+            // nothing here touches the filesystem while mutex_ is held
+            victims = planEvictions(outputBytes, total, diskFree);
+            uint64_t evictableBytes = 0;
+            for (const auto& key : victims) evictableBytes += files_.at(key).bytes;
+
+            uint64_t reservedTotal = reservedUploadBytes_ + reservedOutputBytes_;
+            uint64_t available = diskFree + evictableBytes;
+            if (downloadBytes_ - evictableBytes + reservedOutputBytes_ + outputBytes > downloadsQuota_) {
+                reason = "Download storage is full. Please try again later.";
+            } else if (available < minFreeBytes_ + reservedTotal + total) {
+                reason = "Insufficient disk space. Please try again later.";
+            }
+        }
+
+        if (!reason.empty()) {
+            victims.clear();
+            if (clientUsage == 0) clientBytes_.erase(client);
+            ++rejectedJobs_;
+        } else {
+            evict(victims);
+            reservedUploadBytes_ += uploadBytes;
+            reservedOutputBytes_ += outputBytes;
+            clientUsage += total;
+            reservation.reset(new Reservation(client, uploadBytes, outputBytes));
+        }
+    }
+
+    unlinkAll(victims);
+    if (!reservation) {
+        LOG_WARN << "Storage admission refused for " << client << ": " << reason;
+    }
+    return reservation;
+}
+
+void StorageManager::releaseReservation(const Reservation& reservation) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    reservedUploadBytes_ -= std::min(reservedUploadBytes_, reservation.uploadBytes_);
+    reservedOutputBytes_ -= std::min(reservedOutputBytes_, reservation.outputBytes_);
+
+    auto it = clientBytes_.find(reservation.client_);
+    if (it != clientBytes_.end()) {
+        it->second -= std::min(it->second, reservation.bytes_);
+        if (it->second == 0) clientBytes_.erase(it);
+    }
+}
+
+void StorageManager::add(const std::string& path, const std::string& client) {
+    std::error_code ec;
+    uint64_t bytes = fs::file_size(path, ec);
+    if (ec) {
+        LOG_ERROR << "Cannot track " << path << ": " << ec.message();
+        return;
+    }
+
+    std::string key = normalize(path);
+    std::vector<std::string> victims;
+    uint64_t diskFree = availableBytes();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto existing = files_.find(key);
+        if (existing != files_.end()) forget(existing);
+
+        FileInfo info{areaOf(key), client, bytes, {}};
+        if (info.area == Area::Downloads) {
+            info.lruPos = downloadLru_.insert(downloadLru_.end(), key);
+            downloadBytes_ += bytes;
+        } else {
+            uploadBytes_ += bytes;
+        }
+        if (!client.empty()) clientBytes_[client] += bytes;
+        files_.emplace(key, std::move(info));
+
+        // New output may have pushed us past the high watermark
+        victims = planEvictions(0, 0, diskFree);
+        evict(victims);
+    }
+
+    unlinkAll(victims);
+    FileExpiry::instance().track(path);
+}
+
+bool StorageManager::remove(const std::string& path) {
+    return removeAll({path}) == 1;
+}
+
+size_t StorageManager::removeAll(const std::vector<std::string>& paths) {
+    for (const auto& path : paths) release(path);
+
+    size_t removed = 0;
+    std::vector<int> errors = FileIO::instance().removeFiles(paths);
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (errors[i] == 0) {
+            ++removed;
+        } else if (errors[i] != ENOENT) {
+            LOG_ERROR << "Error deleting file " << paths[i] << ": "
+                      << std::error_code(errors[i], std::generic_category()).message();
+        }
+    }
+    return removed;
+}
+
+void StorageManager::release(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = files_.find(normalize(path));
+    if (it != files_.end()) forget(it);
+}
+
+void StorageManager::touch(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = files_.find(normalize(path));
+    if (it != files_.end() && it->second.area == Area::Downloads) {
+        downloadLru_.splice(downloadLru_.end(), downloadLru_, it->second.lruPos);
+    }
+}
+
+void StorageManager::recover(const std::vector<std::string>& dirs) {
+    auto now = fs::file_time_type::clock::now();
+    size_t recovered = 0;
+
+    for (const auto& dirPath : dirs) {
+        std::error_code ec;
+        if (!fs::exists(dirPath, ec)) continue;
+
+        for (const auto& entry : fs::directory_iterator(dirPath, ec)) {
+            if (!entry.is_regular_file(ec)) continue;
+
+            uint64_t bytes = entry.file_size(ec);
+            if (ec) continue;
+            auto ftime = entry.last_write_time(ec);
+            if (ec) continue;
+
+            std::string key = normalize(entry.path().string());
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (files_.count(key)) continue;
+                FileInfo info{areaOf(key), "", bytes, {}};
+                if (info.area == Area::Downloads) {
+                    // Recovered outputs start as least recently downloaded
+                    info.lruPos = downloadLru_.insert(downloadLru_.begin(), key);
+                    downloadBytes_ += bytes;
+                } else {
+                    uploadBytes_ += bytes;
+                }
+                files_.emplace(key, std::move(info));
+            }
+
+            // Give the file whatever is left of its TTL
+            auto age = std::chrono::duration_cast<std::chrono::seconds>(now - ftime);
+            FileExpiry::instance().track(entry.path().string(), age);
+            ++recovered;
+        }
+    }
+
+    LOG_INFO << "StorageManager recovered " << recovered << " files from previous run.";
+}
+
+Json::Value StorageManager::stats() {
+    uint64_t available = availableBytes();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Json::Value json;
+    json["uploads_bytes"] = (Json::UInt64)(uploadBytes_ + reservedUploadBytes_);
+    json["uploads_quota_bytes"] = (Json::UInt64)uploadsQuota_;
+    json["downloads_bytes"] = (Json::UInt64)downloadBytes_;
+    json["downloads_reserved_bytes"] = (Json::UInt64)reservedOutputBytes_;
+    json["downloads_quota_bytes"] = (Json::UInt64)downloadsQuota_;
+    json["downloads_files"] = (Json::UInt64)downloadLru_.size();
+    json["disk_available_bytes"] = (Json::UInt64)available;
+    json["active_clients"] = (Json::UInt64)clientBytes_.size();
+    json["evicted_files"] = (Json::UInt64)evictedFiles_;
+    json["evicted_bytes"] = (Json::UInt64)evictedBytes_;
+    json["rejected_jobs"] = (Json::UInt64)rejectedJobs_;
+    return json;
+}
+
+uint64_t StorageManager::availableBytes() const {
+    struct statvfs vfs;
+    if (statvfs(storageRoot_.c_str(), &vfs) != 0) return 0;
+    return static_cast<uint64_t>(vfs.f_bavail) * vfs.f_frsize;
+}
+
+StorageManager::Area StorageManager::areaOf(const std::string& normalizedPath) const {
+    return normalizedPath.rfind(downloadsDir_ + "/", 0) == 0 ? Area::Downloads : Area::Uploads;
+}
+
+std::vector<std::string> StorageManager::planEvictions(uint64_t extraOutputBytes, uint64_t extraBytes,
+                                                       uint64_t available) const {
+    std::vector<std::string> victims;
+
+    // Above the high watermark: drain the downloads dir down to the low watermark
+    uint64_t need = 0;
+    uint64_t projected = downloadBytes_ + reservedOutputBytes_ + extraOutputBytes;
+    if (projected > static_cast<uint64_t>(highWatermark_ * downloadsQuota_)) {
+        need = projected - static_cast<uint64_t>(lowWatermark_ * downloadsQuota_);
+    }
+
+    // Below the free-space floor: free enough to restore it
+    uint64_t required = minFreeBytes_ + reservedUploadBytes_ + reservedOutputBytes_ + extraBytes;
+    if (available < required) {
+        need = std::max(need, required - available);
+    }
+
+    uint64_t freed = 0;
+    for (auto lruIt = downloadLru_.begin(); freed < need && lruIt != downloadLru_.end(); ++lruIt) {
+        freed += files_.at(*lruIt).bytes;
+        victims.push_back(*lruIt);
+    }
+    return victims;
+}
+
+void StorageManager::evict(const std::vector<std::string>& victims) {
+    for (const auto& key : victims) {
+        auto it = files_.find(key);
+        ++evictedFiles_;
+        evictedBytes_ += it->second.bytes;
+        forget(it);
+    }
+}
+
+void StorageManager::forget(std::unordered_map<std::string, FileInfo>::iterator it) {
+    FileInfo& info = it->second;
+    if (info.area == Area::Downloads) {
+        downloadBytes_ -= std::min(downloadBytes_, info.bytes);
+        downloadLru_.erase(info.lruPos);
+    } else {
+        uploadBytes_ -= std::min(uploadBytes_, info.bytes);
+    }
+
+    if (!info.client.empty()) {
+        auto clientIt = clientBytes_.find(info.client);
+        if (clientIt != clientBytes_.end()) {
+            clientIt->second -= std::min(clientIt->second, info.bytes);
+            if (clientIt->second == 0) clientBytes_.erase(clientIt);
+        }
+    }
+    files_.erase(it);
+}
+
+void StorageManager::unlinkAll(const std::vector<std::string>& paths) {
+    std::vector<int> errors = FileIO::instance().removeFiles(paths);
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (errors[i] == 0) {
+            LOG_WARN << "Evicted least recently downloaded output: " << paths[i];
+        } else if (errors[i] != ENOENT) {
+            LOG_ERROR << "Error evicting " << paths[i] << ": "
+                      << std::error_code(errors[i], std::generic_category()).message();
+        }
+    }
+}
+
+std::string StorageManager::normalize(const std::string& path) {
+    return fs::path(path).lexically_normal().string();
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include <json/json.h>
+
+/**
+ * @class StorageManager
+ * @brief Singleton service that accounts for and limits disk usage.
+ *
+ * Tracks how many bytes live in `./uploads/` and `./www/downloads/`, both per
+ * directory and per client, and admits new work only if the volume has enough
+ * headroom (`statvfs`) and the relevant quotas are not exceeded. Admitted work
+ * holds a `Reservation` for its expected size until it finishes, so concurrent
+ * requests cannot overbook the same free space.
+ *
+ * When the downloads directory passes its high watermark, or free space falls
+ * below the configured minimum, the least recently downloaded outputs are
+ * evicted until usage is back under the low watermark.
+ */
+class StorageManager {
+public:
+    static StorageManager& instance() {
+        static StorageManager inst;
+        return inst;
+    }
+
+    StorageManager(const StorageManager&) = delete;
+    StorageManager& operator=(const StorageManager&) = delete;
+
+    /**
+     * @brief Bytes set aside for one admitted job; released on destruction.
+     */
+    class Reservation {
+    public:
+        ~Reservation();
+        uint64_t bytes() const { return bytes_; }
+    private:
+        friend class StorageManager;
+        Reservation(std::string client, uint64_t uploadBytes, uint64_t outputBytes)
+            : client_(std::move(client)), uploadBytes_(uploadBytes), outputBytes_(outputBytes),
+              bytes_(uploadBytes + outputBytes) {}
+        std::string client_;
+        uint64_t uploadBytes_;
+        uint64_t outputBytes_;
+        uint64_t bytes_;
+    };
+    using ReservationPtr = std::shared_ptr<Reservation>;
+
+    /**
+     * @brief Admission check for a new job.
+     * @param client Client identifier (IP address) the quota is charged to.
+     * @param uploadBytes Size of the upload that will be written to ./uploads/.
+     * @param outputBytes Estimated size of the output written to ./www/downloads/.
+     * @param reason Set to a human readable explanation when admission fails.
+     * @return A reservation to hold for the job's lifetime, or nullptr if refused.
+     */
+    ReservationPtr reserve(const std::string& client, uint64_t uploadBytes,
+                           uint64_t outputBytes, std::string& reason);
+
+    /**
+     * @brief Records a newly created file and schedules its expiry.
+     * @param path Path of the file (inside ./uploads/ or ./www/downloads/).
+     * @param client Client the file is charged to (empty if unknown).
+     */
+    void add(const std::string& path, const std::string& client);
+
+    /**
+     * @brief Deletes a file and releases its accounting if it was tracked.
+     * @return true if a file was deleted.
+     */
+    bool remove(const std::string& path);
+
+    /**
+     * @brief Deletes several files in one batch (see FileIO::removeFiles).
+     * @return Number of files deleted.
+     */
+    size_t removeAll(const std::vector<std::string>& paths);
+
+    /**
+     * @brief Releases accounting for a file that was already deleted elsewhere.
+     */
+    void release(const std::string& path);
+
+    /**
+     * @brief Marks an output as just downloaded (moves it to the back of the LRU).
+     */
+    void touch(const std::string& path);
+
+    /**
+     * @brief Scans storage directories once at startup and re-registers their files.
+     * @param dirs Directories to scan (non-recursive).
+     */
+    void recover(const std::vector<std::string>& dirs);
+
+    /**
+     * @brief Current occupancy, quotas and eviction counters for /api/stats.
+     */
+    Json::Value stats();
+
+private:
+    StorageManager();
+    ~StorageManager() = default;
+
+    enum class Area { Uploads, Downloads };
+
+    struct FileInfo {
+        Area area;
+        std::string client;
+        uint64_t bytes;
+        std::list<std::string>::iterator lruPos; // Only valid for Downloads
+    };
+
+    // Free bytes on the volume as reported by statvfs (0 on error)
+    uint64_t availableBytes() const;
+    Area areaOf(const std::string& normalizedPath) const;
+    // Picks LRU outputs to evict until below the low watermark and above the free-space
+    // floor, with extraOutputBytes more in the downloads dir and extraBytes more on the
+    // volume. available is an availableBytes() reading taken before locking; victim
+    // sizes come from files_. Must be called with mutex_ held; nothing is evicted
+    // until evict().
+    std::vector<std::string> planEvictions(uint64_t extraOutputBytes, uint64_t extraBytes,
+                                           uint64_t available) const;
+    // Drops the bookkeeping of planned victims; the caller unlinks them after
+    // releasing mutex_. Must be called with mutex_ held.
+    void evict(const std::vector<std::string>& victims);
+    // Removes bookkeeping for a file. Must be called with mutex_ held.
+    void forget(std::unordered_map<std::string, FileInfo>::iterator it);
+    void unlinkAll(const std::vector<std::string>& paths);
+    void releaseReservation(const Reservation& reservation);
+
+    static std::string normalize(const std::string& path);
+
+    std::unordered_map<std::string, FileInfo> files_;
+    std::list<std::string> downloadLru_; // Front = least recently downloaded
+    std::unordered_map<std::string, uint64_t> clientBytes_;
+
+    uint64_t uploadBytes_ = 0;
+    uint64_t downloadBytes_ = 0;
+    uint64_t reservedUploadBytes_ = 0;
+    uint64_t reservedOutputBytes_ = 0;
+    uint64_t evictedFiles_ = 0;
+    uint64_t evictedBytes_ = 0;
+    uint64_t rejectedJobs_ = 0;
+
+    std::mutex mutex_;
+
+    // Configuration (overridable via custom_config.storage in config.json)
+    std::string storageRoot_ = ".";                        // volume checked with statvfs
+    std::string downloadsDir_ = "www/downloads";           // normalized
+    uint64_t uploadsQuota_ = 4ULL * 1024 * 1024 * 1024;    // 4GB
+    uint64_t downloadsQuota_ = 8ULL * 1024 * 1024 * 1024;  // 8GB
+    uint64_t clientQuota_ = 2ULL * 1024 * 1024 * 1024;     // 2GB per client
+    uint64_t minFreeBytes_ = 512ULL * 1024 * 1024;         // 512MB
+    double highWatermark_ = 0.90;
+    double lowWatermark_ = 0.75;
+};
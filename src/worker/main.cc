@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+/**
+ * @file main.cc
+ * @brief Entry point for konvertor_worker, a remote conversion worker.
+ *
+ * Connects to the JobDispatcher of a konvertor server, pulls ffmpeg jobs under
+ * a lease, renews the lease with heartbeats while the job runs and reports the
+ * result. Each slot is one connection running one job at a time; several
+ * workers (or slots) can run on the same host.
+ *
+ * With --shared-path 1 the worker uses the server's file paths directly (same
+ * host or a shared filesystem). Otherwise inputs and outputs are transferred
+ * over the connection and the job runs in --work-dir.
+ *
+ * The dispatcher's shared secret (custom_config.remote.token) is read from
+ * --token-file, or from KONVERTOR_REMOTE_TOKEN, so it never shows up in ps.
+ *
+ * Usage: konvertor_worker [--connect unix:/tmp/konvertor-dispatch.sock] [--name NAME]
+ *        [--slots 1] [--shared-path 0] [--work-dir /tmp/konvertor-worker] [--token-file PATH]
+ */
+
+#include "../services/DispatchConnection.h"
+#include "../services/ProcessRunner.h"
+#include <trantor/utils/Logger.h>
+#include <json/json.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Options {
+    std::string address = "unix:/tmp/konvertor-dispatch.sock";
+    std::string name;
+    int slots = 1;
+    bool sharedPath = false;
+    std::string workDir = "/tmp/konvertor-worker";
+    std::string token;
+};
+
+static std::vector<std::string> toArgs(const Json::Value& list) {
+    std::vector<std::string> args;
+    for (const auto& arg : list) args.push_back(arg.asString());
+    return args;
+}
+
+// Runs one leased job; returns false if the connection to the dispatcher was lost
+static bool runJob(DispatchConnection& conn, const Json::Value& job, const Options& opt, int leaseSeconds) {
+    uint64_t leaseId = job["lease"].asUInt64();
+    bool inlineTransfer = job["transfer"].asString() == "inline";
+    std::string input = job["input"].asString();
+    std::string output = job["output"].asString();
+    std::vector<std::string> args = toArgs(job["args"]);
+    std::vector<std::string> fallback = toArgs(job["fallback_args"]);
+    std::vector<std::vector<std::string>> followUps;
+    for (const auto& command : job["follow_up_args"]) followUps.push_back(toArgs(command));
+
+    // Without a shared path, the job runs on local copies in a private directory
+    std::string localDir;
+    std::string localOutput = output;
+    if (inlineTransfer) {
+        localDir = opt.workDir + "/job-" + std::to_string(getpid()) + "-" + std::to_string(leaseId);
+        std::error_code ec;
+        std::filesystem::create_directories(localDir, ec);
+        std::string localInput = localDir + "/input" + std::filesystem::path(input).extension().string();
+        localOutput = localDir + "/" + std::filesystem::path(output).filename().string();
+        if (!conn.receiveFile(localInput, job["input_bytes"].asUInt64())) {
+            std::filesystem::remove_all(localDir, ec);
+            return false;
+        }
+        auto rewrite = [&](std::vector<std::string>& command) {
+            for (auto& arg : command) {
+                if (arg == input) arg = localInput;
+                else if (arg == output) arg = localOutput;
+            }
+        };
+        rewrite(args);
+        rewrite(fallback);
+    }
+
+    // Commands arrive over the network: only ffmpeg is ever run
+    bool allowed = !args.empty() && args[0] == "ffmpeg" && (fallback.empty() || fallback[0] == "ffmpeg");
+    for (const auto& command : followUps) allowed = allowed && !command.empty() && command[0] == "ffmpeg";
+    if (!allowed) LOG_ERROR << "Refusing lease " << leaseId << ": not an ffmpeg command";
+
+    LOG_INFO << "Running lease " << leaseId << " -> " << output;
+    std::atomic<bool> cancel{false};
+    std::atomic<double> processed{0};
+    ProcessRunner::LineCallback onProgress = [&processed](const std::string& line) {
+        // Same progress format as the server's own workers
+        if (line.rfind("out_time_us=", 0) == 0) processed = std::atof(line.c_str() + 12) / 1e6;
+    };
+    // Largest child RSS of all commands, reported for the job trace
+    long peakRssKb = 0;
+    auto work = std::async(std::launch::async, [&]() {
+        ProcessResult result;
+        if (!allowed) return result;
+        result = ProcessRunner::run(args, onProgress, std::chrono::milliseconds(0), &cancel);
+        peakRssKb = result.peakRssKb;
+        if (!result.success() && !result.cancelled && !fallback.empty()) {
+            result = ProcessRunner::run(fallback, onProgress, std::chrono::milliseconds(0), &cancel);
+            peakRssKb = std::max(peakRssKb, result.peakRssKb);
+        }
+        for (size_t i = 0; i < followUps.size() && result.success(); ++i) {
+            result = ProcessRunner::run(followUps[i], nullptr, std::chrono::milliseconds(0), &cancel);
+            peakRssKb = std::max(peakRssKb, result.peakRssKb);
+        }
+        return result;
+    });
+
+    // Renew the lease well before it expires
+    auto interval = std::chrono::milliseconds(leaseSeconds * 1000 / 3);
+    bool connected = true;
+    bool lost = false;
+    while (work.wait_for(interval) != std::future_status::ready) {
+        Json::Value heartbeat, reply;
+        heartbeat["type"] = "heartbeat";
+        heartbeat["lease"] = (Json::UInt64)leaseId;
+        heartbeat["processed"] = processed.load();
+        if (!conn.send(heartbeat) || !conn.receive(reply, leaseSeconds * 1000)) {
+            connected = false;
+        } else if (reply["type"].asString() == "lost") {
+            lost = true;
+        }
+        if (!connected || lost) {
+            cancel = true;
+            break;
+        }
+    }
+    ProcessResult result = work.get();
+
+    if (lost) {
+        LOG_WARN << "Lease " << leaseId << " was lost, job cancelled";
+    } else if (connected) {
+        bool success = result.success();
+        uint64_t outputBytes = 0;
+        struct stat st;
+        if (inlineTransfer && success) {
+            success = stat(localOutput.c_str(), &st) == 0;
+            outputBytes = success ? static_cast<uint64_t>(st.st_size) : 0;
+        }
+
+        Json::Value done, reply;
+        done["type"] = "done";
+        done["lease"] = (Json::UInt64)leaseId;
+        done["success"] = success;
+        done["exit_code"] = result.exitCode;
+        done["peak_rss_kb"] = (Json::Int64)peakRssKb;
+        if (inlineTransfer && success) done["output_bytes"] = (Json::UInt64)outputBytes;
+        connected = conn.send(done) &&
+                    (!inlineTransfer || !success || conn.sendFile(localOutput, outputBytes)) &&
+                    conn.receive(reply, leaseSeconds * 1000);
+        LOG_INFO << "Lease " << leaseId << (success ? " succeeded" : " failed")
+                 << (connected && reply["type"].asString() == "lost" ? " after it was lost" : "");
+    }
+
+    if (!localDir.empty()) {
+        std::error_code ec;
+        std::filesystem::remove_all(localDir, ec);
+    }
+    return connected;
+}
+
+static void runSlot(const Options& opt, int slot) {
+    std::string name = opt.slots > 1 ? opt.name + "/" + std::to_string(slot) : opt.name;
+    while (true) {
+        int fd = DispatchConnection::connectTo(opt.address);
+        if (fd < 0) {
+            LOG_WARN << name << ": cannot connect to " << opt.address << ", retrying";
+            std::this_thread::sleep_for(std::chrono::seconds(2));
+            continue;
+        }
+
+        DispatchConnection conn(fd);
+        Json::Value hello, welcome;
+        hello["type"] = "hello";
+        hello["worker"] = name;
+        hello["shared_path"] = opt.sharedPath;
+        hello["token"] = opt.token;
+        if (conn.send(hello) && conn.receive(welcome, 10000) && welcome["type"].asString() == "welcome") {
+            int leaseSeconds = std::max(3, welcome.get("lease_seconds", 30).asInt());
+            LOG_INFO << name << ": connected to " << opt.address;
+
+            while (true) {
+                // The dispatcher holds a pull for a few seconds when there is no work
+                Json::Value pull, reply;
+                pull["type"] = "pull";
+                if (!conn.send(pull) || !conn.receive(reply, 30000)) break;
+
+                std::string type = reply["type"].asString();
+                if (type == "idle") continue;
+                if (type != "job" || !runJob(conn, reply, opt, leaseSeconds)) break;
+            }
+        }
+
+        LOG_WARN << name << ": disconnected from " << opt.address << ", reconnecting";
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        std::string value = argv[i + 1];
+        if (key == "--connect") opt.address = value;
+        else if (key == "--name") opt.name = value;
+        else if (key == "--slots") opt.slots = std::max(1, std::atoi(value.c_str()));
+        else if (key == "--shared-path") opt.sharedPath = value == "1" || value == "true";
+        else if (key == "--work-dir") opt.workDir = value;
+        else if (key == "--token-file") {
+            std::ifstream in(value);
+            if (!std::getline(in, opt.token)) {
+                fprintf(stderr, "Cannot read token from %s\n", value.c_str());
+                return 2;
+            }
+        } else {
+            fprintf(stderr, "Unknown option %s\n", key.c_str());
+            return 2;
+        }
+    }
+    if (opt.token.empty()) {
+        const char* token = std::getenv("KONVERTOR_REMOTE_TOKEN");
+        if (token) opt.token = token;
+    }
+    if (opt.name.empty()) {
+        char host[256] = {0};
+        gethostname(host, sizeof(host) - 1);
+        opt.name = std::string(host) + ":" + std::to_string(getpid());
+    }
+
+    std::vector<std::thread> slots;
+    for (int i = 0; i < opt.slots; ++i) {
+        slots.emplace_back(runSlot, std::cref(opt), i);
+    }
+    for (auto& slot : slots) slot.join();
+    return 0;
+}
@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+/**
+ * @file latency_bench.cc
+ * @brief Measures static GET tail latency while large uploads are running.
+ *
+ * Runs two phases against a live server:
+ * 1. Baseline: only GET clients, each on its own keep-alive connection.
+ * 2. Loaded: the same GET clients while upload clients POST large files to
+ *    /api/convert in a loop.
+ *
+ * Both phases print p50/p90/p99/p99.9/max latency. If blocking work runs on
+ * Drogon's event loops, the loaded tail grows by the time a loop spends
+ * writing an upload. Upload clients bind to different 127.0.0.x source
+ * addresses so the per-IP rate limit does not stop them after 10 requests.
+ *
+ * Usage: konvertor_latency_bench [--host 127.0.0.1] [--port 8080] [--path /index.html]
+ *        [--get-clients 4] [--uploaders 4] [--upload-mb 100] [--seconds 20] [--baseline-seconds 10]
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    std::string path = "/index.html";
+    int getClients = 4;
+    int uploaders = 4;
+    size_t uploadMb = 100;
+    int seconds = 20;
+    int baselineSeconds = 10;
+};
+
+static int connectTo(const Options& opt, const std::string& sourceIp = "") {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (!sourceIp.empty()) {
+        sockaddr_in local{};
+        local.sin_family = AF_INET;
+        inet_pton(AF_INET, sourceIp.c_str(), &local.sin_addr);
+        if (bind(fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0) {
+            close(fd);
+            return -1;
+        }
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(opt.port));
+    if (inet_pton(AF_INET, opt.host.c_str(), &addr.sin_addr) != 1 ||
+        connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool sendAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Reads one HTTP response with a Content-Length body; returns the status code or -1
+static int readResponse(int fd) {
+    std::string buffer;
+    char chunk[16 * 1024];
+    size_t headerEnd = std::string::npos;
+    while (headerEnd == std::string::npos) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return -1;
+        buffer.append(chunk, static_cast<size_t>(n));
+        headerEnd = buffer.find("\r\n\r\n");
+    }
+
+    int status = buffer.size() > 12 ? std::atoi(buffer.c_str() + 9) : -1;
+    std::string headers = buffer.substr(0, headerEnd);
+    std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+    size_t lengthPos = headers.find("content-length:");
+    if (lengthPos == std::string::npos) return -1; // This tool does not parse chunked bodies
+    size_t bodyLength = std::strtoull(headers.c_str() + lengthPos + 15, nullptr, 10);
+
+    size_t have = buffer.size() - headerEnd - 4;
+    while (have < bodyLength) {
+        ssize_t n = recv(fd, chunk, std::min(sizeof(chunk), bodyLength - have), 0);
+        if (n <= 0) return -1;
+        have += static_cast<size_t>(n);
+    }
+    return status;
+}
+
+static void getClient(const Options& opt, const std::atomic<bool>& stop,
+                      std::vector<double>& latenciesMs, std::atomic<int>& errors) {
+    std::string request = "GET " + opt.path + " HTTP/1.1\r\nHost: " + opt.host + "\r\n\r\n";
+    int fd = -1;
+    while (!stop) {
+        if (fd < 0 && (fd = connectTo(opt)) < 0) {
+            ++errors;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+        auto start = Clock::now();
+        int status = sendAll(fd, request.data(), request.size()) ? readResponse(fd) : -1;
+        auto elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        if (status != 200) {
+            ++errors;
+            close(fd);
+            fd = -1;
+            continue;
+        }
+        latenciesMs.push_back(elapsed);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    if (fd >= 0) close(fd);
+}
+
+static void uploadClient(const Options& opt, int index, const std::atomic<bool>& stop,
+                         std::atomic<int>& uploads, std::mutex& statusMutex, std::map<int, int>& statuses) {
+    const std::string boundary = "----konvertorbench";
+    std::string head = "--" + boundary + "\r\n"
+        "Content-Disposition: form-data; name=\"format\"\r\n\r\nmp3\r\n"
+        "--" + boundary + "\r\n"
+        "Content-Disposition: form-data; name=\"file\"; filename=\"bench.mp4\"\r\n"
+        "Content-Type: video/mp4\r\n\r\n";
+    std::string tail = "\r\n--" + boundary + "--\r\n";
+    size_t fileBytes = opt.uploadMb * 1024 * 1024;
+
+    std::vector<char> block(256 * 1024);
+    for (size_t i = 0; i < block.size(); ++i) block[i] = static_cast<char>((i * 2654435761u) >> 13);
+
+    bool loopback = opt.host.rfind("127.", 0) == 0;
+    int round = 0;
+    while (!stop) {
+        // Spread requests over 127.0.0.2-254 to stay under the per-IP limits
+        std::string source;
+        if (loopback) {
+            int host = 2 + (index * 31 + round++) % 253;
+            source = "127.0.0." + std::to_string(host);
+        }
+        int fd = connectTo(opt, source);
+        if (fd < 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+
+        std::string header = "POST /api/convert HTTP/1.1\r\nHost: " + opt.host + "\r\n"
+            "Content-Type: multipart/form-data; boundary=" + boundary + "\r\n"
+            "Content-Length: " + std::to_string(head.size() + fileBytes + tail.size()) + "\r\n"
+            "Connection: close\r\n\r\n";
+        bool ok = sendAll(fd, header.data(), header.size()) && sendAll(fd, head.data(), head.size());
+        for (size_t sent = 0; ok && sent < fileBytes && !stop; sent += block.size()) {
+            ok = sendAll(fd, block.data(), std::min(block.size(), fileBytes - sent));
+        }
+        ok = ok && !stop && sendAll(fd, tail.data(), tail.size());
+        int status = ok ? readResponse(fd) : -1;
+        close(fd);
+
+        if (ok) {
+            ++uploads;
+            std::lock_guard<std::mutex> lock(statusMutex);
+            ++statuses[status];
+        }
+    }
+}
+
+static double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t index = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+static void runPhase(const Options& opt, const char* name, int seconds, int uploaders) {
+    std::atomic<bool> stop{false};
+    std::atomic<int> errors{0}, uploads{0};
+    std::mutex statusMutex;
+    std::map<int, int> statuses;
+    std::vector<std::vector<double>> latencies(static_cast<size_t>(opt.getClients));
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < uploaders; ++i) {
+        threads.emplace_back(uploadClient, std::cref(opt), i, std::cref(stop),
+                             std::ref(uploads), std::ref(statusMutex), std::ref(statuses));
+    }
+    for (int i = 0; i < opt.getClients; ++i) {
+        threads.emplace_back(getClient, std::cref(opt), std::cref(stop),
+                             std::ref(latencies[static_cast<size_t>(i)]), std::ref(errors));
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for (auto& thread : threads) thread.join();
+
+    std::vector<double> all;
+    for (const auto& l : latencies) all.insert(all.end(), l.begin(), l.end());
+    std::sort(all.begin(), all.end());
+
+    printf("%-9s GETs %-7zu errors %-4d p50 %7.2fms  p90 %7.2fms  p99 %7.2fms  p99.9 %7.2fms  max %7.2fms",
+           name, all.size(), errors.load(), percentile(all, 50), percentile(all, 90),
+           percentile(all, 99), percentile(all, 99.9), all.empty() ? 0 : all.back());
+    if (uploaders > 0) {
+        printf("  uploads %d (", uploads.load());
+        bool first = true;
+        for (const auto& [status, count] : statuses) {
+            printf("%s%d x%d", first ? "" : ", ", status, count);
+            first = false;
+        }
+        printf(")");
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        std::string value = argv[i + 1];
+        if (key == "--host") opt.host = value;
+        else if (key == "--port") opt.port = std::atoi(value.c_str());
+        else if (key == "--path") opt.path = value;
+        else if (key == "--get-clients") opt.getClients = std::max(1, std::atoi(value.c_str()));
+        else if (key == "--uploaders") opt.uploaders = std::max(0, std::atoi(value.c_str()));
+        else if (key == "--upload-mb") opt.uploadMb = std::strtoull(value.c_str(), nullptr, 10);
+        else if (key == "--seconds") opt.seconds = std::max(1, std::atoi(value.c_str()));
+        else if (key == "--baseline-seconds") opt.baselineSeconds = std::max(0, std::atoi(value.c_str()));
+        else {
+            fprintf(stderr, "Unknown option %s\n", key.c_str());
+            return 2;
+        }
+    }
+
+    printf("Target http://%s:%d%s, %d GET clients, %d uploaders x %zu MB\n",
+           opt.host.c_str(), opt.port, opt.path.c_str(), opt.getClients, opt.uploaders, opt.uploadMb);
+    if (opt.baselineSeconds > 0) runPhase(opt, "baseline", opt.baselineSeconds, 0);
+    runPhase(opt, "uploading", opt.seconds, opt.uploaders);
+    return 0;
+}
@@ -0,0 +1,425 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+/**
+ * @file remote_workers_test.cc
+ * @brief Runs several konvertor_worker processes on localhost against a live server.
+ *
+ * The server must run with custom_config.remote.enabled and local_workers 0,
+ * so only jobs that may not be leased run in-process, with the RAM scratch
+ * tier enabled (the default). The test:
+ * - starts --workers konvertor_worker processes, each in its own process group;
+ * - waits until /api/stats reports all of their slots as connected;
+ * - posts --jobs conversions of a generated WAV at once and downloads each
+ *   output. The WAV (--clip-seconds) is larger than scratch.max_job_mb, so the
+ *   jobs may be leased, and at least one lease must show up in /api/stats;
+ * - with --stall-one 1, freezes the first worker (and its ffmpeg) with SIGSTOP
+ *   once leases are out, so its lease expires and must be completed elsewhere;
+ * - fails unless every conversion answers 200 with a non-empty download and
+ *   /api/stats shows no lease left behind.
+ *
+ * Then it stops the workers and checks the jobs that must never be leased: a
+ * progressive conversion (OutputStreamer reads its output locally) and a small
+ * one that uses the RAM scratch tier (paths private to this host). With no
+ * worker connected they can only run in-process, so each must still start.
+ *
+ * Usage: konvertor_remote_test [--host 127.0.0.1] [--port 8080] [--worker ./build/konvertor_worker]
+ *        [--connect unix:/tmp/konvertor-dispatch.sock] [--workers 3] [--slots 1]
+ *        [--shared-path 1] [--jobs 12] [--clip-seconds 400] [--stall-one 0] [--timeout-seconds 300]
+ *        [--token-file PATH]
+ *
+ * The workers get the dispatcher token from --token-file, or inherit KONVERTOR_REMOTE_TOKEN.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    std::string worker = "./build/konvertor_worker";
+    std::string connect = "unix:/tmp/konvertor-dispatch.sock";
+    int workers = 3;
+    int slots = 1;
+    bool sharedPath = true;
+    int jobs = 12;
+    int clipSeconds = 400; // 48 kHz stereo PCM: about 75 MB, past scratch.max_job_mb
+    bool stallOne = false;
+    int timeoutSeconds = 300;
+    std::string tokenFile;
+};
+
+// ---------------------------------------------------------------------------
+// HTTP
+
+struct Response {
+    int status = -1;
+    std::string body;
+};
+
+static int connectTo(const Options& opt, const std::string& sourceIp) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    // A stalled worker delays a conversion by about two lease periods
+    struct timeval timeout = {static_cast<time_t>(opt.timeoutSeconds), 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    if (!sourceIp.empty()) {
+        sockaddr_in local{};
+        local.sin_family = AF_INET;
+        inet_pton(AF_INET, sourceIp.c_str(), &local.sin_addr);
+        if (bind(fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0) {
+            close(fd);
+            return -1;
+        }
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(opt.port));
+    if (inet_pton(AF_INET, opt.host.c_str(), &addr.sin_addr) != 1 ||
+        connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool sendAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Reads one HTTP response with a Content-Length body (Connection: close)
+static Response readResponse(int fd) {
+    Response response;
+    std::string buffer;
+    char chunk[16 * 1024];
+    size_t headerEnd = std::string::npos;
+    while (headerEnd == std::string::npos) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return response;
+        buffer.append(chunk, static_cast<size_t>(n));
+        headerEnd = buffer.find("\r\n\r\n");
+    }
+
+    std::string headers = buffer.substr(0, headerEnd);
+    std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+    size_t lengthPos = headers.find("content-length:");
+    if (lengthPos == std::string::npos) return response; // This tool does not parse chunked bodies
+    size_t bodyLength = std::strtoull(headers.c_str() + lengthPos + 15, nullptr, 10);
+
+    response.body = buffer.substr(headerEnd + 4);
+    while (response.body.size() < bodyLength) {
+        ssize_t n = recv(fd, chunk, std::min(sizeof(chunk), bodyLength - response.body.size()), 0);
+        if (n <= 0) return response;
+        response.body.append(chunk, static_cast<size_t>(n));
+    }
+    response.status = buffer.size() > 12 ? std::atoi(buffer.c_str() + 9) : -1;
+    return response;
+}
+
+static Response request(const Options& opt, const std::string& source, const std::string& method,
+                        const std::string& path, const std::string& contentType, const std::string& body) {
+    Response response;
+    int fd = connectTo(opt, source);
+    if (fd < 0) return response;
+    std::string header = method + " " + path + " HTTP/1.1\r\nHost: " + opt.host + "\r\n"
+        "Connection: close\r\n";
+    if (!contentType.empty()) header += "Content-Type: " + contentType + "\r\n";
+    header += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    if (sendAll(fd, header.data(), header.size()) && sendAll(fd, body.data(), body.size())) {
+        response = readResponse(fd);
+    }
+    close(fd);
+    return response;
+}
+
+// Value of a string field in a flat JSON body (enough for the server's replies)
+static std::string jsonString(const std::string& body, const std::string& key) {
+    size_t pos = body.find("\"" + key + "\"");
+    if (pos == std::string::npos) return "";
+    pos = body.find('"', body.find(':', pos) + 1);
+    if (pos == std::string::npos) return "";
+    size_t end = body.find('"', pos + 1);
+    return end == std::string::npos ? "" : body.substr(pos + 1, end - pos - 1);
+}
+
+// Value of a numeric field, or -1 when it is missing
+static long jsonNumber(const std::string& body, const std::string& key) {
+    size_t pos = body.find("\"" + key + "\"");
+    if (pos == std::string::npos) return -1;
+    return std::strtol(body.c_str() + body.find(':', pos) + 1, nullptr, 10);
+}
+
+static const std::string BOUNDARY = "----konvertorremote";
+
+static std::string formField(const std::string& name, const std::string& value) {
+    return "--" + BOUNDARY + "\r\nContent-Disposition: form-data; name=\"" + name + "\"\r\n\r\n" + value + "\r\n";
+}
+
+static std::string formFile(const std::string& filename, const std::string& data) {
+    return "--" + BOUNDARY + "\r\nContent-Disposition: form-data; name=\"file\"; filename=\"" + filename +
+           "\"\r\nContent-Type: application/octet-stream\r\n\r\n" + data + "\r\n";
+}
+
+static std::string convertForm(const std::string& format, const std::string& filename, const std::string& data,
+                               bool progressive) {
+    return formField("format", format) + formField("quality", "medium") +
+           (progressive ? formField("progressive", "1") : "") + formFile(filename, data) + "--" + BOUNDARY + "--\r\n";
+}
+
+// ---------------------------------------------------------------------------
+// Processes
+
+static pid_t spawn(std::vector<std::string> args) {
+    std::vector<char*> argv;
+    for (auto& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    pid_t child = fork();
+    if (child == 0) {
+        // Own group, so a signal also reaches the worker's ffmpeg children
+        setpgid(0, 0);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    if (child > 0) setpgid(child, child);
+    return child;
+}
+
+static bool runToEnd(const std::vector<std::string>& args) {
+    pid_t child = spawn(args);
+    if (child < 0) return false;
+    int status = 0;
+    while (waitpid(child, &status, 0) == -1 && errno == EINTR) {}
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Generates a short video with an audio track using ffmpeg's test sources
+static bool makeClip(const std::string& path) {
+    return runToEnd({"ffmpeg", "-nostdin", "-loglevel", "error",
+                     "-f", "lavfi", "-i", "sine=frequency=440:duration=4",
+                     "-f", "lavfi", "-i", "color=c=black:s=64x64:r=10:d=4",
+                     "-shortest", "-c:v", "mpeg4", "-c:a", "aac", "-y", path});
+}
+
+// Generates an uncompressed WAV, large for its length
+static bool makeWav(const std::string& path, int seconds) {
+    return runToEnd({"ffmpeg", "-nostdin", "-loglevel", "error",
+                     "-f", "lavfi", "-i", "sine=frequency=440:duration=" + std::to_string(seconds),
+                     "-ac", "2", "-ar", "48000", "-c:a", "pcm_s16le", "-y", path});
+}
+
+static std::string readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+static Response stats(const Options& opt) {
+    return request(opt, "", "GET", "/api/stats", "", "");
+}
+
+// ---------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        std::string value = argv[i + 1];
+        if (key == "--host") opt.host = value;
+        else if (key == "--port") opt.port = std::atoi(value.c_str());
+        else if (key == "--worker") opt.worker = value;
+        else if (key == "--connect") opt.connect = value;
+        else if (key == "--workers") opt.workers = std::max(1, std::atoi(value.c_str()));
+        else if (key == "--slots") opt.slots = std::max(1, std::atoi(value.c_str()));
+        else if (key == "--shared-path") opt.sharedPath = value == "1" || value == "true";
+        else if (key == "--jobs") opt.jobs = std::max(1, std::atoi(value.c_str()));
+        else if (key == "--clip-seconds") opt.clipSeconds = std::max(1, std::atoi(value.c_str()));
+        else if (key == "--stall-one") opt.stallOne = value == "1" || value == "true";
+        else if (key == "--timeout-seconds") opt.timeoutSeconds = std::max(10, std::atoi(value.c_str()));
+        else if (key == "--token-file") opt.tokenFile = value;
+        else {
+            fprintf(stderr, "Unknown option %s\n", key.c_str());
+            return 2;
+        }
+    }
+
+    Response before = stats(opt);
+    if (before.status != 200) {
+        fprintf(stderr, "Server not reachable at http://%s:%d\n", opt.host.c_str(), opt.port);
+        return 2;
+    }
+    if (jsonNumber(before.body, "workers") < 0) {
+        fprintf(stderr, "Server has no remote executor; set custom_config.remote.enabled\n");
+        return 2;
+    }
+    long baseWorkers = jsonNumber(before.body, "workers");
+
+    char dirTemplate[] = "/tmp/konvertor-remote-XXXXXX";
+    const char* tempDir = mkdtemp(dirTemplate);
+    std::string dir = tempDir ? tempDir : "/tmp";
+    if (!tempDir || !makeWav(dir + "/long.wav", opt.clipSeconds) || !makeClip(dir + "/short.mp4")) {
+        fprintf(stderr, "Could not generate the test clips (is ffmpeg installed?)\n");
+        return 2;
+    }
+    std::string longClip = readFile(dir + "/long.wav");
+    std::string shortClip = readFile(dir + "/short.mp4");
+
+    // One private work directory per worker, as separate hosts would have
+    std::vector<pid_t> workers;
+    for (int i = 0; i < opt.workers; ++i) {
+        std::string name = "local-" + std::to_string(i);
+        std::vector<std::string> args = {opt.worker, "--connect", opt.connect, "--name", name,
+                                         "--slots", std::to_string(opt.slots), "--shared-path", opt.sharedPath ? "1" : "0",
+                                         "--work-dir", dir + "/" + name};
+        if (!opt.tokenFile.empty()) args.insert(args.end(), {"--token-file", opt.tokenFile});
+        workers.push_back(spawn(args));
+    }
+    auto stopWorkers = [&]() {
+        for (pid_t& pid : workers) {
+            if (pid <= 0) continue;
+            kill(-pid, SIGKILL);
+            while (waitpid(pid, nullptr, 0) == -1 && errno == EINTR) {}
+            pid = 0;
+        }
+    };
+    auto cleanup = [&]() {
+        stopWorkers();
+        std::string command = "rm -rf " + dir;
+        if (system(command.c_str()) != 0) fprintf(stderr, "Could not remove %s\n", dir.c_str());
+    };
+
+    long expected = baseWorkers + opt.workers * opt.slots;
+    long connected = 0;
+    auto connectEnd = Clock::now() + std::chrono::seconds(20);
+    while (Clock::now() < connectEnd && (connected = jsonNumber(stats(opt).body, "workers")) < expected) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    printf("Started %d workers x %d slots (%s), %ld connected\n", opt.workers, opt.slots,
+           opt.sharedPath ? "shared path" : "inline transfer", connected);
+    if (connected < expected) {
+        printf("\nFAIL: expected %ld connected worker slots\n", expected);
+        cleanup();
+        return 1;
+    }
+
+    // All conversions at once, spread over source addresses to stay under the per-IP limits
+    std::string contentType = "multipart/form-data; boundary=" + BOUNDARY;
+    std::atomic<int> converted{0};
+    std::atomic<int> running{opt.jobs};
+    std::vector<std::thread> clients;
+    auto start = Clock::now();
+    for (int i = 0; i < opt.jobs; ++i) {
+        clients.emplace_back([&, i]() {
+            std::string source = opt.host.rfind("127.", 0) == 0 ? "127.0.0." + std::to_string(2 + i % 253) : "";
+            std::string body = convertForm(i % 2 ? "mp3" : "ogg", "remote" + std::to_string(i) + ".wav", longClip, false);
+            Response response = request(opt, source, "POST", "/api/convert", contentType, body);
+            std::string url = jsonString(response.body, "download_url");
+            Response output;
+            if (response.status == 200 && !url.empty()) output = request(opt, source, "GET", url, "", "");
+            bool ok = output.status == 200 && !output.body.empty();
+            if (ok) ++converted;
+            printf("  job %-3d convert %d, download %d%s\n", i, response.status, output.status, ok ? "" : "  FAIL");
+            fflush(stdout);
+            --running;
+        });
+    }
+
+    // Watch the leases: without any, the workers were never used
+    long peakLeases = 0;
+    bool stalled = !opt.stallOne;
+    while (running > 0) {
+        long leases = jsonNumber(stats(opt).body, "active_leases");
+        peakLeases = std::max(peakLeases, leases);
+        if (!stalled && leases > 0) {
+            // Freeze a worker once leases are out; its lease must expire and run elsewhere
+            kill(-workers[0], SIGSTOP);
+            printf("Stalled worker local-0 (pid %d)\n", workers[0]);
+            stalled = true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    for (auto& client : clients) client.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    // Leases end with their jobs; anything left was lost by the dispatcher
+    long leases = 0;
+    auto settleEnd = Clock::now() + std::chrono::seconds(10);
+    while ((leases = jsonNumber(stats(opt).body, "active_leases")) > 0 && Clock::now() < settleEnd) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    stopWorkers();
+
+    printf("\n%d/%d conversions in %.1fs, peak %ld leases, %ld leases left\n", converted.load(), opt.jobs, seconds,
+           peakLeases, leases);
+    bool failed = converted != opt.jobs || leases != 0;
+    if (peakLeases == 0) {
+        printf("  FAIL: no job was leased (is local_workers 0, and is --clip-seconds past scratch.max_job_mb?)\n");
+        failed = true;
+    }
+
+    // Jobs that must stay in-process: with no worker left, a leasable job would wait forever
+    long remaining = baseWorkers + 1;
+    auto goneEnd = Clock::now() + std::chrono::seconds(10);
+    while ((remaining = jsonNumber(stats(opt).body, "workers")) > baseWorkers && Clock::now() < goneEnd) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    if (baseWorkers > 0 || remaining > 0) {
+        printf("\nLocal-only jobs: skipped, other workers are connected\n");
+    } else {
+        Options quick = opt;
+        quick.timeoutSeconds = 60;
+        printf("\nLocal-only jobs (no worker connected):\n");
+
+        // Progressive: the large clip, so only streaming keeps it from being leased
+        Response progressive = request(quick, "127.0.0.2", "POST", "/api/convert", contentType,
+                                       convertForm("mp3", "progressive.wav", longClip, true));
+        bool streamed = progressive.status == 200 && !jsonString(progressive.body, "stream_url").empty();
+        printf("  progressive convert %d%s\n", progressive.status, streamed ? "" : "  FAIL");
+
+        // Scratch tier: the short clip fits scratch.max_job_mb
+        Response scratch = request(quick, "127.0.0.3", "POST", "/api/convert", contentType,
+                                   convertForm("ogg", "scratch.mp4", shortClip, false));
+        bool local = scratch.status == 200 && !jsonString(scratch.body, "download_url").empty();
+        printf("  scratch convert %d%s\n", scratch.status, local ? "" : "  FAIL");
+        failed = failed || !streamed || !local;
+    }
+    cleanup();
+
+    printf("\n%s\n", failed ? "FAIL" : "PASS");
+    return failed ? 1 : 0;
+}
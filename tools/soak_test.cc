@@ -0,0 +1,600 @@
+/*
+ * Copyright (C) 2026 Kyaw Tun Linn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+/**
+ * @file soak_test.cc
+ * @brief Drives a live server with mixed traffic for a long time and fails on resource growth.
+ *
+ * Client threads loop over a weighted mix of requests:
+ * - convert: POST a small generated clip to /api/convert, then GET the output.
+ * - zip:     POST /api/zip with recent outputs.
+ * - static:  GET a static page.
+ * - abort:   start an upload and disconnect halfway, or send a whole
+ *            conversion and disconnect before the response.
+ * - batch:   POST two clips to /api/batch.
+ *
+ * Meanwhile /proc/<pid> of the server is sampled: RSS, open FDs, threads,
+ * child processes, zombie children and files under its ./uploads/, plus the
+ * rate limiter's tracked clients from /api/stats. After the
+ * warm-up, a least-squares slope per hour is fitted to each metric and the
+ * run fails if any slope exceeds its limit. Once traffic stops, every child
+ * must exit and no zombie may remain within the settle time.
+ *
+ * The test clip is generated with ffmpeg (lavfi sine + color), so any Linux
+ * box with ffmpeg can run it. Requests are spread over 127.0.0.2-254 source
+ * addresses so the per-IP rate limit does not end the conversions early;
+ * 429 responses are still counted as valid outcomes. With --fresh-ips 1 every
+ * request uses a new 127.x.y.z address instead, so the limiter sees an
+ * unbounded number of clients; its entries live for its one-hour window, so
+ * set --warmup-minutes past 60 in that mode.
+ *
+ * Usage: konvertor_soak [--host 127.0.0.1] [--port 8080] [--pid PID] [--minutes 60]
+ *        [--warmup-minutes 5] [--sample-seconds 5] [--clients 4] [--settle-seconds 60]
+ *        [--mix convert=30,zip=5,static=40,abort=15,batch=10] [--fresh-ips 0]
+ *        [--max-rss-kb-per-hour 20480] [--max-fds-per-hour 20] [--max-threads-per-hour 4]
+ *        [--max-children-per-hour 4] [--max-zombies-per-hour 1] [--max-uploads-per-hour 20]
+ *        [--max-limiter-clients-per-hour 100]
+ */
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    int pid = 0; // 0: find the process named "konvertor"
+    double minutes = 60;
+    double warmupMinutes = 5;
+    int sampleSeconds = 5;
+    int clients = 4;
+    int settleSeconds = 60;
+    std::string staticPath = "/index.html";
+    bool freshIps = false; // A new source address per request
+    std::map<std::string, int> mix = {{"convert", 30}, {"zip", 5}, {"static", 40}, {"abort", 15}, {"batch", 10}};
+};
+
+// One resource the sampler tracks, with its allowed growth
+struct Metric {
+    const char* name;
+    double maxPerHour;
+};
+
+static Metric metrics[] = {
+    {"rss_kb", 20480}, {"fds", 20}, {"threads", 4}, {"children", 4}, {"zombies", 1}, {"uploads", 20},
+    {"limiter_clients", 100},
+};
+static const size_t METRIC_COUNT = sizeof(metrics) / sizeof(metrics[0]);
+
+struct Sample {
+    double hours = 0; // Since the start of the run
+    double values[METRIC_COUNT] = {};
+};
+
+// ---------------------------------------------------------------------------
+// HTTP
+
+struct Response {
+    int status = -1;
+    std::string body;
+};
+
+static int connectTo(const Options& opt, const std::string& sourceIp) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    // A stalled server must not hang a client forever
+    struct timeval timeout = {120, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    if (!sourceIp.empty()) {
+        sockaddr_in local{};
+        local.sin_family = AF_INET;
+        inet_pton(AF_INET, sourceIp.c_str(), &local.sin_addr);
+        if (bind(fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0) {
+            close(fd);
+            return -1;
+        }
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(opt.port));
+    if (inet_pton(AF_INET, opt.host.c_str(), &addr.sin_addr) != 1 ||
+        connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool sendAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Reads one HTTP response with a Content-Length body (Connection: close)
+static Response readResponse(int fd) {
+    Response response;
+    std::string buffer;
+    char chunk[16 * 1024];
+    size_t headerEnd = std::string::npos;
+    while (headerEnd == std::string::npos) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return response;
+        buffer.append(chunk, static_cast<size_t>(n));
+        headerEnd = buffer.find("\r\n\r\n");
+    }
+
+    std::string headers = buffer.substr(0, headerEnd);
+    std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+    size_t lengthPos = headers.find("content-length:");
+    if (lengthPos == std::string::npos) return response; // This tool does not parse chunked bodies
+    size_t bodyLength = std::strtoull(headers.c_str() + lengthPos + 15, nullptr, 10);
+
+    response.body = buffer.substr(headerEnd + 4);
+    while (response.body.size() < bodyLength) {
+        ssize_t n = recv(fd, chunk, std::min(sizeof(chunk), bodyLength - response.body.size()), 0);
+        if (n <= 0) return response;
+        response.body.append(chunk, static_cast<size_t>(n));
+    }
+    response.status = buffer.size() > 12 ? std::atoi(buffer.c_str() + 9) : -1;
+    return response;
+}
+
+static Response request(const Options& opt, const std::string& source, const std::string& method,
+                        const std::string& path, const std::string& contentType, const std::string& body) {
+    Response response;
+    int fd = connectTo(opt, source);
+    if (fd < 0) return response;
+    std::string header = method + " " + path + " HTTP/1.1\r\nHost: " + opt.host + "\r\n"
+        "Connection: close\r\n";
+    if (!contentType.empty()) header += "Content-Type: " + contentType + "\r\n";
+    header += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    if (sendAll(fd, header.data(), header.size()) && sendAll(fd, body.data(), body.size())) {
+        response = readResponse(fd);
+    }
+    close(fd);
+    return response;
+}
+
+// Value of a string field in a flat JSON body (enough for the server's replies)
+static std::string jsonString(const std::string& body, const std::string& key) {
+    size_t pos = body.find("\"" + key + "\"");
+    if (pos == std::string::npos) return "";
+    pos = body.find('"', body.find(':', pos) + 1);
+    if (pos == std::string::npos) return "";
+    size_t end = body.find('"', pos + 1);
+    return end == std::string::npos ? "" : body.substr(pos + 1, end - pos - 1);
+}
+
+static const std::string BOUNDARY = "----konvertorsoak";
+
+static std::string formField(const std::string& name, const std::string& value) {
+    return "--" + BOUNDARY + "\r\nContent-Disposition: form-data; name=\"" + name + "\"\r\n\r\n" + value + "\r\n";
+}
+
+static std::string formFile(const std::string& filename, const std::string& data) {
+    return "--" + BOUNDARY + "\r\nContent-Disposition: form-data; name=\"file\"; filename=\"" + filename +
+           "\"\r\nContent-Type: video/mp4\r\n\r\n" + data + "\r\n";
+}
+
+// ---------------------------------------------------------------------------
+// Traffic
+
+struct Traffic {
+    std::mutex mutex;
+    std::map<std::string, std::map<int, int>> statuses; // kind -> status -> count
+    std::deque<std::string> outputs;                    // Recent output filenames, for zip requests
+
+    void count(const std::string& kind, int status) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++statuses[kind][status];
+    }
+};
+
+static void client(const Options& opt, int index, const std::string& clip, const std::atomic<bool>& stop,
+                   Traffic& traffic) {
+    static const char* formats[] = {"mp3", "aac", "ogg", "opus", "wav", "flac", "m4a"};
+    static const char* qualities[] = {"high", "medium", "low", "podcast"};
+    std::mt19937 rng(static_cast<unsigned>(index * 7919 + 17));
+    int totalWeight = 0;
+    for (const auto& [kind, weight] : opt.mix) totalWeight += weight;
+    std::string contentType = "multipart/form-data; boundary=" + BOUNDARY;
+    bool loopback = opt.host.rfind("127.", 0) == 0;
+    int round = 0;
+    static std::atomic<uint32_t> nextFreshIp{0};
+
+    while (!stop) {
+        int pick = static_cast<int>(rng() % static_cast<unsigned>(std::max(1, totalWeight)));
+        std::string kind;
+        for (const auto& [name, weight] : opt.mix) {
+            if (pick < weight) {
+                kind = name;
+                break;
+            }
+            pick -= weight;
+        }
+
+        // Spread requests over 127.0.0.2-254 to stay under the per-IP limits
+        std::string source;
+        if (loopback && opt.freshIps) {
+            // 127.1-254.0-255.1-254: about 16 million limiter keys before one repeats
+            uint32_t n = nextFreshIp++;
+            source = "127." + std::to_string(1 + n / (254 * 256) % 254) + "." + std::to_string(n / 254 % 256) +
+                     "." + std::to_string(1 + n % 254);
+        } else if (loopback) {
+            source = "127.0.0." + std::to_string(2 + (index * 31 + round++) % 253);
+        }
+
+        std::string format = formats[rng() % 7];
+        std::string options = formField("format", format) + formField("quality", qualities[rng() % 4]);
+
+        if (kind == "convert") {
+            std::string body = options + formFile("soak.mp4", clip) + "--" + BOUNDARY + "--\r\n";
+            Response response = request(opt, source, "POST", "/api/convert", contentType, body);
+            traffic.count(kind, response.status);
+            std::string url = jsonString(response.body, "download_url");
+            if (response.status == 200 && !url.empty()) {
+                traffic.count("download", request(opt, source, "GET", url, "", "").status);
+                std::lock_guard<std::mutex> lock(traffic.mutex);
+                traffic.outputs.push_back(url.substr(url.rfind('/') + 1));
+                if (traffic.outputs.size() > 32) traffic.outputs.pop_front();
+            }
+        } else if (kind == "zip") {
+            std::string files;
+            {
+                std::lock_guard<std::mutex> lock(traffic.mutex);
+                for (size_t i = 0; i < traffic.outputs.size() && i < 4; ++i) {
+                    files += (files.empty() ? "\"" : ",\"") + traffic.outputs[traffic.outputs.size() - 1 - i] + "\"";
+                }
+            }
+            if (files.empty()) continue;
+            Response response = request(opt, source, "POST", "/api/zip", "application/json",
+                                        "{\"files\":[" + files + "]}");
+            traffic.count(kind, response.status);
+        } else if (kind == "static") {
+            traffic.count(kind, request(opt, source, "GET", opt.staticPath, "", "").status);
+        } else if (kind == "abort") {
+            int fd = connectTo(opt, source);
+            if (fd < 0) {
+                traffic.count(kind, -1);
+                continue;
+            }
+            std::string body = options + formFile("abort.mp4", clip) + "--" + BOUNDARY + "--\r\n";
+            std::string header = "POST /api/convert HTTP/1.1\r\nHost: " + opt.host + "\r\n"
+                "Content-Type: " + contentType + "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+            sendAll(fd, header.data(), header.size());
+            if (rng() % 2 == 0) {
+                // Disconnect halfway through the upload
+                sendAll(fd, body.data(), body.size() / 2);
+            } else {
+                // Complete the upload, then leave before the conversion answers
+                sendAll(fd, body.data(), body.size());
+                std::this_thread::sleep_for(std::chrono::milliseconds(rng() % 500));
+            }
+            close(fd);
+            traffic.count(kind, 0);
+        } else if (kind == "batch") {
+            std::string body = options + formFile("batch1.mp4", clip) + formFile("batch2.mp4", clip) +
+                               "--" + BOUNDARY + "--\r\n";
+            traffic.count(kind, request(opt, source, "POST", "/api/batch", contentType, body).status);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Sampling /proc and /api/stats
+
+// Value of a numeric field in a JSON body, or -1 when it is missing
+static double jsonNumber(const std::string& body, const std::string& key) {
+    size_t pos = body.find("\"" + key + "\"");
+    if (pos == std::string::npos) return -1;
+    return std::atof(body.c_str() + body.find(':', pos) + 1);
+}
+
+static bool readSample(const Options& opt, double values[METRIC_COUNT]) {
+    int pid = opt.pid;
+    std::string proc = "/proc/" + std::to_string(pid);
+    std::ifstream status(proc + "/status");
+    if (!status) return false;
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmRSS:", 0) == 0) values[0] = std::atof(line.c_str() + 6);
+        else if (line.rfind("Threads:", 0) == 0) values[2] = std::atof(line.c_str() + 8);
+    }
+
+    auto countEntries = [](const std::string& path, bool regularOnly) {
+        double count = 0;
+        DIR* dir = opendir(path.c_str());
+        if (!dir) return count;
+        while (struct dirent* entry = readdir(dir)) {
+            if (entry->d_name[0] == '.') continue;
+            if (regularOnly && entry->d_type != DT_REG) continue;
+            ++count;
+        }
+        closedir(dir);
+        return count;
+    };
+    values[1] = countEntries(proc + "/fd", false);
+    values[5] = countEntries(proc + "/cwd/uploads", true);
+
+    // A server that stops answering counts as gone, like a missing /proc entry
+    Response stats = request(opt, "", "GET", "/api/stats", "", "");
+    values[6] = stats.status == 200 ? jsonNumber(stats.body, "tracked_clients") : -1;
+    if (values[6] < 0) return false;
+
+    // Children (any state) and zombies: scan every process for this parent
+    values[3] = values[4] = 0;
+    DIR* dir = opendir("/proc");
+    if (!dir) return true;
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9') continue;
+        std::ifstream stat(std::string("/proc/") + entry->d_name + "/stat");
+        std::string content;
+        if (!std::getline(stat, content)) continue;
+        // Fields after the parenthesised command name: state ppid ...
+        size_t close = content.rfind(')');
+        if (close == std::string::npos) continue;
+        char state = 0;
+        int ppid = 0;
+        if (sscanf(content.c_str() + close + 1, " %c %d", &state, &ppid) != 2 || ppid != pid) continue;
+        values[3] += 1;
+        if (state == 'Z') values[4] += 1;
+    }
+    closedir(dir);
+    return true;
+}
+
+static int findServer() {
+    DIR* dir = opendir("/proc");
+    if (!dir) return 0;
+    int found = 0;
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9') continue;
+        std::ifstream comm(std::string("/proc/") + entry->d_name + "/comm");
+        std::string name;
+        if (std::getline(comm, name) && name == "konvertor") {
+            found = std::atoi(entry->d_name);
+            break;
+        }
+    }
+    closedir(dir);
+    return found;
+}
+
+// Least-squares slope of one metric, in units per hour
+static double slopePerHour(const std::vector<Sample>& samples, size_t metric) {
+    double n = static_cast<double>(samples.size());
+    double sumX = 0, sumY = 0;
+    for (const auto& s : samples) {
+        sumX += s.hours;
+        sumY += s.values[metric];
+    }
+    double meanX = sumX / n, meanY = sumY / n;
+    double cov = 0, var = 0;
+    for (const auto& s : samples) {
+        cov += (s.hours - meanX) * (s.values[metric] - meanY);
+        var += (s.hours - meanX) * (s.hours - meanX);
+    }
+    return var > 0 ? cov / var : 0;
+}
+
+static void printSample(const Sample& sample) {
+    printf("%8.1fmin", sample.hours * 60);
+    for (size_t m = 0; m < METRIC_COUNT; ++m) printf("  %s %-8.0f", metrics[m].name, sample.values[m]);
+    printf("\n");
+    fflush(stdout);
+}
+
+// ---------------------------------------------------------------------------
+
+// Generates a short video with an audio track using ffmpeg's test sources
+static bool makeClip(const std::string& path) {
+    std::vector<std::string> args = {
+        "ffmpeg", "-nostdin", "-loglevel", "error",
+        "-f", "lavfi", "-i", "sine=frequency=440:duration=4",
+        "-f", "lavfi", "-i", "color=c=black:s=64x64:r=10:d=4",
+        "-shortest", "-c:v", "mpeg4", "-c:a", "aac", "-y", path};
+    std::vector<char*> argv;
+    for (auto& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    pid_t child = fork();
+    if (child < 0) return false;
+    if (child == 0) {
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    while (waitpid(child, &status, 0) == -1 && errno == EINTR) {}
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static bool parseMix(const std::string& text, std::map<std::string, int>& mix) {
+    std::map<std::string, int> parsed;
+    std::stringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) return false;
+        std::string kind = item.substr(0, eq);
+        if (kind != "convert" && kind != "zip" && kind != "static" && kind != "abort" && kind != "batch") return false;
+        parsed[kind] = std::max(0, std::atoi(item.c_str() + eq + 1));
+    }
+    mix = parsed;
+    return !mix.empty();
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        std::string value = argv[i + 1];
+        if (key == "--host") opt.host = value;
+        else if (key == "--port") opt.port = std::atoi(value.c_str());
+        else if (key == "--pid") opt.pid = std::atoi(value.c_str());
+        else if (key == "--minutes") opt.minutes = std::max(0.1, std::atof(value.c_str()));
+        else if (key == "--warmup-minutes") opt.warmupMinutes = std::max(0.0, std::atof(value.c_str()));
+        else if (key == "--sample-seconds") opt.sampleSeconds = std::max(1, std::atoi(value.c_str()));
+        else if (key == "--clients") opt.clients = std::max(1, std::atoi(value.c_str()));
+        else if (key == "--settle-seconds") opt.settleSeconds = std::max(0, std::atoi(value.c_str()));
+        else if (key == "--path") opt.staticPath = value;
+        else if (key == "--fresh-ips") opt.freshIps = value == "1" || value == "true";
+        else if (key == "--mix") {
+            if (!parseMix(value, opt.mix)) {
+                fprintf(stderr, "Invalid --mix %s\n", value.c_str());
+                return 2;
+            }
+        } else {
+            // --max-<metric>-per-hour, with dashes for underscores (--max-rss-kb-per-hour)
+            bool matched = false;
+            for (auto& metric : metrics) {
+                std::string flag = std::string("--max-") + metric.name + "-per-hour";
+                std::replace(flag.begin(), flag.end(), '_', '-');
+                if (key == flag) {
+                    metric.maxPerHour = std::atof(value.c_str());
+                    matched = true;
+                }
+            }
+            if (!matched) {
+                fprintf(stderr, "Unknown option %s\n", key.c_str());
+                return 2;
+            }
+        }
+    }
+
+    if (opt.pid == 0) opt.pid = findServer();
+    double probe[METRIC_COUNT] = {};
+    if (opt.pid == 0 || !readSample(opt, probe)) {
+        fprintf(stderr, "Server process not found or not answering /api/stats; start konvertor or pass --pid\n");
+        return 2;
+    }
+
+    char dirTemplate[] = "/tmp/konvertor-soak-XXXXXX";
+    const char* tempDir = mkdtemp(dirTemplate);
+    std::string clipPath = std::string(tempDir ? tempDir : "/tmp") + "/clip.mp4";
+    if (!tempDir || !makeClip(clipPath)) {
+        fprintf(stderr, "Could not generate the test clip (is ffmpeg installed?)\n");
+        return 2;
+    }
+    std::ifstream clipFile(clipPath, std::ios::binary);
+    std::string clip((std::istreambuf_iterator<char>(clipFile)), std::istreambuf_iterator<char>());
+    unlink(clipPath.c_str());
+    rmdir(tempDir);
+
+    printf("Soaking pid %d at http://%s:%d for %.1f min (warm-up %.1f min), %d clients, sample every %ds\n",
+           opt.pid, opt.host.c_str(), opt.port, opt.minutes, opt.warmupMinutes, opt.clients, opt.sampleSeconds);
+
+    std::atomic<bool> stop{false};
+    Traffic traffic;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < opt.clients; ++i) {
+        threads.emplace_back(client, std::cref(opt), i, std::cref(clip), std::cref(stop), std::ref(traffic));
+    }
+
+    auto start = Clock::now();
+    auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opt.minutes * 60));
+    std::vector<Sample> samples;
+    bool alive = true;
+    while (Clock::now() < end) {
+        std::this_thread::sleep_for(std::chrono::seconds(opt.sampleSeconds));
+        Sample sample;
+        sample.hours = std::chrono::duration<double>(Clock::now() - start).count() / 3600.0;
+        if (!readSample(opt, sample.values)) {
+            alive = false;
+            break;
+        }
+        printSample(sample);
+        if (sample.hours * 60 >= opt.warmupMinutes) samples.push_back(sample);
+    }
+    stop = true;
+    for (auto& thread : threads) thread.join();
+
+    printf("\nRequests:\n");
+    for (const auto& [kind, statuses] : traffic.statuses) {
+        printf("  %-9s", kind.c_str());
+        for (const auto& [status, count] : statuses) printf(" %d x%d", status, count);
+        printf("\n");
+    }
+
+    if (!alive) {
+        printf("\nFAIL: server pid %d exited or stopped answering during the run\n", opt.pid);
+        return 1;
+    }
+
+    bool failed = false;
+    printf("\nGrowth after warm-up (%zu samples):\n", samples.size());
+    if (samples.size() < 10) {
+        printf("  not enough samples; run longer than the warm-up\n");
+        failed = true;
+    } else {
+        for (size_t m = 0; m < METRIC_COUNT; ++m) {
+            double slope = slopePerHour(samples, m);
+            bool over = slope > metrics[m].maxPerHour;
+            failed = failed || over;
+            printf("  %-9s %10.2f/hour (limit %.2f)%s\n", metrics[m].name, slope, metrics[m].maxPerHour,
+                   over ? "  FAIL" : "");
+        }
+    }
+
+    // With traffic gone, every ffmpeg/zip child must finish and be reaped
+    Sample settled;
+    bool settledRead = false;
+    auto settleEnd = Clock::now() + std::chrono::seconds(opt.settleSeconds);
+    while ((settledRead = readSample(opt, settled.values)) && (settled.values[3] > 0 || settled.values[4] > 0) &&
+           Clock::now() < settleEnd) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+    if (!settledRead) {
+        // No sample means no evidence the children exited: the server died or stopped answering
+        printf("\nFAIL: server pid %d could not be sampled after traffic stopped\n", opt.pid);
+        return 1;
+    }
+    printf("After traffic stopped: children %.0f, zombies %.0f, fds %.0f, uploads %.0f\n",
+           settled.values[3], settled.values[4], settled.values[1], settled.values[5]);
+    if (settled.values[3] > 0 || settled.values[4] > 0) {
+        printf("  FAIL: child processes left behind\n");
+        failed = true;
+    }
+
+    printf("\n%s\n", failed ? "FAIL" : "PASS");
+    return failed ? 1 : 0;
+}
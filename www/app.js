@@ -150,36 +150,55 @@ document.addEventListener('DOMContentLoaded', () => {
         resultArea.style.display = 'none';
 
         const downloadUrls = [];
+        let zipEndpoint = null;
 
-        // Process files sequentially
-        for (let i = 0; i < selectedFiles.length; i++) {
-            const file = selectedFiles[i];
-            const statusSpan = document.getElementById(`status-${i}`);
-
-            if (statusSpan) {
-                statusSpan.textContent = 'Converting...';
-                statusSpan.style.color = 'var(--accent-color)';
-            }
-
+        if (selectedFiles.length > 1) {
+            // One streamed request: the server converts each file as soon as it has arrived
             try {
-                const downloadUrl = await convertSingleFile(file, i);
-                downloadUrls.push(downloadUrl);
+                const batch = await convertBatch(selectedFiles);
+                downloadUrls.push(...batch.downloadUrls);
+                zipEndpoint = batch.zipUrl;
+            } catch (error) {
+                console.error('Batch request error:', error);
+                selectedFiles.forEach((file, i) => {
+                    const statusSpan = document.getElementById(`status-${i}`);
+                    if (statusSpan && !statusSpan.querySelector('a')) {
+                        statusSpan.textContent = '✗ Failed';
+                        statusSpan.style.color = 'var(--error-color)';
+                    }
+                });
+            }
+        } else {
+            // Single file: plain conversion request
+            for (let i = 0; i < selectedFiles.length; i++) {
+                const file = selectedFiles[i];
+                const statusSpan = document.getElementById(`status-${i}`);
 
                 if (statusSpan) {
-                    statusSpan.innerHTML = `
-                        <a href="${downloadUrl}" download class="batch-download-btn">
-                            <svg viewBox="0 0 24 24" width="16" height="16" fill="none" stroke="currentColor" stroke-width="2" stroke-linecap="round" stroke-linejoin="round">
-                                <path d="M21 15v4a2 2 0 0 1-2 2H5a2 2 0 0 1-2-2v-4"></path>
-                                <polyline points="7 10 12 15 17 10"></polyline>
-                                <line x1="12" y1="15" x2="12" y2="3"></line>
-                            </svg>
-                            Download
-                        </a>`;
+                    statusSpan.textContent = 'Converting...';
+                    statusSpan.style.color = 'var(--accent-color)';
                 }
-            } catch (error) {
-                if (statusSpan) {
-                    statusSpan.textContent = '✗ Failed';
-                    statusSpan.style.color = 'var(--error-color)';
+
+                try {
+                    const downloadUrl = await convertSingleFile(file, i);
+                    downloadUrls.push(downloadUrl);
+
+                    if (statusSpan) {
+                        statusSpan.innerHTML = `
+                            <a href="${downloadUrl}" download class="batch-download-btn">
+                                <svg viewBox="0 0 24 24" width="16" height="16" fill="none" stroke="currentColor" stroke-width="2" stroke-linecap="round" stroke-linejoin="round">
+                                    <path d="M21 15v4a2 2 0 0 1-2 2H5a2 2 0 0 1-2-2v-4"></path>
+                                    <polyline points="7 10 12 15 17 10"></polyline>
+                                    <line x1="12" y1="15" x2="12" y2="3"></line>
+                                </svg>
+                                Download
+                            </a>`;
+                    }
+                } catch (error) {
+                    if (statusSpan) {
+                        statusSpan.textContent = '✗ Failed';
+                        statusSpan.style.color = 'var(--error-color)';
+                    }
                 }
             }
         }
@@ -206,13 +225,18 @@ document.addEventListener('DOMContentLoaded', () => {
             // New Zip Logic
             const files = downloadUrls.map(url => url.split('/').pop()); // Extract filenames
 
-            fetch('/api/zip', {
-                method: 'POST',
-                headers: {
-                    'Content-Type': 'application/json',
-                },
-                body: JSON.stringify({ files: files })
-            })
+            // A finished batch zips its own outputs
+            const zipRequest = zipEndpoint
+                ? fetch(zipEndpoint, { method: 'POST' })
+                : fetch('/api/zip', {
+                    method: 'POST',
+                    headers: {
+                        'Content-Type': 'application/json',
+                    },
+                    body: JSON.stringify({ files: files })
+                });
+
+            zipRequest
                 .then(response => response.json())
                 .then(data => {
                     if (data.status === 'success') {
@@ -275,6 +299,12 @@ document.addEventListener('DOMContentLoaded', () => {
             formData.append('format', formatSelect.value);
             formData.append('quality', qualitySelect.value);
 
+            // Random id used to poll /api/progress while the server converts
+            const progressId = (window.crypto && crypto.randomUUID)
+                ? crypto.randomUUID()
+                : Date.now().toString(36) + '-' + Math.random().toString(36).slice(2);
+            formData.append('progress_id', progressId);
+
             const xhr = new XMLHttpRequest();
             xhr.open('POST', '/api/convert', true);
 
@@ -299,28 +329,32 @@ document.addEventListener('DOMContentLoaded', () => {
                 }
             };
 
-            // Upload complete, start simulated conversion progress
+            // Upload complete, poll the server for real conversion progress
             xhr.upload.onload = function () {
                 if (statusSpan) {
                     statusSpan.textContent = 'Converting...';
                 }
+                if (progressFill && progressPercent) {
+                    progressFill.style.width = '0%';
+                    progressPercent.textContent = '0%';
+                }
 
-                // Simulate conversion progress
-                let conversionProgress = 30;
                 conversionInterval = setInterval(() => {
                     if (xhr.readyState === 4) {
                         clearInterval(conversionInterval);
                         return;
                     }
-                    if (conversionProgress < 95) {
-                        conversionProgress += (Math.random() * 3);
-                        const pct = Math.round(conversionProgress);
-                        if (progressFill && progressPercent) {
-                            progressFill.style.width = pct + '%';
-                            progressPercent.textContent = pct + '%';
-                        }
-                    }
-                }, 300);
+                    fetch(`/api/progress/${progressId}`)
+                        .then(response => response.ok ? response.json() : null)
+                        .then(data => {
+                            if (!data || data.percent === undefined || xhr.readyState === 4) return;
+                            if (progressFill && progressPercent) {
+                                progressFill.style.width = data.percent + '%';
+                                progressPercent.textContent = data.percent + '%';
+                            }
+                        })
+                        .catch(err => console.error('Progress request error:', err));
+                }, 500);
             };
 
             xhr.onload = function () {
@@ -381,6 +415,111 @@ document.addEventListener('DOMContentLoaded', () => {
         });
     }
 
+    function convertBatch(files) {
+        return new Promise((resolve, reject) => {
+            const formData = new FormData();
+            // Options go first: the server applies a field to the files after it
+            formData.append('format', formatSelect.value);
+            formData.append('quality', qualitySelect.value);
+            files.forEach(file => formData.append('file', file));
+
+            const xhr = new XMLHttpRequest();
+            xhr.open('POST', '/api/batch', true);
+
+            function setProgress(index, percent) {
+                const progressFill = document.getElementById(`progress-fill-${index}`);
+                const progressPercent = document.getElementById(`progress-percent-${index}`);
+                if (progressFill && progressPercent) {
+                    progressFill.style.width = percent + '%';
+                    progressPercent.textContent = percent + '%';
+                }
+            }
+
+            function setStatus(index, text, color) {
+                const statusSpan = document.getElementById(`status-${index}`);
+                if (statusSpan && statusSpan.textContent !== text) {
+                    statusSpan.textContent = text;
+                    statusSpan.style.color = color;
+                }
+            }
+
+            // Files are sent in order, so the overall upload position tells which one is in flight
+            xhr.upload.onprogress = function (e) {
+                if (!e.lengthComputable) return;
+                let offset = 0;
+                files.forEach((file, index) => {
+                    const sent = Math.min(Math.max(e.loaded - offset, 0), file.size);
+                    offset += file.size;
+                    if (sent >= file.size) {
+                        setProgress(index, 0);
+                        setStatus(index, 'Converting...', 'var(--accent-color)');
+                    } else if (sent > 0) {
+                        setProgress(index, Math.round((sent / file.size) * 100));
+                        setStatus(index, 'Uploading...', 'var(--accent-color)');
+                    }
+                });
+            };
+
+            // Poll the batch until every file has finished
+            function poll(statusUrl, zipUrl) {
+                fetch(statusUrl)
+                    .then(response => {
+                        if (!response.ok) throw new Error('HTTP error: ' + response.status);
+                        return response.json();
+                    })
+                    .then(data => {
+                        const downloadUrls = [];
+                        data.items.forEach(item => {
+                            const statusSpan = document.getElementById(`status-${item.index}`);
+                            if (item.state === 'done') {
+                                downloadUrls.push(item.download_url);
+                                setProgress(item.index, 100);
+                                if (statusSpan && !statusSpan.querySelector('a')) {
+                                    statusSpan.innerHTML = `
+                                        <a href="${item.download_url}" download class="batch-download-btn">
+                                            <svg viewBox="0 0 24 24" width="16" height="16" fill="none" stroke="currentColor" stroke-width="2" stroke-linecap="round" stroke-linejoin="round">
+                                                <path d="M21 15v4a2 2 0 0 1-2 2H5a2 2 0 0 1-2-2v-4"></path>
+                                                <polyline points="7 10 12 15 17 10"></polyline>
+                                                <line x1="12" y1="15" x2="12" y2="3"></line>
+                                            </svg>
+                                            Download
+                                        </a>`;
+                                }
+                            } else if (item.state === 'failed') {
+                                setStatus(item.index, '✗ Failed', 'var(--error-color)');
+                                if (statusSpan) statusSpan.title = item.error || '';
+                            } else {
+                                setStatus(item.index, 'Converting...', 'var(--accent-color)');
+                                if (item.percent !== undefined) setProgress(item.index, item.percent);
+                            }
+                        });
+
+                        if (data.complete) {
+                            resolve({ downloadUrls: downloadUrls, zipUrl: zipUrl });
+                        } else {
+                            setTimeout(() => poll(statusUrl, zipUrl), 500);
+                        }
+                    })
+                    .catch(reject);
+            }
+
+            xhr.onload = function () {
+                if (xhr.status !== 200) {
+                    reject(new Error('HTTP error: ' + xhr.status));
+                    return;
+                }
+                const response = JSON.parse(xhr.responseText);
+                poll(response.status_url, response.zip_url);
+            };
+
+            xhr.onerror = function () {
+                reject(new Error('Network error'));
+            };
+
+            xhr.send(formData);
+        });
+    }
+
     function finishConversion(url, format) {
         progressContainer.style.display = 'none';
         resultArea.style.display = 'block';